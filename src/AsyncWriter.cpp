@@ -0,0 +1,570 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "AsyncWriter.h"
+#include "Logger.h"
+#include "CpuPlacement.h"
+
+#define DIRECT_ALIGN 4096
+
+using namespace std;
+
+namespace mediakit{
+
+/**
+ * 基于系统调用的最小io_uring封装，只被引擎线程使用
+ */
+class UringRing {
+public:
+    UringRing(uint32_t entries) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        _fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (_fd < 0) {
+            return;
+        }
+
+        _sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            _sq_size = _cq_size = max(_sq_size, _cq_size);
+        }
+        _sq_ptr = (char *) mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+        if (_sq_ptr == MAP_FAILED) {
+            _sq_ptr = nullptr;
+            return;
+        }
+        if (single_mmap) {
+            _cq_ptr = _sq_ptr;
+        } else {
+            _cq_ptr = (char *) mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+            if (_cq_ptr == MAP_FAILED) {
+                _cq_ptr = nullptr;
+                return;
+            }
+        }
+        _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        _sqes = (struct io_uring_sqe *) mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+        if (_sqes == MAP_FAILED) {
+            _sqes = nullptr;
+            return;
+        }
+
+        _sq_tail = (uint32_t *) (_sq_ptr + params.sq_off.tail);
+        _sq_mask = *(uint32_t *) (_sq_ptr + params.sq_off.ring_mask);
+        _sq_array = (uint32_t *) (_sq_ptr + params.sq_off.array);
+        _cq_head = (uint32_t *) (_cq_ptr + params.cq_off.head);
+        _cq_tail = (uint32_t *) (_cq_ptr + params.cq_off.tail);
+        _cq_mask = *(uint32_t *) (_cq_ptr + params.cq_off.ring_mask);
+        _cqes = (struct io_uring_cqe *) (_cq_ptr + params.cq_off.cqes);
+        _ok = true;
+    }
+
+    ~UringRing() {
+        if (_sqes) {
+            munmap(_sqes, _sqes_size);
+        }
+        if (_cq_ptr && _cq_ptr != _sq_ptr) {
+            munmap(_cq_ptr, _cq_size);
+        }
+        if (_sq_ptr) {
+            munmap(_sq_ptr, _sq_size);
+        }
+        if (_fd >= 0) {
+            close(_fd);
+        }
+    }
+
+    bool ok() const {
+        return _ok;
+    }
+
+    bool registerBuffers(const struct iovec *iov, uint32_t count) {
+        return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, iov, count) == 0;
+    }
+
+    bool registerFiles(uint32_t count) {
+        //稀疏注册，打开文件时再更新对应位置
+        vector<int> fds(count, -1);
+        return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES, fds.data(), count) == 0;
+    }
+
+    bool updateFile(uint32_t slot, int fd) {
+        struct io_uring_files_update update;
+        memset(&update, 0, sizeof(update));
+        update.offset = slot;
+        update.fds = (uint64_t) (uintptr_t) &fd;
+        return syscall(__NR_io_uring_register, _fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+    }
+
+    struct io_uring_sqe *getSqe() {
+        auto tail = *_sq_tail + _queued;
+        auto index = tail & _sq_mask;
+        auto sqe = &_sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        _sq_array[index] = index;
+        ++_queued;
+        return sqe;
+    }
+
+    /**
+     * 提交已填写的sqe并等待完成
+     * @param min_complete 至少等待完成的个数
+     */
+    int submit(uint32_t min_complete) {
+        if (_queued) {
+            __atomic_store_n(_sq_tail, *_sq_tail + _queued, __ATOMIC_RELEASE);
+        }
+        auto to_submit = _queued;
+        _queued = 0;
+        while (true) {
+            auto ret = syscall(__NR_io_uring_enter, _fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            return ret;
+        }
+    }
+
+    /**
+     * 批量回收完成事件
+     * @return 回收的个数
+     */
+    template<typename FUNC>
+    uint32_t reap(FUNC &&func) {
+        auto head = *_cq_head;
+        auto tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        uint32_t count = 0;
+        for (; head != tail; ++head, ++count) {
+            auto &cqe = _cqes[head & _cq_mask];
+            func(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    bool _ok = false;
+    int _fd = -1;
+    char *_sq_ptr = nullptr;
+    char *_cq_ptr = nullptr;
+    size_t _sq_size = 0;
+    size_t _cq_size = 0;
+    size_t _sqes_size = 0;
+    uint32_t _queued = 0;
+    uint32_t *_sq_tail = nullptr;
+    uint32_t _sq_mask = 0;
+    uint32_t *_sq_array = nullptr;
+    uint32_t *_cq_head = nullptr;
+    uint32_t *_cq_tail = nullptr;
+    uint32_t _cq_mask = 0;
+    struct io_uring_sqe *_sqes = nullptr;
+    struct io_uring_cqe *_cqes = nullptr;
+
+public:
+    bool _fixed_buffers = false;
+    //由_mtx保护
+    bool _fixed_files = false;
+    //未注册缓存时writev使用的iovec，按缓存下标存放
+    vector<struct iovec> _iovecs;
+};
+
+AsyncWriteEngine::AsyncWriteEngine() : AsyncWriteEngine(Config()) {}
+
+AsyncWriteEngine::AsyncWriteEngine(const Config &config) {
+    _config = config;
+    _config.buffer_size = (_config.buffer_size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    _config.staging_size = (_config.staging_size + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    if (!_config.staging_size || _config.staging_size > _config.buffer_size) {
+        _config.staging_size = _config.buffer_size;
+    }
+    if (posix_memalign((void **) &_buffers, DIRECT_ALIGN, (size_t) _config.buffer_size * _config.buffer_count)) {
+        throw std::bad_alloc();
+    }
+    for (uint32_t i = 0; i < _config.buffer_count; ++i) {
+        _free_buffers.emplace_back(_config.buffer_count - i - 1);
+    }
+    _inflight_requests.resize(_config.buffer_count);
+
+    if (_config.use_uring) {
+        //队列深度不小于缓存个数，保证sq/cq不会溢出
+        uint32_t entries = 1;
+        while (entries < _config.buffer_count) {
+            entries <<= 1;
+        }
+        _ring = std::make_shared<UringRing>(entries);
+        if (!_ring->ok()) {
+            PrintW("io_uring不可用，使用写线程池");
+            _ring = nullptr;
+        }
+    }
+
+    if (_ring) {
+        _ring->_iovecs.resize(_config.buffer_count);
+        for (uint32_t i = 0; i < _config.buffer_count; ++i) {
+            _ring->_iovecs[i].iov_base = _buffers + (size_t) i * _config.buffer_size;
+            _ring->_iovecs[i].iov_len = _config.buffer_size;
+        }
+        //注册缓存受RLIMIT_MEMLOCK限制，失败时使用普通writev
+        _ring->_fixed_buffers = _ring->registerBuffers(_ring->_iovecs.data(), _config.buffer_count);
+        _ring->_fixed_files = _ring->registerFiles(_config.max_files);
+        _threads.emplace_back([this]() {
+            CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleWriter, 0);
+            runUring();
+        });
+        return;
+    }
+
+    for (uint32_t i = 0; i < max(_config.fallback_threads, 1U); ++i) {
+        _threads.emplace_back([this, i]() {
+            CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleWriter, i);
+            runThread();
+        });
+    }
+}
+
+AsyncWriteEngine::~AsyncWriteEngine() {
+    {
+        lock_guard<mutex> lck(_mtx);
+        _exit = true;
+    }
+    _cv_work.notify_all();
+    for (auto &thread : _threads) {
+        thread.join();
+    }
+    _ring = nullptr;
+    free(_buffers);
+}
+
+bool AsyncWriteEngine::isUring() const {
+    return _ring != nullptr;
+}
+
+uint32_t AsyncWriteEngine::getBufferSize() const {
+    return _config.buffer_size;
+}
+
+uint32_t AsyncWriteEngine::getStagingSize() const {
+    return _config.staging_size;
+}
+
+AsyncWriteEngine::Stats AsyncWriteEngine::getStats() const {
+    lock_guard<mutex> lck(_mtx);
+    return _stats;
+}
+
+int AsyncWriteEngine::addFile(int fd) {
+    lock_guard<mutex> lck(_mtx);
+    int file_id;
+    if (!_free_files.empty()) {
+        file_id = _free_files.back();
+        _free_files.pop_back();
+    } else {
+        if (_files.size() >= _config.max_files) {
+            return -1;
+        }
+        file_id = _files.size();
+        _files.emplace_back();
+    }
+    auto &slot = _files[file_id];
+    slot.fd = fd;
+    slot.inflight = 0;
+    slot.error = 0;
+    if (_ring && _ring->_fixed_files && !_ring->updateFile(file_id, fd)) {
+        //注册失败，该引擎不再使用注册文件
+        _ring->_fixed_files = false;
+    }
+    return file_id;
+}
+
+int AsyncWriteEngine::removeFile(int file_id) {
+    unique_lock<mutex> lck(_mtx);
+    auto &slot = _files[file_id];
+    _cv_done.wait(lck, [&]() {
+        return slot.inflight == 0;
+    });
+    auto error = slot.error;
+    if (_ring && _ring->_fixed_files) {
+        _ring->updateFile(file_id, -1);
+    }
+    slot.fd = -1;
+    _free_files.emplace_back(file_id);
+    return error;
+}
+
+void AsyncWriteEngine::write(int file_id, const char *data, uint32_t len, uint64_t offset, uint32_t padded_len) {
+    padded_len = max(padded_len, len);
+    uint32_t index;
+    {
+        //缓存只被写入中的请求占用，等待总会因写入完成而结束
+        unique_lock<mutex> lck(_mtx);
+        if (_free_buffers.empty()) {
+            ++_stats.stalls;
+            _cv_done.wait(lck, [&]() {
+                return !_free_buffers.empty();
+            });
+        }
+        index = _free_buffers.back();
+        _free_buffers.pop_back();
+    }
+
+    char *buf = _buffers + (size_t) index * _config.buffer_size;
+    memcpy(buf, data, len);
+    memset(buf + len, 0, padded_len - len);
+
+    {
+        lock_guard<mutex> lck(_mtx);
+        Request request;
+        request.file_id = file_id;
+        request.fd = _files[file_id].fd;
+        request.index = index;
+        request.len = padded_len;
+        request.offset = offset;
+        request.done = 0;
+        _pending.emplace_back(request);
+        ++_files[file_id].inflight;
+        ++_stats.writes;
+    }
+    _cv_work.notify_one();
+}
+
+bool AsyncWriteEngine::onComplete(Request &request, int result) {
+    //调用者已加锁
+    auto &slot = _files[request.file_id];
+    if (result > 0) {
+        _stats.bytes += result;
+        request.done += result;
+        if (request.done < request.len) {
+            //写入不完整(如磁盘将满或被信号打断)，由调用者重新提交剩余部分
+            return false;
+        }
+    } else {
+        ++_stats.errors;
+        slot.error = result < 0 ? -result : EIO;
+    }
+    --slot.inflight;
+    _free_buffers.emplace_back(request.index);
+    return true;
+}
+
+void AsyncWriteEngine::runUring() {
+    vector<Request> batch;
+    vector<pair<uint64_t, int> > completions;
+    while (true) {
+        //_fixed_files由调用者线程在_mtx下修改，在取出请求时一并读取
+        bool fixed_files;
+        {
+            unique_lock<mutex> lck(_mtx);
+            _cv_work.wait(lck, [&]() {
+                return _exit || !_pending.empty() || _inflight;
+            });
+            if (_exit && _pending.empty() && !_inflight) {
+                break;
+            }
+            batch.swap(_pending);
+            _inflight += batch.size();
+            fixed_files = _ring->_fixed_files;
+        }
+
+        for (auto &request : batch) {
+            auto sqe = _ring->getSqe();
+            char *buf = _buffers + (size_t) request.index * _config.buffer_size + request.done;
+            if (_ring->_fixed_buffers) {
+                sqe->opcode = IORING_OP_WRITE_FIXED;
+                sqe->addr = (uint64_t) (uintptr_t) buf;
+                sqe->len = request.len - request.done;
+                sqe->buf_index = request.index;
+            } else {
+                auto &iov = _ring->_iovecs[request.index];
+                iov.iov_base = buf;
+                iov.iov_len = request.len - request.done;
+                sqe->opcode = IORING_OP_WRITEV;
+                sqe->addr = (uint64_t) (uintptr_t) &iov;
+                sqe->len = 1;
+            }
+            if (fixed_files) {
+                sqe->fd = request.file_id;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            } else {
+                sqe->fd = request.fd;
+            }
+            sqe->off = request.offset + request.done;
+            sqe->user_data = request.index;
+            _inflight_requests[request.index] = request;
+        }
+
+        //没有新请求时阻塞等待至少一个写入完成
+        auto submitted = batch.size();
+        batch.clear();
+        if (_ring->submit(submitted ? 0 : 1) < 0 && errno != EBUSY && errno != EAGAIN) {
+            PrintE("io_uring_enter失败:%s", strerror(errno));
+        }
+
+        completions.clear();
+        _ring->reap([&](uint64_t user_data, int result) {
+            completions.emplace_back(user_data, result);
+        });
+        if (completions.empty()) {
+            continue;
+        }
+
+        //批量回收，写入不完整的请求放回待提交队列，下一轮继续写剩余部分
+        {
+            lock_guard<mutex> lck(_mtx);
+            for (auto &pr : completions) {
+                auto &request = _inflight_requests[pr.first];
+                if (!onComplete(request, pr.second)) {
+                    _pending.emplace_back(request);
+                }
+            }
+            _inflight -= completions.size();
+            ++_stats.reap_batches;
+        }
+        _cv_done.notify_all();
+    }
+}
+
+void AsyncWriteEngine::runThread() {
+    while (true) {
+        Request request;
+        {
+            unique_lock<mutex> lck(_mtx);
+            _cv_work.wait(lck, [&]() {
+                return _exit || !_pending.empty();
+            });
+            if (_pending.empty()) {
+                break;
+            }
+            //写请求带有偏移量，与完成顺序无关
+            request = _pending.back();
+            _pending.pop_back();
+        }
+
+        char *buf = _buffers + (size_t) request.index * _config.buffer_size;
+        uint32_t written = 0;
+        int result = 0;
+        //写线程内循环写完，不会产生不完整的完成事件
+        while (written < request.len) {
+            auto ret = pwrite(request.fd, buf + written, request.len - written, request.offset + written);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                result = ret < 0 ? -errno : -EIO;
+                break;
+            }
+            written += ret;
+        }
+
+        {
+            lock_guard<mutex> lck(_mtx);
+            onComplete(request, result < 0 ? result : written);
+            ++_stats.reap_batches;
+        }
+        _cv_done.notify_all();
+    }
+}
+
+/////////////////////////////////////////AsyncFileWriter/////////////////////////////////////////
+
+AsyncFileWriter::AsyncFileWriter(const AsyncWriteEngine::Ptr &engine, const std::string &path, bool direct) {
+    _engine = engine;
+    int flags = O_WRONLY | O_CREAT;
+    if (direct) {
+        _fd = open(path.c_str(), flags | O_DIRECT, 0644);
+        if (_fd >= 0 && lseek(_fd, 0, SEEK_END) % DIRECT_ALIGN) {
+            //已有文件长度未对齐，无法直接追加
+            close(_fd);
+            _fd = -1;
+        }
+        _direct = _fd >= 0;
+        if (!_direct) {
+            PrintW("O_DIRECT不可用，使用普通写入:%s", path.c_str());
+        }
+    }
+    if (_fd < 0) {
+        _fd = open(path.c_str(), flags, 0644);
+    }
+    if (_fd < 0) {
+        PrintE("打开文件失败:%s", path.c_str());
+        return;
+    }
+    //不使用O_APPEND，写请求按偏移量并发完成
+    _offset = lseek(_fd, 0, SEEK_END);
+    _file_id = _engine->addFile(_fd);
+    if (_file_id < 0) {
+        PrintE("打开的文件过多:%s", path.c_str());
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+    if (_fd < 0) {
+        return;
+    }
+    uint64_t size = _offset + _buf_len;
+    if (_buf_len) {
+        submit(true);
+    }
+    auto error = _engine->removeFile(_file_id);
+    if (error) {
+        PrintE("写文件失败:%s", strerror(error));
+    }
+    if (_direct && ftruncate(_fd, size) < 0) {
+        PrintE("截断文件失败:%s", strerror(errno));
+    }
+    close(_fd);
+}
+
+bool AsyncFileWriter::isOpen() const {
+    return _fd >= 0;
+}
+
+uint64_t AsyncFileWriter::size() const {
+    return _offset + _buf_len;
+}
+
+void AsyncFileWriter::inputFrame(const Frame::Ptr &frame) {
+    write(frame->data(), frame->size());
+}
+
+void AsyncFileWriter::write(const char *data, uint32_t len) {
+    if (_fd < 0) {
+        return;
+    }
+    auto capacity = _engine->getStagingSize();
+    if (_buf.size() != capacity) {
+        _buf.resize(capacity);
+    }
+    while (len) {
+        auto n = min(len, capacity - _buf_len);
+        memcpy(&_buf[_buf_len], data, n);
+        _buf_len += n;
+        data += n;
+        len -= n;
+        if (_buf_len == capacity) {
+            submit();
+        }
+    }
+}
+
+void AsyncFileWriter::submit(bool last) {
+    uint32_t padded_len = _buf_len;
+    if (last && _direct) {
+        //O_DIRECT要求长度对齐，补齐后再截断
+        padded_len = (_buf_len + DIRECT_ALIGN - 1) / DIRECT_ALIGN * DIRECT_ALIGN;
+    }
+    _engine->write(_file_id, _buf.data(), _buf_len, _offset, padded_len);
+    _offset += _buf_len;
+    _buf_len = 0;
+}
+
+}//namespace mediakit
@@ -0,0 +1,185 @@
+#ifndef RTP2PS_ASYNCWRITER_H
+#define RTP2PS_ASYNCWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include "Frame.h"
+
+namespace mediakit{
+
+class UringRing;
+
+/**
+ * 异步文件写入引擎
+ * 优先使用io_uring提交写请求(注册缓存 + 注册文件)，由引擎线程批量提交与回收；
+ * io_uring不可用时退化为写线程池。写入方先把数据写入自己的暂存缓存，暂存缓存满时才获取引擎缓存并立即提交，
+ * 引擎缓存只被写入中的请求占用，写入方不会在文件系统上阻塞，仅当全部缓存都在写入中时才会等待(有界背压)，
+ * 任意多个写入方共享同一个引擎也不会因缓存被占满而互相等待
+ */
+class AsyncWriteEngine {
+public:
+    typedef std::shared_ptr<AsyncWriteEngine> Ptr;
+
+    struct Config {
+        //单个缓存大小，必须为4096的倍数
+        uint32_t buffer_size = 512 * 1024;
+        //缓存个数，即最大同时写入请求数
+        uint32_t buffer_count = 64;
+        //每个写入方的暂存缓存大小，即单个写请求的最大长度，按4096对齐且不超过buffer_size
+        uint32_t staging_size = 64 * 1024;
+        //最多同时打开的文件数(注册文件表大小)
+        uint32_t max_files = 4096;
+        //io_uring不可用时写线程个数
+        uint32_t fallback_threads = 4;
+        //是否尝试使用io_uring
+        bool use_uring = true;
+    };
+
+    struct Stats {
+        //提交的写请求数
+        uint64_t writes = 0;
+        //写入的字节数
+        uint64_t bytes = 0;
+        //批量回收的次数
+        uint64_t reap_batches = 0;
+        //因缓存耗尽而等待的次数
+        uint64_t stalls = 0;
+        //写入失败次数
+        uint64_t errors = 0;
+    };
+
+    AsyncWriteEngine();
+    AsyncWriteEngine(const Config &config);
+    ~AsyncWriteEngine();
+
+    /**
+     * 是否在使用io_uring
+     */
+    bool isUring() const;
+
+    /**
+     * 单个缓存大小
+     */
+    uint32_t getBufferSize() const;
+
+    /**
+     * 写入方暂存缓存大小
+     */
+    uint32_t getStagingSize() const;
+
+    /**
+     * 添加文件，返回文件id，失败返回-1
+     * @param fd 文件描述符，由调用者负责关闭
+     */
+    int addFile(int fd);
+
+    /**
+     * 等待该文件全部写入完成后移除
+     * @return 写入过程中的错误码，0为成功
+     */
+    int removeFile(int file_id);
+
+    /**
+     * 拷贝数据到引擎缓存并提交写请求，写入完成后缓存自动回收；全部缓存都在写入中时等待
+     * @param file_id 文件id
+     * @param data 数据
+     * @param len 数据长度，不超过getBufferSize()
+     * @param offset 文件偏移量
+     * @param padded_len 写入长度，大于len时补0(O_DIRECT对齐)，为0时等于len
+     */
+    void write(int file_id, const char *data, uint32_t len, uint64_t offset, uint32_t padded_len = 0);
+
+    Stats getStats() const;
+
+private:
+    struct Request {
+        int file_id;
+        int fd;
+        uint32_t index;
+        uint32_t len;
+        uint64_t offset;
+        //已写入的长度，写入不完整时从该位置继续提交
+        uint32_t done;
+    };
+
+    struct FileSlot {
+        int fd = -1;
+        int inflight = 0;
+        int error = 0;
+    };
+
+    void runUring();
+    void runThread();
+    bool onComplete(Request &request, int result);
+
+private:
+    Config _config;
+    bool _exit = false;
+    //缓存内存，按4096对齐
+    char *_buffers = nullptr;
+    std::vector<uint32_t> _free_buffers;
+    std::vector<FileSlot> _files;
+    std::vector<int> _free_files;
+    std::vector<Request> _pending;
+    //已提交但未完成的请求
+    std::vector<Request> _inflight_requests;
+    uint32_t _inflight = 0;
+    Stats _stats;
+    mutable std::mutex _mtx;
+    std::condition_variable _cv_work;
+    std::condition_variable _cv_done;
+    std::shared_ptr<UringRing> _ring;
+    std::vector<std::thread> _threads;
+};
+
+/**
+ * 通过AsyncWriteEngine写文件的帧输出目标
+ */
+class AsyncFileWriter : public FrameWriterInterface {
+public:
+    typedef std::shared_ptr<AsyncFileWriter> Ptr;
+
+    /**
+     * @param engine 写入引擎
+     * @param path 文件路径，已存在时从文件末尾追加
+     * @param direct 是否使用O_DIRECT，文件系统不支持时自动退化
+     */
+    AsyncFileWriter(const AsyncWriteEngine::Ptr &engine, const std::string &path, bool direct = false);
+    ~AsyncFileWriter() override;
+
+    bool isOpen() const;
+
+    void inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * 写入数据
+     */
+    void write(const char *data, uint32_t len);
+
+    /**
+     * 已写入的逻辑长度
+     */
+    uint64_t size() const;
+
+private:
+    void submit(bool last = false);
+
+private:
+    bool _direct = false;
+    int _fd = -1;
+    int _file_id = -1;
+    //暂存缓存，满后才占用引擎缓存
+    std::string _buf;
+    uint32_t _buf_len = 0;
+    //下一个写请求的文件偏移量
+    uint64_t _offset = 0;
+    AsyncWriteEngine::Ptr _engine;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_ASYNCWRITER_H
@@ -0,0 +1,147 @@
+#include "Checkpoint.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Logger.h"
+
+namespace mediakit{
+
+//文件头：标识 + 数据长度 + 数据摘要
+static const char s_magic[8] = {'R', '2', 'P', 'S', 'C', 'K', 'P', '3'};
+
+static uint64_t fnv1a(const char *data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (uint8_t) data[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static bool writeAll(int fd, const char *data, size_t size) {
+    while (size) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool Checkpoint::save(const std::string &path, const std::string &data) {
+    auto tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        PrintE("创建断点文件失败:%s, %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    uint64_t header[2] = {data.size(), fnv1a(data.data(), data.size())};
+    bool ok = writeAll(fd, s_magic, sizeof(s_magic)) && writeAll(fd, (const char *) header, sizeof(header))
+              && writeAll(fd, data.data(), data.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        PrintE("写入断点文件失败:%s, %s", path.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    //重命名也需要落盘
+    auto pos = path.rfind('/');
+    auto dir = pos == std::string::npos ? std::string(".") : path.substr(0, pos + 1);
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+    return true;
+}
+
+bool Checkpoint::load(const std::string &path, std::string &data) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    std::string content;
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        content.append(buf, n);
+    }
+    close(fd);
+
+    uint64_t header[2];
+    if (content.size() < sizeof(s_magic) + sizeof(header) || memcmp(content.data(), s_magic, sizeof(s_magic))) {
+        PrintE("非法的断点文件:%s", path.c_str());
+        return false;
+    }
+    memcpy(header, content.data() + sizeof(s_magic), sizeof(header));
+    auto payload = content.data() + sizeof(s_magic) + sizeof(header);
+    if (header[0] != content.size() - sizeof(s_magic) - sizeof(header) || header[1] != fnv1a(payload, header[0])) {
+        PrintE("断点文件已损坏:%s", path.c_str());
+        return false;
+    }
+    data.assign(payload, header[0]);
+    return true;
+}
+
+void Checkpoint::saveFrame(CheckpointWriter &writer, const Frame &frame) {
+    writer.write(frame.getCodecId());
+    writer.write(frame.dts());
+    writer.write(frame.pts());
+    writer.write(frame.prefixSize());
+    auto arrival = frame.getArrival();
+    writer.write(arrival ? *arrival : FrameArrival());
+    writer.writeBytes(frame.data(), frame.size());
+}
+
+bool Checkpoint::loadFrame(CheckpointReader &reader, FrameImp &frame) {
+    const char *data;
+    uint32_t size;
+    if (!reader.read(frame._codec_id) || !reader.read(frame._dts) || !reader.read(frame._pts)
+        || !reader.read(frame._prefix_size) || !reader.read(frame._arrival) || !reader.readBytes(data, size)) {
+        return false;
+    }
+    frame._buffer.clear();
+    if (size) {
+        frame._buffer.append(data, size);
+    }
+    return true;
+}
+
+void Checkpoint::saveRtp(CheckpointWriter &writer, const RtpPacket &rtp) {
+    writer.write(rtp.interleaved);
+    writer.write(rtp.PT);
+    writer.write(rtp.mark);
+    writer.write(rtp.timeStamp);
+    writer.write(rtp.sequence);
+    writer.write(rtp.ssrc);
+    writer.write(rtp.offset);
+    writer.write(rtp.type);
+    writer.write(rtp.arrival_us);
+    writer.writeBytes(rtp.data(), rtp.size());
+}
+
+bool Checkpoint::loadRtp(CheckpointReader &reader, RtpPacket &rtp) {
+    const char *data;
+    uint32_t size;
+    if (!reader.read(rtp.interleaved) || !reader.read(rtp.PT) || !reader.read(rtp.mark) || !reader.read(rtp.timeStamp)
+        || !reader.read(rtp.sequence) || !reader.read(rtp.ssrc) || !reader.read(rtp.offset) || !reader.read(rtp.type)
+        || !reader.read(rtp.arrival_us) || !reader.readBytes(data, size)) {
+        return false;
+    }
+    rtp.setCapacity(size);
+    rtp.setSize(size);
+    memcpy(rtp.data(), data, size);
+    return true;
+}
+
+}//namespace mediakit
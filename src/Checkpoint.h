@@ -0,0 +1,119 @@
+#ifndef RTP2PS_CHECKPOINT_H
+#define RTP2PS_CHECKPOINT_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include "Frame.h"
+
+namespace mediakit{
+
+/**
+ * 断点状态的写入，按本机字节序顺序写入，只用于同一程序的断点续传
+ */
+class CheckpointWriter {
+public:
+    template<typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint value must be trivially copyable");
+        _data.append((const char *) &value, sizeof(T));
+    }
+
+    /**
+     * 写入长度与数据
+     */
+    void writeBytes(const char *data, uint32_t size) {
+        write(size);
+        _data.append(data, size);
+    }
+
+    const std::string &data() const {
+        return _data;
+    }
+
+private:
+    std::string _data;
+};
+
+/**
+ * 断点状态的读取，越界时返回false，之后的读取都失败
+ */
+class CheckpointReader {
+public:
+    CheckpointReader(const char *data, size_t size) : _data(data), _size(size) {}
+
+    template<typename T>
+    bool read(T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint value must be trivially copyable");
+        if (!_ok || _pos + sizeof(T) > _size) {
+            _ok = false;
+            return false;
+        }
+        memcpy(&value, _data + _pos, sizeof(T));
+        _pos += sizeof(T);
+        return true;
+    }
+
+    /**
+     * 读取长度与数据，数据指针在reader的数据有效期间有效
+     */
+    bool readBytes(const char *&data, uint32_t &size) {
+        if (!read(size) || _pos + size > _size) {
+            _ok = false;
+            return false;
+        }
+        data = _data + _pos;
+        _pos += size;
+        return true;
+    }
+
+    bool ok() const {
+        return _ok;
+    }
+
+    /**
+     * 是否已读完全部数据
+     */
+    bool eof() const {
+        return _pos == _size;
+    }
+
+private:
+    bool _ok = true;
+    const char *_data;
+    size_t _size;
+    size_t _pos = 0;
+};
+
+/**
+ * 断点文件，离线转换中断后从最近的断点继续
+ */
+class Checkpoint {
+public:
+    /**
+     * 原子的写入断点文件：先写临时文件并落盘，再重命名覆盖
+     */
+    static bool save(const std::string &path, const std::string &data);
+
+    /**
+     * 读取并校验断点文件
+     * @return 文件不存在或者损坏时返回false
+     */
+    static bool load(const std::string &path, std::string &data);
+
+    /**
+     * 帧的编码、时间戳与数据
+     */
+    static void saveFrame(CheckpointWriter &writer, const Frame &frame);
+    static bool loadFrame(CheckpointReader &reader, FrameImp &frame);
+
+    /**
+     * rtp包的头部字段与数据
+     */
+    static void saveRtp(CheckpointWriter &writer, const RtpPacket &rtp);
+    static bool loadRtp(CheckpointReader &reader, RtpPacket &rtp);
+};
+
+}//namespace mediakit
+#endif //RTP2PS_CHECKPOINT_H
@@ -0,0 +1,118 @@
+#include <string.h>
+#include <immintrin.h>
+#include "Checksum.h"
+
+namespace mediakit{
+
+//64位反码加法，进位回卷
+static inline uint64_t addCarry(uint64_t sum, uint64_t value) {
+    sum += value;
+    return sum + (sum < value);
+}
+
+static inline uint16_t fold(uint64_t sum) {
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return (uint16_t) sum;
+}
+
+static uint64_t sumScalar(const uint8_t *data, size_t len, uint64_t sum) {
+    //4路独立累加，减少进位判断的依赖链
+    uint64_t acc[4] = {sum, 0, 0, 0};
+    while (len >= 32) {
+        uint64_t value[4];
+        memcpy(value, data, 32);
+        acc[0] = addCarry(acc[0], value[0]);
+        acc[1] = addCarry(acc[1], value[1]);
+        acc[2] = addCarry(acc[2], value[2]);
+        acc[3] = addCarry(acc[3], value[3]);
+        data += 32;
+        len -= 32;
+    }
+    sum = addCarry(addCarry(acc[0], acc[1]), addCarry(acc[2], acc[3]));
+    while (len >= 8) {
+        uint64_t value;
+        memcpy(&value, data, 8);
+        sum = addCarry(sum, value);
+        data += 8;
+        len -= 8;
+    }
+    //剩余不足8字节，按内存顺序补0
+    uint64_t tail = 0;
+    memcpy(&tail, data, len);
+    return addCarry(sum, tail);
+}
+
+__attribute__((target("avx2")))
+static uint64_t sumAvx2(const uint8_t *data, size_t len, uint64_t sum) {
+    //32位字零扩展后累加到64位通道，64K以内的数据不会溢出，不需要处理进位
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero;
+    __m256i acc1 = zero;
+    while (len >= 64) {
+        auto v0 = _mm256_loadu_si256((const __m256i *) data);
+        auto v1 = _mm256_loadu_si256((const __m256i *) (data + 32));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+        data += 64;
+        len -= 64;
+    }
+    if (len >= 32) {
+        auto v0 = _mm256_loadu_si256((const __m256i *) data);
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        data += 32;
+        len -= 32;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+    for (auto lane : lanes) {
+        sum = addCarry(sum, lane);
+    }
+    return sumScalar(data, len, sum);
+}
+
+typedef uint64_t (*SumFunc)(const uint8_t *data, size_t len, uint64_t sum);
+
+static SumFunc selectSum() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? sumAvx2 : sumScalar;
+}
+
+static const SumFunc s_sum = selectSum();
+
+uint16_t Checksum::sum(const void *data, size_t len, uint64_t initial) {
+    return fold(s_sum((const uint8_t *) data, len, initial));
+}
+
+bool Checksum::verifyIpv4(const void *ip, uint32_t ihl) {
+    //首部很短，直接标量求和
+    return fold(sumScalar((const uint8_t *) ip, ihl, 0)) == 0xFFFF;
+}
+
+bool Checksum::verifyUdp(const void *ip, const void *udp, uint32_t len) {
+    auto ptr = (const uint8_t *) udp;
+    if (!ptr[6] && !ptr[7]) {
+        return true;
+    }
+    //伪首部：源地址、目的地址、协议与udp长度，按网络字节序排列
+    uint8_t pseudo[12];
+    memcpy(pseudo, (const uint8_t *) ip + 12, 8);
+    pseudo[8] = 0;
+    pseudo[9] = 17;
+    pseudo[10] = len >> 8;
+    pseudo[11] = len & 0xFF;
+    auto sum = sumScalar(pseudo, sizeof(pseudo), 0);
+    //伪首部为12字节，udp数据从偶数偏移开始，可以直接续加
+    return fold(s_sum(ptr, len, (uint64_t) fold(sum))) == 0xFFFF;
+}
+
+bool Checksum::isAvx2() {
+    return s_sum == sumAvx2;
+}
+
+}//namespace mediakit
@@ -0,0 +1,46 @@
+#ifndef RTP2PS_CHECKSUM_H
+#define RTP2PS_CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mediakit{
+
+/**
+ * ip/udp校验和(RFC 1071)
+ * 求和按内存中的字节序进行，结果与网络字节序的校验和字段直接比较即可，不需要转换字节序；
+ * cpu支持时使用AVX2，否则使用64位累加的标量实现
+ */
+class Checksum {
+public:
+    /**
+     * 反码求和并折叠到16位，结果未取反
+     * @param data 数据
+     * @param len 数据长度，可以为奇数
+     * @param initial 之前部分的累加值，用于分段求和
+     */
+    static uint16_t sum(const void *data, size_t len, uint64_t initial = 0);
+
+    /**
+     * 校验ipv4首部
+     * @param ip ip首部
+     * @param ihl 首部长度，字节
+     */
+    static bool verifyIpv4(const void *ip, uint32_t ihl);
+
+    /**
+     * 校验udp，校验和字段为0时表示发送端未计算，视为通过
+     * @param ip ipv4首部，用于伪首部中的源与目的地址
+     * @param udp udp首部
+     * @param len udp首部中的长度
+     */
+    static bool verifyUdp(const void *ip, const void *udp, uint32_t len);
+
+    /**
+     * 是否在使用AVX2
+     */
+    static bool isAvx2();
+};
+
+}//namespace mediakit
+#endif //RTP2PS_CHECKSUM_H
@@ -9,9 +9,11 @@
  */
 
 #include "CommonRtp.h"
+#include "Logger.h"
+#include "Trace.h"
 
 CommonRtpDecoder::CommonRtpDecoder(CodecId codec, int max_frame_size ){
-    printf("CommonRtpDecoder\n");
+    PrintT("CommonRtpDecoder");
     _codec = codec;
     _max_frame_size = max_frame_size;
     obtainFrame();
@@ -21,17 +23,84 @@ CodecId CommonRtpDecoder::getCodecId() const {
     return _codec;
 }
 
+void CommonRtpDecoder::setCodecId(CodecId codec) {
+    _codec = codec;
+    _frame->_codec_id = codec;
+}
+
+void CommonRtpDecoder::setAudioConfig(int samplerate, int channels) {
+    _samplerate = samplerate;
+    _channels = channels;
+}
+
+void CommonRtpDecoder::setFrameWriter(const FrameWriterInterface::Ptr &writer) {
+    _writer = writer;
+}
+
+void CommonRtpDecoder::setMemoryAccount(const MemoryAccount::Ptr &account) {
+    if (_account) {
+        _account->release(_charged);
+    }
+    _account = account;
+    _charged = 0;
+    syncMemory();
+}
+
+void CommonRtpDecoder::setMarkerFlush(bool enable) {
+    _marker_flush = enable;
+}
+
+void CommonRtpDecoder::flushFrame() {
+    if (!_drop_flag && !_frame->_buffer.empty() && _writer) {
+        TraceSpan("writeFrame");
+        _size_predictor.update(_frame->_buffer.size());
+        _writer->inputFrame(_frame);
+    }
+    obtainFrame();
+    _drop_flag = false;
+    syncMemory();
+}
+
+uint64_t CommonRtpDecoder::dropFrame() {
+    uint64_t bytes = _frame->_buffer.size();
+    if (!bytes) {
+        return 0;
+    }
+    _drop_flag = true;
+    _frame->_buffer.clear();
+    syncMemory();
+    return bytes;
+}
+
+void CommonRtpDecoder::syncMemory() {
+    if (!_account) {
+        return;
+    }
+    uint64_t size = _frame->_buffer.size();
+    if (size > _charged) {
+        _account->charge(size - _charged);
+    } else if (size < _charged) {
+        _account->release(_charged - size);
+    }
+    _charged = size;
+}
+
 void CommonRtpDecoder::obtainFrame() {
-    printf("obtainFrame\n");
+    PrintT("obtainFrame");
     _frame = ResourcePoolHelper<FrameImp>::obtainObj();
     _frame->_buffer.clear();
+    _size_predictor.prepare(_frame->_buffer);
     _frame->_prefix_size = 0;
     _frame->_dts = 0;
     _frame->_codec_id = _codec;
+    _frame->_arrival = FrameArrival();
 }
 
 bool CommonRtpDecoder::inputRtp(const RtpPacket::Ptr &rtp, bool){
-    printf("CommonRtpDecoder::inputRtp\n");
+    PrintT("CommonRtpDecoder::inputRtp");
+    if (_codec == CodecAAC) {
+        return inputAac(rtp);
+    }
     auto payload = rtp->data() + rtp->offset;
     auto size = rtp->size() - rtp->offset;
     if (size <= 0) {
@@ -39,27 +108,21 @@ bool CommonRtpDecoder::inputRtp(const RtpPacket::Ptr &rtp, bool){
         return false;
     }
 
-    std::shared_ptr<FILE> _save_file_ps;
-
     // InfoL << "rtp header: " << hexdump((uint8_t *) payload, 4) << endl;
     // InfoL << "rtp offset: " << rtp->offset << endl;
     // InfoL << "rtp->timeStamp: " << rtp->timeStamp << endl;
     // InfoL << "_frame->_dts: " << _frame->_dts << endl;
     if (_frame->_dts != rtp->timeStamp || _frame->_buffer.size() > _max_frame_size
-        || (size > 4 && (uint8_t)payload[0] == 0x00 && (uint8_t)payload[1] == 0x00 && (uint8_t)payload[2] == 0x01 && (uint8_t)payload[3] == 0xba)) {
-            printf("找到了ps头\n");
+        || (_codec == CodecInvalid && size > 4 && (uint8_t)payload[0] == 0x00 && (uint8_t)payload[1] == 0x00 && (uint8_t)payload[2] == 0x01 && (uint8_t)payload[3] == 0xba)) {
+            PrintT("找到了ps头");
         //时间戳发生变化或者缓存超过MAX_FRAME_SIZE，则清空上帧数据
         // InfoL << "get frame ==== " << _frame->_buffer.size() << endl;
-        if (!_frame->_buffer.empty()) {
+        if (!_frame->_buffer.empty() && _writer) {
             //有有效帧，则输出
-            // RtpCodec::inputFrame(_frame);
-            printf("写文件\n");
-            FILE *fp = NULL;
- 
-            fp = fopen(outputfile.c_str(), "a+");
-            fwrite((char *)_frame->data(), _frame->size(), 1, fp);
-            fclose(fp);
-
+            PrintT("写文件");
+            TraceSpan("writeFrame");
+            _size_predictor.update(_frame->_buffer.size());
+            _writer->inputFrame(_frame);
         }
 
         //新的一帧数据
@@ -68,15 +131,106 @@ bool CommonRtpDecoder::inputRtp(const RtpPacket::Ptr &rtp, bool){
         _drop_flag = false;
     } else if (_last_seq != 0 && (uint16_t)(_last_seq + 1) != rtp->sequence) {
         //时间戳未发生变化，但是seq却不连续，说明中间rtp丢包了，那么整帧应该废弃
-        printf("rtp丢包:%d -> %d", _last_seq, rtp->sequence);
+        PrintW("rtp丢包:%d -> %d", _last_seq, rtp->sequence);
         _drop_flag = true;
         _frame->_buffer.clear();
     }
 
     if (!_drop_flag) {
         _frame->_buffer.append(payload, size);
+        _frame->_arrival.mark(rtp->arrival_us);
     }
 
+    _last_seq = rtp->sequence;
+    if (_marker_flush && rtp->mark) {
+        //帧结束，立即输出，下一个包无论时间戳是否变化都开始新的一帧
+        flushFrame();
+        return false;
+    }
+    syncMemory();
+    return false;
+}
+
+void CommonRtpDecoder::saveState(CheckpointWriter &writer) const {
+    writer.write(_drop_flag);
+    writer.write(_last_seq);
+    Checkpoint::saveFrame(writer, *_frame);
+}
+
+bool CommonRtpDecoder::loadState(CheckpointReader &reader) {
+    obtainFrame();
+    if (!reader.read(_drop_flag) || !reader.read(_last_seq) || !Checkpoint::loadFrame(reader, *_frame)) {
+        return false;
+    }
+    syncMemory();
+    return true;
+}
+
+//adts头中的采样率序号
+static int getAacSampleIndex(int samplerate) {
+    static const int s_rates[] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+    for (int i = 0; i < (int) (sizeof(s_rates) / sizeof(s_rates[0])); ++i) {
+        if (s_rates[i] == samplerate) {
+            return i;
+        }
+    }
+    return 11;
+}
+
+bool CommonRtpDecoder::inputAac(const RtpPacket::Ptr &rtp) {
+    auto payload = (uint8_t *) rtp->data() + rtp->offset;
+    int size = (int) rtp->size() - (int) rtp->offset;
+    if (size < 2) {
+        return false;
+    }
+    //AU-headers-length以bit为单位，每个AU头16bit：13bit长度 + 3bit序号
+    int headers_bits = (payload[0] << 8) | payload[1];
+    int headers_size = (headers_bits + 7) / 8;
+    auto au_header = payload + 2;
+    auto au_data = au_header + headers_size;
+    auto end = payload + size;
+    if (au_data > end) {
+        PrintW("非法的aac rtp包:%d", size);
+        return false;
+    }
+
+    auto sample_index = getAacSampleIndex(_samplerate);
+    int count = headers_bits / 16;
+    for (int i = 0; i < count; ++i) {
+        int au_size = ((au_header[2 * i] << 8) | au_header[2 * i + 1]) >> 3;
+        if (au_data + au_size > end) {
+            //跨包分片的AU不常见，直接丢弃
+            PrintW("不完整的aac AU:%d > %d", au_size, (int) (end - au_data));
+            break;
+        }
+        if (!au_size) {
+            continue;
+        }
+        //adts头，AAC-LC，无crc
+        int adts_size = au_size + 7;
+        char adts[7];
+        adts[0] = (char) 0xFF;
+        adts[1] = (char) 0xF1;
+        adts[2] = (char) ((1 << 6) | (sample_index << 2) | ((_channels >> 2) & 0x01));
+        adts[3] = (char) (((_channels & 0x03) << 6) | ((adts_size >> 11) & 0x03));
+        adts[4] = (char) ((adts_size >> 3) & 0xFF);
+        adts[5] = (char) (((adts_size & 0x07) << 5) | 0x1F);
+        adts[6] = (char) 0xFC;
+
+        //同一个包中的AU每个1024个采样
+        _frame->_dts = rtp->timeStamp + (uint32_t) (i * 1024 * 1000LL / _samplerate);
+        _frame->_prefix_size = 7;
+        _frame->_buffer.append(adts, sizeof(adts));
+        _frame->_buffer.append((char *) au_data, au_size);
+        _frame->_arrival.mark(rtp->arrival_us);
+        if (_writer) {
+            TraceSpan("writeFrame");
+            _size_predictor.update(_frame->_buffer.size());
+            _writer->inputFrame(_frame);
+        }
+        obtainFrame();
+        au_data += au_size;
+    }
     _last_seq = rtp->sequence;
     return false;
 }
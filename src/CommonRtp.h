@@ -12,7 +12,8 @@
 #define ZLMEDIAKIT_COMMONRTP_H
 
 #include "Frame.h"
-#include "global.hpp"
+#include "MemoryBudget.h"
+#include "Checkpoint.h"
 
 using namespace mediakit;
 
@@ -39,6 +40,44 @@ public:
      */
     CodecId getCodecId() const;
 
+    /**
+     * 修改编码类型，CodecInvalid为ps流
+     */
+    void setCodecId(CodecId codec);
+
+    /**
+     * 设置音频参数，aac生成adts头时使用
+     * @param samplerate 采样率
+     * @param channels 声道数
+     */
+    void setAudioConfig(int samplerate, int channels);
+
+    /**
+     * 设置帧输出目标
+     */
+    void setFrameWriter(const FrameWriterInterface::Ptr &writer);
+
+    /**
+     * 设置内存账户，未完成帧占用的内存记在该账户上
+     */
+    void setMemoryAccount(const MemoryAccount::Ptr &account);
+
+    /**
+     * 收到marker位的rtp包时立即输出当前帧，不再等待下一帧的第一个包
+     */
+    void setMarkerFlush(bool enable);
+
+    /**
+     * 输出未完成的帧，输入结束或者空闲超时时调用；帧内丢包时丢弃
+     */
+    void flushFrame();
+
+    /**
+     * 丢弃未完成的帧，该帧后续的rtp包也会被丢弃
+     * @return 释放的字节数
+     */
+    uint64_t dropFrame();
+
     /**
      * 输入rtp并解码
      * @param rtp rtp数据包
@@ -46,15 +85,36 @@ public:
      */
     bool inputRtp(const RtpPacket::Ptr &rtp, bool key_pos = false);
 
+    /**
+     * 保存与恢复未完成帧与序列号，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const;
+    bool loadState(CheckpointReader &reader);
+
 private:
     void obtainFrame();
+    void syncMemory();
+
+    /**
+     * 解析RFC 3640 aac负载(AAC-hbr模式)，每个AU加上adts头后单独输出
+     */
+    bool inputAac(const RtpPacket::Ptr &rtp);
 
 private:
     bool _drop_flag = false;
+    bool _marker_flush = false;
     uint16_t _last_seq = 0;
     int _max_frame_size;
     CodecId _codec;
+    int _samplerate = 8000;
+    int _channels = 1;
     FrameImp::Ptr _frame;
+    //按近期帧大小预先申请帧缓存
+    FrameSizePredictor _size_predictor;
+    FrameWriterInterface::Ptr _writer;
+    MemoryAccount::Ptr _account;
+    //已记账的未完成帧字节数
+    uint64_t _charged = 0;
 };
 
 }//namespace mediakit
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include "CpuPlacement.h"
+#include "Logger.h"
+
+using namespace std;
+
+namespace mediakit{
+
+static bool readFile(const string &path, string &out) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp) {
+        return false;
+    }
+    char buf[4096];
+    auto n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+    out = buf;
+    return true;
+}
+
+static const char *roleName(CpuPlacement::Role role) {
+    switch (role) {
+        case CpuPlacement::RoleReader: return "reader";
+        case CpuPlacement::RoleWorker: return "worker";
+        case CpuPlacement::RoleWriter: return "writer";
+        default: return "unknown";
+    }
+}
+
+CpuPlacement &CpuPlacement::Instance() {
+    static CpuPlacement instance;
+    return instance;
+}
+
+CpuPlacement::CpuPlacement() {
+    loadTopology();
+}
+
+void CpuPlacement::loadTopology() {
+    string str;
+    if (!readFile("/sys/devices/system/cpu/online", str) || !parseCpuList(str, _online) || _online.empty()) {
+        _online.clear();
+        auto count = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long i = 0; i < max(count, 1L); ++i) {
+            _online.emplace_back(i);
+        }
+    }
+    auto max_cpu = *max_element(_online.begin(), _online.end());
+    _cpu_node.assign(max_cpu + 1, 0);
+    _primary.assign(max_cpu + 1, true);
+
+    //numa节点
+    auto dir = opendir("/sys/devices/system/node");
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            int node;
+            if (sscanf(entry->d_name, "node%d", &node) != 1) {
+                continue;
+            }
+            vector<int> cpus;
+            if (!readFile(string("/sys/devices/system/node/") + entry->d_name + "/cpulist", str) || !parseCpuList(str, cpus)) {
+                continue;
+            }
+            for (auto cpu : cpus) {
+                if (cpu <= max_cpu) {
+                    _cpu_node[cpu] = node;
+                }
+            }
+            _node_count = max(_node_count, node + 1);
+        }
+        closedir(dir);
+    }
+
+    //超线程，同一物理核中编号最小的为主线程
+    for (auto cpu : _online) {
+        vector<int> siblings;
+        if (readFile("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/thread_siblings_list", str) &&
+            parseCpuList(str, siblings) && !siblings.empty()) {
+            _primary[cpu] = cpu == *min_element(siblings.begin(), siblings.end());
+        }
+    }
+}
+
+void CpuPlacement::autoAssign() {
+    if (_auto_assigned) {
+        return;
+    }
+    _auto_assigned = true;
+
+    //每个节点的cpu，物理核优先
+    vector<vector<int> > nodes(_node_count);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (auto cpu : _online) {
+            if (_primary[cpu] == (pass == 0)) {
+                nodes[_cpu_node[cpu]].emplace_back(cpu);
+            }
+        }
+    }
+    auto &first = nodes[0].empty() ? nodes[_cpu_node[_online[0]]] : nodes[0];
+    int reader = first[0];
+    int writer = first.size() > 1 ? first[1] : first[0];
+    if (_auto[RoleReader]) {
+        _cpus[RoleReader] = {reader};
+    }
+    if (_auto[RoleWriter]) {
+        _cpus[RoleWriter] = {writer};
+    }
+    if (_auto[RoleWorker]) {
+        //其余cpu在各节点间交替分配，相邻的worker位于不同节点
+        _cpus[RoleWorker].clear();
+        size_t index = 0;
+        bool more = true;
+        while (more) {
+            more = false;
+            for (auto &node : nodes) {
+                if (index >= node.size()) {
+                    continue;
+                }
+                more = true;
+                auto cpu = node[index];
+                if (cpu != reader && cpu != writer) {
+                    _cpus[RoleWorker].emplace_back(cpu);
+                }
+            }
+            ++index;
+        }
+        if (_cpus[RoleWorker].empty()) {
+            _cpus[RoleWorker] = _online;
+        }
+    }
+}
+
+bool CpuPlacement::setCpus(Role role, const string &spec) {
+    lock_guard<mutex> lck(_mtx);
+    if (spec == "auto") {
+        _auto[role] = true;
+        _auto_assigned = false;
+        _cpus[role].clear();
+        return true;
+    }
+    vector<int> cpus;
+    if (!parseCpuList(spec, cpus) || cpus.empty()) {
+        return false;
+    }
+    for (auto cpu : cpus) {
+        if (find(_online.begin(), _online.end(), cpu) == _online.end()) {
+            PrintW("cpu%d不在线", cpu);
+            return false;
+        }
+    }
+    _auto[role] = false;
+    _cpus[role] = std::move(cpus);
+    return true;
+}
+
+bool CpuPlacement::isEnabled(Role role) const {
+    lock_guard<mutex> lck(_mtx);
+    return _auto[role] || !_cpus[role].empty();
+}
+
+vector<int> CpuPlacement::getCpus(Role role) {
+    lock_guard<mutex> lck(_mtx);
+    if (_auto[role]) {
+        autoAssign();
+    }
+    return _cpus[role];
+}
+
+int CpuPlacement::bindCurrentThread(Role role, int index) {
+    auto cpus = getCpus(role);
+    if (cpus.empty()) {
+        return -1;
+    }
+    auto cpu = cpus[index % cpus.size()];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    auto ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        PrintE("%s线程绑定cpu%d失败:%s", roleName(role), cpu, strerror(ret));
+        return -1;
+    }
+    PrintI("%s线程%d绑定cpu%d, numa节点%d", roleName(role), index, cpu, getNode(cpu));
+    return cpu;
+}
+
+int CpuPlacement::getNode(int cpu) const {
+    if (cpu < 0 || cpu >= (int) _cpu_node.size()) {
+        return 0;
+    }
+    return _cpu_node[cpu];
+}
+
+int CpuPlacement::getNodeCount() const {
+    return _node_count;
+}
+
+bool CpuPlacement::parseCpuList(const string &spec, vector<int> &cpus) {
+    cpus.clear();
+    auto ptr = spec.c_str();
+    while (*ptr) {
+        if (*ptr == ',' || *ptr == '\n' || *ptr == ' ') {
+            ++ptr;
+            continue;
+        }
+        char *end;
+        auto first = strtol(ptr, &end, 10);
+        if (end == ptr || first < 0) {
+            return false;
+        }
+        auto last = first;
+        ptr = end;
+        if (*ptr == '-') {
+            ++ptr;
+            last = strtol(ptr, &end, 10);
+            if (end == ptr || last < first) {
+                return false;
+            }
+            ptr = end;
+        }
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            cpus.emplace_back(cpu);
+        }
+    }
+    return true;
+}
+
+void CpuPlacement::firstTouch(void *ptr, size_t size) {
+    static const long page_size = sysconf(_SC_PAGESIZE);
+    auto data = (volatile char *) ptr;
+    for (size_t i = 0; i < size; i += page_size) {
+        data[i] = data[i];
+    }
+}
+
+}//namespace mediakit
@@ -0,0 +1,95 @@
+#ifndef RTP2PS_CPUPLACEMENT_H
+#define RTP2PS_CPUPLACEMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mediakit{
+
+/**
+ * cpu绑定与numa感知的线程放置
+ * 拓扑从/sys/devices/system读取，不依赖libnuma；
+ * 每种角色(读取、流处理、写文件)可以配置cpu列表或auto，
+ * 线程先绑定cpu再申请自己的内存，由内核的首次访问(first-touch)策略把内存放在本地numa节点上
+ */
+class CpuPlacement {
+public:
+    enum Role {
+        //抓包/收包线程
+        RoleReader = 0,
+        //流处理线程
+        RoleWorker,
+        //写文件线程
+        RoleWriter,
+        RoleMax
+    };
+
+    static CpuPlacement &Instance();
+
+    /**
+     * 设置角色的cpu
+     * @param spec "auto"或者cpu列表，譬如"0-3,8,10-11"
+     * @return 格式错误或cpu不在线时返回false
+     */
+    bool setCpus(Role role, const std::string &spec);
+
+    /**
+     * 角色是否配置了cpu
+     */
+    bool isEnabled(Role role) const;
+
+    /**
+     * 获取角色的cpu列表，auto时按拓扑分配
+     */
+    std::vector<int> getCpus(Role role);
+
+    /**
+     * 把当前线程绑定到角色的第index个cpu(超出时循环使用)
+     * @return 绑定的cpu，未配置或失败时返回-1
+     */
+    int bindCurrentThread(Role role, int index = 0);
+
+    /**
+     * cpu所在的numa节点，未知时返回0
+     */
+    int getNode(int cpu) const;
+
+    /**
+     * numa节点个数
+     */
+    int getNodeCount() const;
+
+    /**
+     * 解析cpu列表
+     */
+    static bool parseCpuList(const std::string &spec, std::vector<int> &cpus);
+
+    /**
+     * 按页写入内存，使其在当前线程所在的numa节点上分配
+     */
+    static void firstTouch(void *ptr, size_t size);
+
+private:
+    CpuPlacement();
+    void loadTopology();
+    void autoAssign();
+
+private:
+    bool _auto_assigned = false;
+    int _node_count = 1;
+    //在线的cpu
+    std::vector<int> _online;
+    //以cpu编号为下标的numa节点
+    std::vector<int> _cpu_node;
+    //以cpu编号为下标，是否为物理核的第一个超线程
+    std::vector<bool> _primary;
+    bool _auto[RoleMax] = {false, false, false};
+    std::vector<int> _cpus[RoleMax];
+    mutable std::mutex _mtx;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_CPUPLACEMENT_H
@@ -0,0 +1,386 @@
+#include "Decompressor.h"
+#include <string.h>
+#include "CpuPlacement.h"
+#include "Logger.h"
+#include "Trace.h"
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace mediakit{
+
+static const uint8_t s_gzip_magic[] = {0x1F, 0x8B};
+static const uint8_t s_zstd_magic[] = {0x28, 0xB5, 0x2F, 0xFD};
+
+Decompressor::Format Decompressor::detect(const char *data, size_t size) {
+    if (size >= sizeof(s_gzip_magic) && !memcmp(data, s_gzip_magic, sizeof(s_gzip_magic))) {
+        return FormatGzip;
+    }
+    if (size >= sizeof(s_zstd_magic) && !memcmp(data, s_zstd_magic, sizeof(s_zstd_magic))) {
+        return FormatZstd;
+    }
+    return FormatNone;
+}
+
+bool Decompressor::isSupported(Format format) {
+    switch (format) {
+#ifdef ENABLE_ZLIB
+        case FormatGzip: return true;
+#endif
+#ifdef ENABLE_ZSTD
+        case FormatZstd: return true;
+#endif
+        default: return false;
+    }
+}
+
+const char *Decompressor::getName(Format format) {
+    switch (format) {
+        case FormatGzip: return "gzip";
+        case FormatZstd: return "zstd";
+        default: return "none";
+    }
+}
+
+Decompressor::Decompressor(const char *data, size_t size, Format format) : Decompressor(data, size, format, Config()) {}
+
+Decompressor::Decompressor(const char *data, size_t size, Format format, const Config &config) {
+    _data = data;
+    _size = size;
+    _format = format;
+    _config = config;
+    if (!_config.max_chunks) {
+        _config.max_chunks = 1;
+    }
+    if (_format == FormatZstd) {
+        uint32_t threads = _config.threads;
+        if (!threads) {
+            threads = std::thread::hardware_concurrency();
+            threads = threads ? (threads > 8 ? 8 : threads) : 1;
+        }
+        for (uint32_t i = 0; i < threads; ++i) {
+            _workers.emplace_back([this, i]() {
+                runWorker(i);
+            });
+        }
+    }
+    _thread = std::thread([this]() {
+        run();
+    });
+}
+
+Decompressor::~Decompressor() {
+    {
+        lock_guard<mutex> lck(_mtx);
+        _exit = true;
+    }
+    _cv_push.notify_all();
+    _cv_task.notify_all();
+    _cv_read.notify_all();
+    _thread.join();
+    for (auto &worker : _workers) {
+        worker.join();
+    }
+}
+
+bool Decompressor::read(char *&data, size_t &size) {
+    unique_lock<mutex> lck(_mtx);
+    //回收上一块，流式解压的块缓存循环使用
+    if (_reading && !_reading->src && _free.size() < _config.max_chunks) {
+        _free.emplace_back(std::move(_reading));
+    }
+    _reading = nullptr;
+    while (true) {
+        _cv_read.wait(lck, [this]() {
+            return _exit || (!_chunks.empty() && _chunks.front()->ready) || (_done && _chunks.empty());
+        });
+        if (_exit || _chunks.empty()) {
+            return false;
+        }
+        auto chunk = std::move(_chunks.front());
+        _chunks.pop_front();
+        _cv_push.notify_one();
+        if (chunk->error) {
+            //之前的块都已输出，之后的数据不再可信
+            _error = true;
+            return false;
+        }
+        if (chunk->data.empty()) {
+            continue;
+        }
+        _reading = std::move(chunk);
+        data = &_reading->data[0];
+        size = _reading->data.size();
+        return true;
+    }
+}
+
+bool Decompressor::hasError() const {
+    lock_guard<mutex> lck(_mtx);
+    return _error;
+}
+
+Decompressor::Chunk::Ptr Decompressor::obtainChunk() {
+    Chunk::Ptr chunk;
+    {
+        lock_guard<mutex> lck(_mtx);
+        if (!_free.empty()) {
+            chunk = std::move(_free.back());
+            _free.pop_back();
+        }
+    }
+    if (!chunk) {
+        chunk = std::make_shared<Chunk>();
+    }
+    chunk->ready = false;
+    chunk->error = false;
+    //缩小后容量不变，不会重新分配
+    chunk->data.resize(_config.chunk_size);
+    return chunk;
+}
+
+bool Decompressor::push(const Chunk::Ptr &chunk) {
+    unique_lock<mutex> lck(_mtx);
+    _cv_push.wait(lck, [this]() {
+        return _exit || _chunks.size() < _config.max_chunks;
+    });
+    if (_exit) {
+        return false;
+    }
+    _chunks.emplace_back(chunk);
+    if (chunk->ready) {
+        _cv_read.notify_one();
+    } else {
+        _tasks.emplace_back(chunk);
+        _cv_task.notify_one();
+    }
+    return true;
+}
+
+void Decompressor::finish(bool error) {
+    if (error) {
+        //错误作为最后一块，之前的数据仍然可以被解析
+        auto chunk = std::make_shared<Chunk>();
+        chunk->ready = true;
+        chunk->error = true;
+        push(chunk);
+    }
+    {
+        lock_guard<mutex> lck(_mtx);
+        _done = true;
+    }
+    _cv_read.notify_all();
+    _cv_task.notify_all();
+}
+
+//读取cpu足够时绑定第index个，不足时不绑定，避免循环使用时与解析线程挤在同一个cpu上
+static void bindReaderCpu(int index) {
+    auto &placement = CpuPlacement::Instance();
+    if (!placement.isEnabled(CpuPlacement::RoleReader)) {
+        return;
+    }
+    if ((int) placement.getCpus(CpuPlacement::RoleReader).size() <= index) {
+        PrintI("读取cpu不足，解压线程%d不绑定cpu", index);
+        return;
+    }
+    placement.bindCurrentThread(CpuPlacement::RoleReader, index);
+}
+
+void Decompressor::run() {
+    //解析线程为第0个读取cpu
+    bindReaderCpu(1);
+    switch (_format) {
+        case FormatGzip: runGzip(); break;
+        case FormatZstd: runZstd(); break;
+        default:
+            PrintE("不支持的压缩格式:%s", getName(_format));
+            finish(true);
+            break;
+    }
+}
+
+void Decompressor::runWorker(int index) {
+    bindReaderCpu(2 + index);
+#ifdef ENABLE_ZSTD
+    auto dctx = ZSTD_createDCtx();
+#endif
+    while (true) {
+        Chunk::Ptr chunk;
+        {
+            unique_lock<mutex> lck(_mtx);
+            _cv_task.wait(lck, [this]() {
+                return _exit || _done || !_tasks.empty();
+            });
+            if (_exit || _tasks.empty()) {
+                //_done之后不会再有新的任务
+                break;
+            }
+            chunk = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        bool error = true;
+#ifdef ENABLE_ZSTD
+        {
+            TraceSpan("zstdFrame");
+            auto content = ZSTD_getFrameContentSize(chunk->src, chunk->src_size);
+            chunk->data.resize(content);
+            auto ret = ZSTD_decompressDCtx(dctx, &chunk->data[0], chunk->data.size(), chunk->src, chunk->src_size);
+            error = ZSTD_isError(ret) || ret != content;
+            if (error) {
+                PrintE("zstd帧解压失败:%s", ZSTD_isError(ret) ? ZSTD_getErrorName(ret) : "长度不一致");
+            }
+        }
+#endif
+        {
+            lock_guard<mutex> lck(_mtx);
+            chunk->ready = true;
+            chunk->error = error;
+        }
+        _cv_read.notify_all();
+    }
+#ifdef ENABLE_ZSTD
+    ZSTD_freeDCtx(dctx);
+#endif
+}
+
+void Decompressor::runGzip() {
+#ifdef ENABLE_ZLIB
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    //自动识别gzip与zlib头
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        finish(true);
+        return;
+    }
+    //avail_in为32位，超大文件分段输入
+    static const size_t kMaxInput = 1024 * 1024 * 1024;
+    size_t pos = 0;
+    bool error = false;
+    bool end = false;
+    auto chunk = obtainChunk();
+    zs.next_out = (Bytef *) &chunk->data[0];
+    zs.avail_out = chunk->data.size();
+    while (!end) {
+        if (!zs.avail_in && pos < _size) {
+            auto n = _size - pos > kMaxInput ? kMaxInput : _size - pos;
+            zs.next_in = (Bytef *) _data + pos;
+            zs.avail_in = n;
+            pos += n;
+        }
+        int ret;
+        {
+            TraceSpan("inflate");
+            ret = inflate(&zs, Z_NO_FLUSH);
+        }
+        if (ret == Z_STREAM_END) {
+            //多个gzip成员拼接的文件继续解压下一个成员，其他的尾部数据忽略
+            auto next = (const char *) zs.next_in;
+            auto left = zs.avail_in + (_size - pos);
+            if (left >= sizeof(s_gzip_magic) && !memcmp(next, s_gzip_magic, sizeof(s_gzip_magic))) {
+                inflateReset(&zs);
+            } else {
+                if (left) {
+                    PrintW("忽略gzip之后的%llu字节", (unsigned long long) left);
+                }
+                end = true;
+            }
+        } else if (ret == Z_BUF_ERROR && !zs.avail_in && pos >= _size) {
+            PrintE("gzip数据不完整");
+            error = end = true;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            PrintE("gzip解压失败:%s", zs.msg ? zs.msg : "");
+            error = end = true;
+        }
+        if (!zs.avail_out || end) {
+            chunk->data.resize(chunk->data.size() - zs.avail_out);
+            chunk->ready = true;
+            if (!push(chunk)) {
+                //析构中
+                inflateEnd(&zs);
+                return;
+            }
+            chunk = obtainChunk();
+            zs.next_out = (Bytef *) &chunk->data[0];
+            zs.avail_out = chunk->data.size();
+        }
+    }
+    inflateEnd(&zs);
+    finish(error);
+#else
+    PrintE("编译时未找到zlib，不支持gzip");
+    finish(true);
+#endif
+}
+
+void Decompressor::runZstd() {
+#ifdef ENABLE_ZSTD
+    auto dstream = ZSTD_createDStream();
+    size_t pos = 0;
+    bool error = false;
+    while (pos < _size && !error) {
+        auto src = _data + pos;
+        auto frame = ZSTD_findFrameCompressedSize(src, _size - pos);
+        if (ZSTD_isError(frame)) {
+            PrintE("zstd帧不完整:%s", ZSTD_getErrorName(frame));
+            error = true;
+            break;
+        }
+        pos += frame;
+        auto content = ZSTD_getFrameContentSize(src, frame);
+        if (content != ZSTD_CONTENTSIZE_UNKNOWN && content != ZSTD_CONTENTSIZE_ERROR && content <= _config.max_frame_size) {
+            //交给线程池解压
+            auto chunk = std::make_shared<Chunk>();
+            chunk->src = src;
+            chunk->src_size = frame;
+            if (!push(chunk)) {
+                ZSTD_freeDStream(dstream);
+                return;
+            }
+            continue;
+        }
+
+        //大小未知或者太大的帧流式解压
+        ZSTD_DCtx_reset(dstream, ZSTD_reset_session_only);
+        ZSTD_inBuffer in = {src, frame, 0};
+        size_t ret = 1;
+        while (ret && !error) {
+            auto chunk = obtainChunk();
+            ZSTD_outBuffer out = {&chunk->data[0], chunk->data.size(), 0};
+            while (out.pos < out.size && ret) {
+                TraceSpan("zstdStream");
+                ret = ZSTD_decompressStream(dstream, &out, &in);
+                if (ZSTD_isError(ret)) {
+                    PrintE("zstd解压失败:%s", ZSTD_getErrorName(ret));
+                    error = true;
+                    break;
+                }
+                if (ret && in.pos == in.size && out.pos < out.size) {
+                    PrintE("zstd帧不完整");
+                    error = true;
+                    break;
+                }
+            }
+            chunk->data.resize(out.pos);
+            chunk->ready = true;
+            if (!push(chunk)) {
+                //析构中
+                ZSTD_freeDStream(dstream);
+                return;
+            }
+        }
+    }
+    ZSTD_freeDStream(dstream);
+    finish(error);
+#else
+    PrintE("编译时未找到zstd，不支持zstd");
+    finish(true);
+#endif
+}
+
+}//namespace mediakit
@@ -0,0 +1,130 @@
+#ifndef RTP2PS_DECOMPRESSOR_H
+#define RTP2PS_DECOMPRESSOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+
+namespace mediakit{
+
+/**
+ * 压缩抓包文件的流式解压
+ * 解压在独立的线程中进行，解压后的数据按顺序放入有界的块队列，解析线程依次取出，解压与解析重叠；
+ * gzip由解压线程流式解压；zstd的多帧文件中，已知解压后大小且不太大的帧分发给解压线程池并行解压，
+ * 其他帧由解压线程流式解压，输出顺序与文件中的顺序一致
+ */
+class Decompressor {
+public:
+    typedef std::shared_ptr<Decompressor> Ptr;
+
+    typedef enum {
+        FormatNone = 0,
+        FormatGzip,
+        FormatZstd,
+    } Format;
+
+    struct Config {
+        //流式解压时每块的大小
+        uint32_t chunk_size = 4 * 1024 * 1024;
+        //队列中最多的块数，解析跟不上时解压线程等待
+        uint32_t max_chunks = 8;
+        //zstd并行解压的线程数，0为在线cpu个数(最多8个)
+        uint32_t threads = 0;
+        //并行解压的zstd帧解压后的最大大小，更大的帧流式解压
+        uint32_t max_frame_size = 64 * 1024 * 1024;
+    };
+
+    /**
+     * 根据文件头的magic判断压缩格式
+     */
+    static Format detect(const char *data, size_t size);
+
+    /**
+     * 编译时是否支持该格式
+     */
+    static bool isSupported(Format format);
+
+    static const char *getName(Format format);
+
+    /**
+     * @param data 压缩数据，解压结束前必须有效
+     * @param size 压缩数据长度
+     * @param format 压缩格式
+     */
+    Decompressor(const char *data, size_t size, Format format);
+    Decompressor(const char *data, size_t size, Format format, const Config &config);
+    ~Decompressor();
+
+    /**
+     * 取出下一块解压后的数据，上一块同时被回收
+     * 数据在下一次调用read()之前有效
+     * @return 全部数据已读完或者解压出错时返回false
+     */
+    bool read(char *&data, size_t &size);
+
+    /**
+     * 解压是否出错，数据损坏或不完整
+     */
+    bool hasError() const;
+
+private:
+    struct Chunk {
+        typedef std::shared_ptr<Chunk> Ptr;
+        std::string data;
+        //由线程池解压的zstd帧
+        const char *src = nullptr;
+        size_t src_size = 0;
+        bool ready = false;
+        //该块解压失败
+        bool error = false;
+    };
+
+    void run();
+    void runWorker(int index);
+    void runGzip();
+    void runZstd();
+
+    /**
+     * 块放入队列，队列满时等待
+     * @return 需要退出时返回false
+     */
+    bool push(const Chunk::Ptr &chunk);
+
+    /**
+     * 获取流式解压用的块，优先复用已被解析的块
+     */
+    Chunk::Ptr obtainChunk();
+    void finish(bool error);
+
+private:
+    const char *_data;
+    size_t _size;
+    Format _format;
+    Config _config;
+    bool _exit = false;
+    bool _done = false;
+    bool _error = false;
+    //按顺序的块，包括还在线程池中解压的块
+    std::deque<Chunk::Ptr> _chunks;
+    //等待线程池解压的块
+    std::deque<Chunk::Ptr> _tasks;
+    //正在被解析的块
+    Chunk::Ptr _reading;
+    //可以复用的块
+    std::vector<Chunk::Ptr> _free;
+    mutable std::mutex _mtx;
+    std::condition_variable _cv_read;
+    std::condition_variable _cv_push;
+    std::condition_variable _cv_task;
+    std::thread _thread;
+    std::vector<std::thread> _workers;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_DECOMPRESSOR_H
@@ -0,0 +1,162 @@
+#ifndef RTP2PS_DUPLICATEFILTER_H
+#define RTP2PS_DUPLICATEFILTER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "Checkpoint.h"
+
+namespace mediakit{
+
+/**
+ * rtp重复包过滤，记录最近kWindow个序列号是否已收到
+ * 序列号按kWindow取模映射到位图，kWindow整除65536，回环前后映射一致；
+ * 每个包只做常数次位运算，在拷贝rtp数据之前丢弃重复包
+ * 开启负载哈希时每个序列号同时记录负载摘要，序列号相同但负载不同(ssrc冲突)的包不视为重复
+ */
+class DuplicateFilter {
+public:
+    //窗口大小，必须是64的倍数且整除65536
+    static const uint32_t kWindow = 1024;
+
+    struct Stats {
+        //丢弃的重复包数
+        uint64_t duplicates = 0;
+        //序列号重复但负载摘要不同的包数
+        uint64_t hash_mismatches = 0;
+    };
+
+    /**
+     * 开启负载哈希校验
+     */
+    void setHashCheck(bool enable) {
+        _hashes.assign(enable ? kWindow : 0, 0);
+    }
+
+    bool isHashCheck() const {
+        return !_hashes.empty();
+    }
+
+    /**
+     * 清空窗口，ssrc切换时调用
+     */
+    void clear() {
+        _started = false;
+        memset(_bits, 0, sizeof(_bits));
+    }
+
+    /**
+     * 判断是否为重复包
+     * @param seq 序列号
+     * @param hash 负载摘要，未开启负载哈希时忽略
+     */
+    bool isDuplicate(uint16_t seq, uint32_t hash) {
+        if (!_started) {
+            return false;
+        }
+        auto diff = (int16_t) (uint16_t) (seq - _highest);
+        if (diff > 0 || -diff >= (int) kWindow || !testBit(seq)) {
+            //新的序列号，或者太旧已经移出窗口
+            return false;
+        }
+        if (!_hashes.empty() && _hashes[seq % kWindow] != hash) {
+            ++_stats.hash_mismatches;
+            return false;
+        }
+        ++_stats.duplicates;
+        return true;
+    }
+
+    /**
+     * 记录已收到的序列号
+     */
+    void mark(uint16_t seq, uint32_t hash) {
+        if (!_started) {
+            _started = true;
+            _highest = seq;
+        }
+        auto diff = (int16_t) (uint16_t) (seq - _highest);
+        if (diff > 0) {
+            //窗口前移，清除移入窗口的位
+            if (diff >= (int) kWindow) {
+                memset(_bits, 0, sizeof(_bits));
+            } else {
+                for (uint16_t s = _highest + 1; s != seq; ++s) {
+                    clearBit(s);
+                }
+            }
+            _highest = seq;
+        } else if (-diff >= (int) kWindow) {
+            return;
+        }
+        _bits[(seq % kWindow) / 64] |= 1ULL << (seq % 64);
+        if (!_hashes.empty()) {
+            _hashes[seq % kWindow] = hash;
+        }
+    }
+
+    /**
+     * 计算负载摘要：rtp时间戳、长度与负载首尾各8字节，开销与包长无关
+     * @param rtp rtp数据，至少12字节
+     */
+    static uint32_t hashPacket(const uint8_t *rtp, uint32_t len) {
+        uint64_t head = 0, tail = 0;
+        uint32_t stamp;
+        memcpy(&stamp, rtp + 4, 4);
+        auto n = len - 12 < 8 ? len - 12 : 8;
+        memcpy(&head, rtp + 12, n);
+        memcpy(&tail, rtp + len - n, n);
+        uint64_t h = ((uint64_t) stamp << 32 | len) * 0x9E3779B97F4A7C15ULL;
+        h = (h ^ head) * 0xC2B2AE3D27D4EB4FULL;
+        h = (h ^ tail) * 0x165667B19E3779F9ULL;
+        return (uint32_t) (h >> 32);
+    }
+
+    const Stats &getStats() const {
+        return _stats;
+    }
+
+    /**
+     * 保存与恢复窗口状态，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const {
+        writer.write(_started);
+        writer.write(_highest);
+        writer.write(_bits);
+        writer.write(_stats);
+        writer.write((uint32_t) _hashes.size());
+        writer.writeBytes((const char *) _hashes.data(), _hashes.size() * sizeof(uint32_t));
+    }
+
+    bool loadState(CheckpointReader &reader) {
+        uint32_t hashes;
+        const char *data;
+        uint32_t size;
+        if (!reader.read(_started) || !reader.read(_highest) || !reader.read(_bits) || !reader.read(_stats)
+            || !reader.read(hashes) || !reader.readBytes(data, size) || size != hashes * sizeof(uint32_t)) {
+            return false;
+        }
+        _hashes.assign((const uint32_t *) data, (const uint32_t *) data + hashes);
+        return true;
+    }
+
+private:
+    bool testBit(uint16_t seq) const {
+        return _bits[(seq % kWindow) / 64] & (1ULL << (seq % 64));
+    }
+
+    void clearBit(uint16_t seq) {
+        _bits[(seq % kWindow) / 64] &= ~(1ULL << (seq % 64));
+    }
+
+private:
+    bool _started = false;
+    //已收到的最大序列号
+    uint16_t _highest = 0;
+    uint64_t _bits[kWindow / 64] = {0};
+    std::vector<uint32_t> _hashes;
+    Stats _stats;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_DUPLICATEFILTER_H
@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "EventPoller.h"
+#include "CpuPlacement.h"
+#include "SlabAllocator.h"
+#include "Logger.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//单次epoll_wait最多返回的事件数
+static const int kMaxEvents = 256;
+
+static uint64_t getCurrentMillisecond() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+EventPoller::EventPoller(int index) : _index(index) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_epoll_fd < 0 || _event_fd < 0) {
+        PrintE("创建epoll失败:%s", strerror(errno));
+        return;
+    }
+    addEvent(_event_fd, Event_Read, [this](int event) {
+        onWakeup();
+    });
+}
+
+EventPoller::~EventPoller() {
+    shutdown();
+    if (_event_fd >= 0) {
+        close(_event_fd);
+    }
+    if (_epoll_fd >= 0) {
+        close(_epoll_fd);
+    }
+}
+
+int EventPoller::start() {
+    if (_epoll_fd < 0 || _event_fd < 0) {
+        return -1;
+    }
+    _exit = false;
+    _thread = std::thread([this]() {
+        runLoop();
+    });
+    return 0;
+}
+
+void EventPoller::shutdown() {
+    if (!_thread.joinable()) {
+        return;
+    }
+    _exit = true;
+    uint64_t one = 1;
+    auto n = write(_event_fd, &one, sizeof(one));
+    (void) n;
+    _thread.join();
+}
+
+int EventPoller::addEvent(int fd, int event, PollEventCB cb) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = event;
+    ev.data.fd = fd;
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        return -errno;
+    }
+    _events[fd] = std::make_shared<PollEventCB>(std::move(cb));
+    return 0;
+}
+
+int EventPoller::delEvent(int fd) {
+    _events.erase(fd);
+    if (epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+void EventPoller::async(Task task) {
+    bool wakeup;
+    {
+        lock_guard<mutex> lck(_mtx);
+        wakeup = _tasks.empty();
+        _tasks.emplace_back(std::move(task));
+    }
+    if (wakeup) {
+        //队列非空时事件循环已经被唤醒过
+        uint64_t one = 1;
+        auto n = write(_event_fd, &one, sizeof(one));
+        (void) n;
+    }
+}
+
+void EventPoller::setOnTimer(uint32_t interval_ms, Task cb) {
+    _timer_interval = interval_ms;
+    _on_timer = std::move(cb);
+}
+
+bool EventPoller::isCurrentThread() const {
+    return this_thread::get_id() == _thread_id;
+}
+
+int EventPoller::getIndex() const {
+    return _index;
+}
+
+void EventPoller::onWakeup() {
+    uint64_t value;
+    auto n = read(_event_fd, &value, sizeof(value));
+    (void) n;
+
+    vector<Task> tasks;
+    {
+        lock_guard<mutex> lck(_mtx);
+        tasks.swap(_tasks);
+    }
+    for (auto &task : tasks) {
+        task();
+    }
+}
+
+void EventPoller::runLoop() {
+    _thread_id = this_thread::get_id();
+    if (_index >= 0 && CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleWorker, _index) >= 0) {
+        //本线程的slab内存位于本地numa节点
+        SlabAllocator::warmUp(1);
+    }
+
+    struct epoll_event events[kMaxEvents];
+    auto next_timer = getCurrentMillisecond() + _timer_interval;
+    while (!_exit) {
+        int timeout = -1;
+        if (_on_timer) {
+            auto now = getCurrentMillisecond();
+            timeout = next_timer > now ? (int) (next_timer - now) : 0;
+        }
+        int count = epoll_wait(_epoll_fd, events, kMaxEvents, timeout);
+        if (count < 0 && errno != EINTR) {
+            PrintE("epoll_wait失败:%s", strerror(errno));
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            auto it = _events.find(events[i].data.fd);
+            if (it == _events.end()) {
+                continue;
+            }
+            //回调中可能会取消监听
+            auto cb = it->second;
+            (*cb)(events[i].events);
+        }
+        if (_on_timer && getCurrentMillisecond() >= next_timer) {
+            next_timer = getCurrentMillisecond() + _timer_interval;
+            _on_timer();
+        }
+    }
+}
+
+}//namespace mediakit
@@ -0,0 +1,103 @@
+#ifndef RTP2PS_EVENTPOLLER_H
+#define RTP2PS_EVENTPOLLER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <sys/epoll.h>
+
+namespace mediakit{
+
+/**
+ * 基于epoll的事件循环，一个线程一个实例
+ * 文件描述符事件与异步任务都在事件循环线程中执行，跨线程只能通过async()投递任务
+ */
+class EventPoller {
+public:
+    typedef std::shared_ptr<EventPoller> Ptr;
+    typedef std::function<void(int event)> PollEventCB;
+    typedef std::function<void()> Task;
+
+    enum {
+        Event_Read = EPOLLIN,
+        Event_Write = EPOLLOUT,
+        Event_Error = EPOLLERR | EPOLLHUP,
+    };
+
+    /**
+     * @param index 线程下标，用于绑定cpu，小于0时不绑定
+     */
+    EventPoller(int index);
+    ~EventPoller();
+
+    EventPoller(const EventPoller &) = delete;
+    EventPoller &operator=(const EventPoller &) = delete;
+
+    /**
+     * 启动事件循环线程
+     * @return 成功返回0
+     */
+    int start();
+
+    /**
+     * 停止并等待事件循环线程退出，未执行的任务被丢弃
+     */
+    void shutdown();
+
+    /**
+     * 监听文件描述符事件，只能在事件循环线程中调用，或在start()之前调用
+     * @param fd 文件描述符
+     * @param event Event_Read等事件的组合
+     * @param cb 事件回调
+     * @return 成功返回0，失败返回-errno
+     */
+    int addEvent(int fd, int event, PollEventCB cb);
+
+    /**
+     * 取消监听文件描述符，不会关闭文件描述符，只能在事件循环线程中调用
+     */
+    int delEvent(int fd);
+
+    /**
+     * 投递任务到事件循环线程，线程安全
+     */
+    void async(Task task);
+
+    /**
+     * 设置定时回调，在事件循环线程中每隔interval_ms毫秒调用一次，start()之前调用
+     */
+    void setOnTimer(uint32_t interval_ms, Task cb);
+
+    /**
+     * 是否在本事件循环线程中
+     */
+    bool isCurrentThread() const;
+
+    int getIndex() const;
+
+private:
+    void runLoop();
+    void onWakeup();
+
+private:
+    int _index;
+    int _epoll_fd = -1;
+    //用于唤醒事件循环的eventfd
+    int _event_fd = -1;
+    std::atomic<bool> _exit{false};
+    std::thread _thread;
+    std::thread::id _thread_id;
+    std::unordered_map<int, std::shared_ptr<PollEventCB> > _events;
+    std::mutex _mtx;
+    std::vector<Task> _tasks;
+    uint32_t _timer_interval = 0;
+    Task _on_timer;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_EVENTPOLLER_H
@@ -0,0 +1,59 @@
+#include "FileWriter.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Logger.h"
+
+namespace mediakit{
+
+FrameFileWriter::FrameFileWriter(const std::string &path, uint32_t buffer_size) {
+    _fp = fopen(path.c_str(), "ab");
+    if (!_fp) {
+        PrintE("打开文件失败:%s", path.c_str());
+        return;
+    }
+    if (buffer_size) {
+        _buffer.resize(buffer_size);
+        setvbuf(_fp, _buffer.data(), _IOFBF, _buffer.size());
+    }
+    //追加写入，从原有长度开始计算
+    struct stat st;
+    if (fstat(fileno(_fp), &st) == 0) {
+        _size = st.st_size;
+    }
+}
+
+FrameFileWriter::~FrameFileWriter() {
+    if (_fp) {
+        fclose(_fp);
+    }
+}
+
+bool FrameFileWriter::isOpen() const {
+    return _fp != nullptr;
+}
+
+void FrameFileWriter::inputFrame(const Frame::Ptr &frame) {
+    if (_fp) {
+        fwrite(frame->data(), frame->size(), 1, _fp);
+        _size += frame->size();
+    }
+}
+
+uint64_t FrameFileWriter::size() const {
+    return _size;
+}
+
+bool FrameFileWriter::flush() {
+    return _fp && fflush(_fp) == 0 && fdatasync(fileno(_fp)) == 0;
+}
+
+bool FrameFileWriter::truncate(uint64_t size) {
+    if (!_fp || fflush(_fp) != 0 || ftruncate(fileno(_fp), size) != 0) {
+        PrintE("截断文件失败:%llu", (unsigned long long) size);
+        return false;
+    }
+    _size = size;
+    return true;
+}
+
+}//namespace mediakit
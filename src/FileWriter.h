@@ -0,0 +1,57 @@
+#ifndef RTP2PS_FILEWRITER_H
+#define RTP2PS_FILEWRITER_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "Frame.h"
+
+namespace mediakit{
+
+/**
+ * 把帧追加写入文件，文件在整个生命周期内保持打开，使用大块用户态缓存减少write调用
+ */
+class FrameFileWriter : public FrameWriterInterface {
+public:
+    typedef std::shared_ptr<FrameFileWriter> Ptr;
+
+    /**
+     * @param path 文件路径
+     * @param buffer_size 用户态缓存大小
+     */
+    FrameFileWriter(const std::string &path, uint32_t buffer_size = 1024 * 1024);
+    ~FrameFileWriter() override;
+
+    /**
+     * 文件是否打开成功
+     */
+    bool isOpen() const;
+
+    /**
+     * 写入帧数据
+     */
+    void inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * 文件长度，包括还在用户态缓存中的数据
+     */
+    uint64_t size() const;
+
+    /**
+     * 写出用户态缓存并落盘，保存断点前调用
+     */
+    bool flush();
+
+    /**
+     * 截断文件，断点续传时丢弃断点之后写入的数据
+     */
+    bool truncate(uint64_t size);
+
+private:
+    FILE *_fp = nullptr;
+    uint64_t _size = 0;
+    std::vector<char> _buffer;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_FILEWRITER_H
@@ -16,8 +16,11 @@
 #include <memory>
 #include <bits/shared_ptr.h>
 #include <map>
+#include <vector>
 #include <string.h>
 #include "ResourcePool.h"
+#include "SlabAllocator.h"
+#include "Logger.h"
 
 using namespace std;
 using namespace toolkit;
@@ -110,6 +113,27 @@ public:
         return size();
     }
 };
+/**
+ * 帧的时延戳，时间与rtp包的到达时间使用同一时钟，微秒，0为未知
+ */
+struct FrameArrival {
+    //帧内rtp包最早与最晚的到达时间
+    uint64_t first_us = 0;
+    uint64_t last_us = 0;
+    //帧被解码器输出的时间
+    uint64_t emit_us = 0;
+
+    /**
+     * 记录帧内一个rtp包的到达时间
+     */
+    void mark(uint64_t arrival_us) {
+        if (!first_us) {
+            first_us = arrival_us;
+        }
+        last_us = arrival_us;
+    }
+};
+
 /**
  * 帧类型的抽象接口
  */
@@ -151,6 +175,12 @@ public:
      */
     virtual bool cacheAble() const { return true; }
 
+    /**
+     * 时延戳，用于统计端到端时延，不支持时返回nullptr
+     */
+    virtual FrameArrival *getArrival() { return nullptr; }
+    virtual const FrameArrival *getArrival() const { return nullptr; }
+
     /**
      * 返回可缓存的frame
      */
@@ -172,7 +202,7 @@ public:
 
     ~BufferRaw() {
         if(_data){
-            delete [] _data;
+            SlabAllocator::deallocate(_data);
         }
     }
     //在写入数据时请确保内存是否越界
@@ -203,10 +233,16 @@ public:
                 }
             }while(false);
 
-            delete [] _data;
+            SlabAllocator::deallocate(_data);
         }
-        _data = new char[capacity];
-        _capacity = capacity;
+        //从slab分配器申请，实际容量为所在分级的大小
+        size_t real_capacity;
+        _data = (char *) SlabAllocator::allocate(capacity, real_capacity);
+        if (!_data) {
+            _capacity = 0;
+            throw std::bad_alloc();
+        }
+        _capacity = real_capacity;
     }
     //设置有效数据大小
     void setSize(uint32_t size){
@@ -247,6 +283,8 @@ public:
     uint32_t ssrc;
     uint32_t offset;
     TrackType type;
+    //到达时间，微秒
+    uint64_t arrival_us = 0;
 };
 
 class BufferLikeString : public Buffer {
@@ -258,14 +296,14 @@ public:
         _erase_tail  = 0;
     }
 
-    BufferLikeString(string str) {
-        _str = std::move(str);
+    BufferLikeString(const string &str) {
+        _str.assign(str.data(), str.size());
         _erase_head = 0;
         _erase_tail  = 0;
     }
 
-    BufferLikeString& operator= (string str){
-        _str = std::move(str);
+    BufferLikeString& operator= (const string &str){
+        _str.assign(str.data(), str.size());
         _erase_head = 0;
         _erase_tail  = 0;
         return *this;
@@ -451,6 +489,15 @@ public:
         _str.reserve(size);
     }
 
+    /**
+     * 清空并释放缓存，容量归还给分配器
+     */
+    void release() {
+        _erase_head = 0;
+        _erase_tail = 0;
+        decltype(_str)().swap(_str);
+    }
+
     bool empty() const{
         return size() <= 0;
     }
@@ -461,14 +508,14 @@ public:
             if (pos >= size()) {
                 throw std::out_of_range("BufferLikeString::substr out_of_range");
             }
-            return _str.substr(_erase_head + pos, size() - pos);
+            return string(_str.data() + _erase_head + pos, size() - pos);
         }
 
         //获取部分
         if (pos + n > size()) {
             throw std::out_of_range("BufferLikeString::substr out_of_range");
         }
-        return _str.substr(_erase_head + pos, n);
+        return string(_str.data() + _erase_head + pos, n);
     }
 
 private:
@@ -482,7 +529,8 @@ private:
 private:
     uint32_t _erase_head;
     uint32_t _erase_tail;
-    string _str;
+    //帧数据从slab分配器申请
+    basic_string<char, char_traits<char>, SlabStlAllocator<char> > _str;
 };
 
 class FrameImp : public Frame {
@@ -521,12 +569,21 @@ public:
         return false;
     }
 
+    FrameArrival *getArrival() override {
+        return &_arrival;
+    }
+
+    const FrameArrival *getArrival() const override {
+        return &_arrival;
+    }
+
 public:
     CodecId _codec_id = CodecInvalid;
     BufferLikeString _buffer;
     uint32_t _dts = 0;
     uint32_t _pts = 0;
     uint32_t _prefix_size = 0;
+    FrameArrival _arrival;
 };
 
 /**
@@ -562,13 +619,61 @@ public:
     virtual ~ResourcePoolHelper(){}
 
     std::shared_ptr<T> obtainObj(){
-        printf("obtainObj\n");
+        PrintT("obtainObj");
         return _pool.obtain();
     }
 private:
     ResourcePool<T> _pool;
 };
 
+/**
+ * 单个流的帧大小预测
+ * 按最近帧大小的指数加权平均预估下一帧大小，新帧预先申请相应分级的缓存，避免逐次扩容；
+ * 峰值缓慢衰减，i帧与p帧交替时保留i帧所需的容量，
+ * 循环使用的帧对象容量远超近期峰值时归还给分配器，由所有流共用
+ */
+class FrameSizePredictor {
+public:
+    /**
+     * 记录输出的帧大小
+     */
+    void update(size_t size) {
+        _average = _average ? _average - _average / 8 + size / 8 : size;
+        _peak -= _peak / 64;
+        if (size > _peak) {
+            _peak = size;
+        }
+    }
+
+    /**
+     * 按预估大小准备新帧的缓存，缓存必须为空
+     */
+    void prepare(BufferLikeString &buffer) const {
+        if (!_average) {
+            return;
+        }
+        auto capacity = buffer.capacity();
+        auto peak = SlabAllocator::roundUp(_peak);
+        if (capacity > 64 * 1024 && capacity > 2 * peak) {
+            buffer.release();
+            capacity = buffer.capacity();
+        }
+        auto predict = _average + _average / 2;
+        if (capacity < predict) {
+            //正好占满分级，basic_string额外申请结尾的'\0'
+            buffer.reserve(SlabAllocator::roundUp(predict + 1) - 1);
+        }
+    }
+
+    size_t getAverage() const {
+        return _average;
+    }
+
+private:
+    size_t _average = 0;
+    size_t _peak = 0;
+};
+
 /**
  * 写帧接口的抽象接口类
  */
@@ -648,13 +753,16 @@ public:
         if(_need_update){
             //发现代理列表发生变化了，这里同步一次
             lock_guard<mutex> lck(_mtx);
-            _delegates_read = _delegates_write;
+            _delegates_read.clear();
+            for(auto &pr : _delegates_write){
+                _delegates_read.emplace_back(pr.second);
+            }
             _need_update = false;
         }
 
-        //_delegates_read能确保是单线程操作的
-        for(auto &pr : _delegates_read){
-            pr.second->inputFrame(frame);
+        //_delegates_read能确保是单线程操作的，使用连续内存遍历
+        for(auto &delegate : _delegates_read){
+            delegate->inputFrame(frame);
         }
     }
 
@@ -666,7 +774,7 @@ public:
     }
 private:
     mutex _mtx;
-    map<void *,FrameWriterInterface::Ptr>  _delegates_read;
+    vector<FrameWriterInterface::Ptr>  _delegates_read;
     map<void *,FrameWriterInterface::Ptr>  _delegates_write;
     bool _need_update = false;
 };
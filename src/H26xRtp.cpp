@@ -0,0 +1,358 @@
+#include "H26xRtp.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "util.h"
+
+namespace mediakit{
+
+//RFC 6184
+#define H264_TYPE(v) ((v) & 0x1F)
+#define H264_STAP_A 24
+#define H264_FU_A 28
+//RFC 7798
+#define H265_TYPE(v) (((v) >> 1) & 0x3F)
+#define H265_AP 48
+#define H265_FU 49
+
+//分片头中的起始与结束标志
+#define FU_START 0x80
+#define FU_END 0x40
+
+static const char s_start_code[] = {0x00, 0x00, 0x00, 0x01};
+
+H26xRtpDecoder::H26xRtpDecoder(CodecId codec, int max_frame_size) {
+    _codec = codec;
+    _max_frame_size = max_frame_size;
+    obtainFrame();
+}
+
+CodecId H26xRtpDecoder::getCodecId() const {
+    return _codec;
+}
+
+void H26xRtpDecoder::setCodecId(CodecId codec) {
+    if (_codec == codec) {
+        return;
+    }
+    _codec = codec;
+    obtainFrame();
+    syncMemory();
+}
+
+void H26xRtpDecoder::setFrameWriter(const FrameWriterInterface::Ptr &writer) {
+    _writer = writer;
+}
+
+void H26xRtpDecoder::setMemoryAccount(const MemoryAccount::Ptr &account) {
+    if (_account) {
+        _account->release(_charged);
+    }
+    _account = account;
+    _charged = 0;
+    syncMemory();
+}
+
+uint64_t H26xRtpDecoder::dropFrame() {
+    uint64_t bytes = _frame->_buffer.size();
+    if (!bytes) {
+        return 0;
+    }
+    _drop_flag = true;
+    discardFrame();
+    syncMemory();
+    return bytes;
+}
+
+void H26xRtpDecoder::syncMemory() {
+    if (!_account) {
+        return;
+    }
+    uint64_t size = _frame->_buffer.size();
+    if (size > _charged) {
+        _account->charge(size - _charged);
+    } else if (size < _charged) {
+        _account->release(_charged - size);
+    }
+    _charged = size;
+}
+
+void H26xRtpDecoder::obtainFrame() {
+    _frame = ResourcePoolHelper<H26xFrame>::obtainObj();
+    _frame->_buffer.clear();
+    _size_predictor.prepare(_frame->_buffer);
+    _frame->_nals.clear();
+    _frame->_key_frame = false;
+    _frame->_config_frame = false;
+    _frame->_prefix_size = sizeof(s_start_code);
+    _frame->_dts = 0;
+    _frame->_pts = 0;
+    _frame->_codec_id = _codec;
+    _frame->_arrival = FrameArrival();
+    _in_fu = false;
+}
+
+void H26xRtpDecoder::discardFrame() {
+    //保留时间戳，同一帧后续的包不会被当作新的一帧，直到下一个时间戳或marker位
+    _frame->_buffer.clear();
+    _frame->_nals.clear();
+    _frame->_key_frame = false;
+    _frame->_config_frame = false;
+    _frame->_arrival = FrameArrival();
+    _in_fu = false;
+}
+
+void H26xRtpDecoder::outputFrame() {
+    if (_in_fu) {
+        //缺少结束分片，丢弃不完整的nalu
+        _frame->_buffer.erase(_nal_offset - sizeof(s_start_code));
+    }
+    if (!_frame->_nals.empty() && _writer) {
+        TraceSpan("writeFrame");
+        _size_predictor.update(_frame->_buffer.size());
+        _writer->inputFrame(_frame);
+    }
+    obtainFrame();
+}
+
+bool H26xRtpDecoder::inputRtp(const RtpPacket::Ptr &rtp) {
+    auto payload = (const uint8_t *) rtp->data() + rtp->offset;
+    int size = (int) rtp->size() - (int) rtp->offset;
+    if (size <= 0) {
+        //无实际负载
+        return false;
+    }
+
+    bool lost = _has_seq && (uint16_t) (_last_seq + 1) != rtp->sequence;
+    if (lost) {
+        PrintW("rtp丢包:%d -> %d", _last_seq, rtp->sequence);
+    }
+    _has_seq = true;
+    _last_seq = rtp->sequence;
+
+    if (_frame->_dts != rtp->timeStamp) {
+        //新的一帧，上一帧缺少marker位；丢包时上一帧的结尾可能丢失，不输出
+        if (!_frame->_buffer.empty()) {
+            if (lost) {
+                obtainFrame();
+            } else {
+                outputFrame();
+            }
+        }
+        _frame->_dts = rtp->timeStamp;
+        _drop_flag = false;
+    } else if (lost) {
+        //帧内丢包，整帧废弃
+        _drop_flag = true;
+        discardFrame();
+    }
+
+    if (!_drop_flag) {
+        _frame->_arrival.mark(rtp->arrival_us);
+        if (_codec == CodecH265) {
+            inputH265(payload, size);
+        } else {
+            inputH264(payload, size);
+        }
+        if (_frame->_buffer.size() > (size_t) _max_frame_size) {
+            PrintW("帧太大，丢弃:%u", (uint32_t) _frame->_buffer.size());
+            _drop_flag = true;
+            discardFrame();
+        }
+    }
+
+    if (rtp->mark) {
+        //帧结束
+        if (_drop_flag) {
+            obtainFrame();
+        } else {
+            outputFrame();
+        }
+        _drop_flag = false;
+    }
+    syncMemory();
+    return false;
+}
+
+void H26xRtpDecoder::flushFrame() {
+    if (_drop_flag || _frame->_buffer.empty()) {
+        obtainFrame();
+    } else {
+        outputFrame();
+    }
+    _drop_flag = false;
+    syncMemory();
+}
+
+void H26xRtpDecoder::saveState(CheckpointWriter &writer) const {
+    writer.write(_drop_flag);
+    writer.write(_in_fu);
+    writer.write(_has_seq);
+    writer.write(_last_seq);
+    writer.write(_nal_offset);
+    writer.write(_frame->_key_frame);
+    writer.write(_frame->_config_frame);
+    writer.writeBytes((const char *) _frame->_nals.data(), _frame->_nals.size() * sizeof(H26xFrame::Nal));
+    Checkpoint::saveFrame(writer, *_frame);
+}
+
+bool H26xRtpDecoder::loadState(CheckpointReader &reader) {
+    obtainFrame();
+    const char *nals;
+    uint32_t size;
+    if (!reader.read(_drop_flag) || !reader.read(_in_fu) || !reader.read(_has_seq) || !reader.read(_last_seq)
+        || !reader.read(_nal_offset) || !reader.read(_frame->_key_frame) || !reader.read(_frame->_config_frame)
+        || !reader.readBytes(nals, size) || size % sizeof(H26xFrame::Nal) || !Checkpoint::loadFrame(reader, *_frame)) {
+        return false;
+    }
+    _frame->_nals.resize(size / sizeof(H26xFrame::Nal));
+    if (size) {
+        memcpy(_frame->_nals.data(), nals, size);
+    }
+    syncMemory();
+    return true;
+}
+
+void H26xRtpDecoder::inputH264(const uint8_t *payload, uint32_t size) {
+    auto type = H264_TYPE(payload[0]);
+    if (type >= 1 && type <= 23) {
+        inputNal(payload, size);
+        return;
+    }
+    switch (type) {
+        case H264_STAP_A: {
+            //每个nalu前为2字节长度
+            uint32_t pos = 1;
+            while (pos + 2 <= size) {
+                uint32_t len = AV_RB16(payload + pos);
+                pos += 2;
+                if (!len || pos + len > size) {
+                    PrintW("非法的STAP-A包:%u", size);
+                    break;
+                }
+                inputNal(payload + pos, len);
+                pos += len;
+            }
+            break;
+        }
+        case H264_FU_A: {
+            if (size < 3) {
+                return;
+            }
+            auto fu = payload[1];
+            if (fu & FU_START) {
+                if (_in_fu) {
+                    //上一个nalu缺少结束分片
+                    _frame->_buffer.erase(_nal_offset - sizeof(s_start_code));
+                }
+                //由FU indicator的F/NRI与FU header的类型还原nalu头
+                uint8_t header = (payload[0] & 0xE0) | H264_TYPE(fu);
+                beginNal(&header, 1);
+                _in_fu = true;
+            } else if (!_in_fu) {
+                //缺少起始分片
+                return;
+            }
+            _frame->_buffer.append((const char *) payload + 2, size - 2);
+            if (fu & FU_END) {
+                endNal();
+            }
+            break;
+        }
+        default:
+            PrintT("不支持的h264 rtp包类型:%d", type);
+            break;
+    }
+}
+
+void H26xRtpDecoder::inputH265(const uint8_t *payload, uint32_t size) {
+    if (size < 2) {
+        return;
+    }
+    auto type = H265_TYPE(payload[0]);
+    if (type < H265_AP) {
+        inputNal(payload, size);
+        return;
+    }
+    switch (type) {
+        case H265_AP: {
+            //不支持DONL，每个nalu前为2字节长度
+            uint32_t pos = 2;
+            while (pos + 2 <= size) {
+                uint32_t len = AV_RB16(payload + pos);
+                pos += 2;
+                if (len < 2 || pos + len > size) {
+                    PrintW("非法的h265 AP包:%u", size);
+                    break;
+                }
+                inputNal(payload + pos, len);
+                pos += len;
+            }
+            break;
+        }
+        case H265_FU: {
+            if (size < 4) {
+                return;
+            }
+            auto fu = payload[2];
+            if (fu & FU_START) {
+                if (_in_fu) {
+                    _frame->_buffer.erase(_nal_offset - sizeof(s_start_code));
+                }
+                //payload header中的类型替换为FU header中的类型
+                uint8_t header[2];
+                header[0] = (payload[0] & 0x81) | ((fu & 0x3F) << 1);
+                header[1] = payload[1];
+                beginNal(header, 2);
+                _in_fu = true;
+            } else if (!_in_fu) {
+                return;
+            }
+            _frame->_buffer.append((const char *) payload + 3, size - 3);
+            if (fu & FU_END) {
+                endNal();
+            }
+            break;
+        }
+        default:
+            PrintT("不支持的h265 rtp包类型:%d", type);
+            break;
+    }
+}
+
+void H26xRtpDecoder::beginNal(const uint8_t *header, uint32_t header_size) {
+    _frame->_buffer.append(s_start_code, sizeof(s_start_code));
+    _nal_offset = _frame->_buffer.size();
+    _frame->_buffer.append((const char *) header, header_size);
+}
+
+void H26xRtpDecoder::endNal() {
+    _in_fu = false;
+    H26xFrame::Nal nal;
+    nal.offset = _nal_offset;
+    nal.size = _frame->_buffer.size() - _nal_offset;
+    _frame->_nals.emplace_back(nal);
+
+    auto header = (uint8_t) _frame->_buffer.data()[_nal_offset];
+    if (_codec == CodecH265) {
+        auto type = H265_TYPE(header);
+        //IRAP
+        _frame->_key_frame |= type >= 16 && type <= 21;
+        //VPS/SPS/PPS
+        _frame->_config_frame |= type >= 32 && type <= 34;
+    } else {
+        auto type = H264_TYPE(header);
+        _frame->_key_frame |= type == 5;
+        //SPS/PPS
+        _frame->_config_frame |= type == 7 || type == 8;
+    }
+}
+
+void H26xRtpDecoder::inputNal(const uint8_t *nal, uint32_t size) {
+    if (_in_fu) {
+        _frame->_buffer.erase(_nal_offset - sizeof(s_start_code));
+    }
+    beginNal(nal, size);
+    endNal();
+}
+
+}//namespace mediakit
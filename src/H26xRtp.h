@@ -0,0 +1,142 @@
+#ifndef RTP2PS_H26XRTP_H
+#define RTP2PS_H26XRTP_H
+
+#include <vector>
+#include "Frame.h"
+#include "MemoryBudget.h"
+#include "Checkpoint.h"
+
+namespace mediakit{
+
+/**
+ * h264/h265访问单元，Annex-B格式，每个nalu前为4字节起始码
+ * 同时记录每个nalu在缓存中的位置，使用者不需要再次搜索起始码即可按nalu切分
+ */
+class H26xFrame : public FrameImp {
+public:
+    typedef std::shared_ptr<H26xFrame> Ptr;
+
+    struct Nal {
+        //nalu头在缓存中的偏移，不含起始码
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    bool keyFrame() const override {
+        return _key_frame;
+    }
+
+    bool configFrame() const override {
+        return _config_frame;
+    }
+
+public:
+    //帧对象循环使用，vector的容量也被复用
+    std::vector<Nal> _nals;
+    bool _key_frame = false;
+    bool _config_frame = false;
+};
+
+/**
+ * h264(RFC 6184)/h265(RFC 7798) rtp解码类
+ * 支持单nalu包、FU-A/FU分片与STAP-A/AP聚合包，分片直接拼接到帧缓存中，
+ * 帧对象与其缓存来自循环池，解码过程中没有按nalu的内存分配；
+ * marker位或时间戳变化时输出一帧，帧内丢包时丢弃整帧
+ */
+class H26xRtpDecoder : public ResourcePoolHelper<H26xFrame> {
+public:
+    typedef std::shared_ptr<H26xRtpDecoder> Ptr;
+
+    /**
+     * @param codec CodecH264或CodecH265
+     * @param max_frame_size 允许的最大帧大小
+     */
+    H26xRtpDecoder(CodecId codec, int max_frame_size = 2 * 1024 * 1024);
+    ~H26xRtpDecoder() override {}
+
+    CodecId getCodecId() const;
+
+    /**
+     * 修改编码类型，未完成的帧被丢弃
+     */
+    void setCodecId(CodecId codec);
+
+    void setFrameWriter(const FrameWriterInterface::Ptr &writer);
+
+    /**
+     * 设置内存账户，未完成帧占用的内存记在该账户上
+     */
+    void setMemoryAccount(const MemoryAccount::Ptr &account);
+
+    /**
+     * 丢弃未完成的帧，该帧后续的rtp包也会被丢弃
+     * @return 释放的字节数
+     */
+    uint64_t dropFrame();
+
+    /**
+     * 输入rtp并解码
+     */
+    bool inputRtp(const RtpPacket::Ptr &rtp);
+
+    /**
+     * 输出缺少marker位的未完成帧，输入结束或者空闲超时时调用；帧内丢包时丢弃
+     */
+    void flushFrame();
+
+    /**
+     * 保存与恢复未完成帧与分片状态，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const;
+    bool loadState(CheckpointReader &reader);
+
+private:
+    void obtainFrame();
+    void outputFrame();
+
+    /**
+     * 清空未完成帧的数据，保留其时间戳
+     */
+    void discardFrame();
+    void syncMemory();
+
+    void inputH264(const uint8_t *payload, uint32_t size);
+    void inputH265(const uint8_t *payload, uint32_t size);
+
+    /**
+     * 开始一个nalu，写入起始码与nalu头
+     */
+    void beginNal(const uint8_t *header, uint32_t header_size);
+
+    /**
+     * 结束当前nalu，记录其位置与类型
+     */
+    void endNal();
+
+    /**
+     * 输入完整的nalu
+     */
+    void inputNal(const uint8_t *nal, uint32_t size);
+
+private:
+    CodecId _codec;
+    int _max_frame_size;
+    //当前帧丢包，丢弃到下一帧
+    bool _drop_flag = false;
+    //正在接收分片
+    bool _in_fu = false;
+    bool _has_seq = false;
+    uint16_t _last_seq = 0;
+    //当前nalu在缓存中的起始位置
+    uint32_t _nal_offset = 0;
+    H26xFrame::Ptr _frame;
+    //按近期帧大小预先申请帧缓存
+    FrameSizePredictor _size_predictor;
+    FrameWriterInterface::Ptr _writer;
+    MemoryAccount::Ptr _account;
+    //已记账的未完成帧字节数
+    uint64_t _charged = 0;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_H26XRTP_H
@@ -0,0 +1,162 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <atomic>
+#include "HugePage.h"
+#include "Logger.h"
+
+using namespace std;
+
+namespace mediakit{
+
+static atomic<bool> s_enabled{false};
+//抓包文件拷贝到大页内存的大小上限
+static atomic<uint64_t> s_copy_limit{1024 * 1024 * 1024ULL};
+
+static inline size_t alignUp(size_t size) {
+    return (size + HugePage::kPageSize - 1) & ~(HugePage::kPageSize - 1);
+}
+
+void HugePage::setEnabled(bool enabled) {
+    s_enabled = enabled;
+}
+
+bool HugePage::isEnabled() {
+    return s_enabled.load(memory_order_relaxed);
+}
+
+void HugePage::setCopyLimit(uint64_t bytes) {
+    s_copy_limit = bytes;
+}
+
+uint64_t HugePage::getCopyLimit() {
+    return s_copy_limit.load(memory_order_relaxed);
+}
+
+void *HugePage::mapFile(int fd, size_t size) {
+    //先预留多一个大页的地址空间，再把文件映射到其中2MB对齐的位置
+    auto raw = (char *) mmap(nullptr, size + kPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    auto aligned = (char *) (((uintptr_t) raw + kPageSize - 1) & ~(uintptr_t) (kPageSize - 1));
+    auto ptr = mmap(aligned, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        munmap(raw, size + kPageSize);
+        return nullptr;
+    }
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    auto page = (size_t) sysconf(_SC_PAGESIZE);
+    auto end = aligned + ((size + page - 1) & ~(page - 1));
+    if (raw + size + kPageSize > end) {
+        munmap(end, raw + size + kPageSize - end);
+    }
+    advise(aligned, size);
+    madvise(aligned, size, MADV_SEQUENTIAL);
+    return aligned;
+}
+
+uint64_t HugePage::getAvailableMemory() {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) {
+        return 0;
+    }
+    uint64_t bytes = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long long kb;
+        if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) {
+            bytes = kb * 1024;
+            break;
+        }
+    }
+    fclose(fp);
+    return bytes;
+}
+
+void *HugePage::map(size_t size, bool *hugetlb) {
+    size = alignUp(size);
+    auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+        if (hugetlb) {
+            *hugetlb = true;
+        }
+        return ptr;
+    }
+    if (hugetlb) {
+        *hugetlb = false;
+    }
+
+    //没有预留大页，多映射一个大页用于对齐，透明大页要求2MB对齐
+    auto raw = (char *) mmap(nullptr, size + kPageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    auto aligned = (char *) (((uintptr_t) raw + kPageSize - 1) & ~(uintptr_t) (kPageSize - 1));
+    if (aligned > raw) {
+        munmap(raw, aligned - raw);
+    }
+    auto tail = (raw + size + kPageSize) - (aligned + size);
+    if (tail > 0) {
+        munmap(aligned + size, tail);
+    }
+    advise(aligned, size);
+    return aligned;
+}
+
+void HugePage::unmap(void *ptr, size_t size) {
+    if (ptr) {
+        munmap(ptr, alignUp(size));
+    }
+}
+
+bool HugePage::advise(void *ptr, size_t size) {
+#if defined(MADV_HUGEPAGE)
+    if (madvise(ptr, size, MADV_HUGEPAGE) == 0) {
+        return true;
+    }
+    PrintW("madvise(MADV_HUGEPAGE)失败:%s", strerror(errno));
+#endif
+    return false;
+}
+
+uint64_t HugePage::getHugeBytes(const void *ptr) {
+    //smaps_rollup为整个进程的汇总
+    FILE *fp = fopen(ptr ? "/proc/self/smaps" : "/proc/self/smaps_rollup", "r");
+    if (!fp) {
+        return 0;
+    }
+    static const char *kHugeKeys[] = {"AnonHugePages:", "ShmemPmdMapped:", "FilePmdMapped:", "Shared_Hugetlb:", "Private_Hugetlb:"};
+    uint64_t bytes = 0;
+    bool matched = !ptr;
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long start, end;
+        if (ptr && sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, '-') < strchr(line, ' ')) {
+            //新的映射区间
+            if (matched) {
+                break;
+            }
+            matched = (uintptr_t) ptr >= start && (uintptr_t) ptr < end;
+            continue;
+        }
+        if (!matched) {
+            continue;
+        }
+        for (auto key : kHugeKeys) {
+            auto len = strlen(key);
+            if (strncmp(line, key, len) == 0) {
+                bytes += strtoull(line + len, nullptr, 10) * 1024;
+            }
+        }
+    }
+    fclose(fp);
+    return bytes;
+}
+
+}//namespace mediakit
@@ -0,0 +1,68 @@
+#ifndef RTP2PS_HUGEPAGE_H
+#define RTP2PS_HUGEPAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mediakit{
+
+/**
+ * 大页内存
+ * 优先使用MAP_HUGETLB(需要预留hugetlbfs大页)，失败时退化为按2MB对齐的普通映射并设置MADV_HUGEPAGE，
+ * 由内核尽量使用透明大页；实际是否拿到大页可以通过getHugeBytes()查询
+ */
+class HugePage {
+public:
+    //大页大小
+    static const size_t kPageSize = 2 * 1024 * 1024;
+
+    /**
+     * 设置是否启用大页，影响抓包文件映射与slab分配器
+     */
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    /**
+     * 设置抓包文件拷贝到大页内存的大小上限，超过时直接映射文件
+     */
+    static void setCopyLimit(uint64_t bytes);
+    static uint64_t getCopyLimit();
+
+    /**
+     * 按大页对齐只读映射文件并设置MADV_HUGEPAGE，内核支持文件透明大页时页缓存可以按大页映射
+     * @return 失败返回nullptr，使用munmap(ptr, size)释放
+     */
+    static void *mapFile(int fd, size_t size);
+
+    /**
+     * 系统可用内存(/proc/meminfo的MemAvailable)，未知时返回0
+     */
+    static uint64_t getAvailableMemory();
+
+    /**
+     * 映射匿名内存，大小按大页对齐
+     * @param size 映射大小
+     * @param hugetlb 返回是否使用了MAP_HUGETLB，可以为nullptr
+     * @return 失败返回nullptr
+     */
+    static void *map(size_t size, bool *hugetlb = nullptr);
+
+    /**
+     * 释放map()映射的内存
+     */
+    static void unmap(void *ptr, size_t size);
+
+    /**
+     * 对已有映射设置MADV_HUGEPAGE
+     */
+    static bool advise(void *ptr, size_t size);
+
+    /**
+     * 查询实际使用的大页字节数(透明大页 + hugetlb)
+     * @param ptr 映射中的任意地址，为nullptr时返回整个进程的统计
+     */
+    static uint64_t getHugeBytes(const void *ptr = nullptr);
+};
+
+}//namespace mediakit
+#endif //RTP2PS_HUGEPAGE_H
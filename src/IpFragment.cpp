@@ -0,0 +1,198 @@
+#include <string.h>
+#include "IpFragment.h"
+#include "util.h"
+
+#define IP_FLAG_MF 0x2000
+#define IP_OFFSET_MASK 0x1FFF
+
+namespace mediakit{
+
+IpFragmentTable::IpFragmentTable(int slots, uint32_t max_bytes, uint32_t timeout_ms) {
+    _max_bytes = max_bytes;
+    _timeout_us = timeout_ms * 1000ULL;
+    _slots.resize(slots);
+    _pool.setSize(slots);
+}
+
+const IpFragmentTable::Stats &IpFragmentTable::getStats() const {
+    return _stats;
+}
+
+bool IpFragmentTable::hasPending() const {
+    for (auto &slot : _slots) {
+        if (slot.used) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool IpFragmentTable::isFragment(const char *ip) {
+    return AV_RB16(ip + 6) & (IP_FLAG_MF | IP_OFFSET_MASK);
+}
+
+void IpFragmentTable::release(Slot &slot) {
+    slot.used = false;
+    slot.buffer = nullptr;
+    _used_bytes -= kMaxDatagram;
+    if (_account) {
+        _account->release(kMaxDatagram);
+    }
+}
+
+void IpFragmentTable::expire(uint64_t now_us) {
+    if (now_us - _last_expire_us < _timeout_us / 4) {
+        return;
+    }
+    _last_expire_us = now_us;
+    for (auto &slot : _slots) {
+        if (slot.used && now_us - slot.first_us > _timeout_us) {
+            ++_stats.timeouts;
+            release(slot);
+        }
+    }
+}
+
+IpFragmentTable::Slot *IpFragmentTable::findSlot(const char *ip, uint64_t now_us) {
+    uint32_t src_ip, dst_ip;
+    memcpy(&src_ip, ip + 12, 4);
+    memcpy(&dst_ip, ip + 16, 4);
+    uint16_t id = AV_RB16(ip + 4);
+    uint8_t protocol = ip[9];
+
+    Slot *free_slot = nullptr;
+    Slot *oldest = nullptr;
+    for (auto &slot : _slots) {
+        if (!slot.used) {
+            if (!free_slot) {
+                free_slot = &slot;
+            }
+            continue;
+        }
+        if (slot.id == id && slot.src_ip == src_ip && slot.dst_ip == dst_ip && slot.protocol == protocol) {
+            return &slot;
+        }
+        if (!oldest || slot.first_us < oldest->first_us) {
+            oldest = &slot;
+        }
+    }
+
+    if (!free_slot || _used_bytes + kMaxDatagram > _max_bytes) {
+        //槽位或内存不足，淘汰最早的重组
+        if (!oldest) {
+            return nullptr;
+        }
+        ++_stats.evictions;
+        release(*oldest);
+        free_slot = oldest;
+    }
+
+    auto &slot = *free_slot;
+    slot.used = true;
+    slot.src_ip = src_ip;
+    slot.dst_ip = dst_ip;
+    slot.id = id;
+    slot.protocol = protocol;
+    slot.first_us = now_us;
+    slot.header_len = 0;
+    slot.total = 0;
+    slot.blocks = 0;
+    memset(slot.bitmap, 0, sizeof(slot.bitmap));
+    slot.buffer = _pool.obtain();
+    slot.buffer->setCapacity(kMaxDatagram);
+    _used_bytes += kMaxDatagram;
+    if (_account) {
+        _account->charge(kMaxDatagram);
+    }
+    return &slot;
+}
+
+void IpFragmentTable::setOnDatagram(onDatagram cb) {
+    _cb = std::move(cb);
+}
+
+void IpFragmentTable::setMemoryAccount(const MemoryAccount::Ptr &account) {
+    if (_account) {
+        _account->release(_used_bytes);
+    }
+    _account = account;
+    if (_account) {
+        _account->charge(_used_bytes);
+    }
+}
+
+void IpFragmentTable::input(const char *ip, uint32_t len, uint64_t now_us) {
+    ++_stats.fragments;
+    expire(now_us);
+
+    uint32_t ihl = (ip[0] & 0x0F) * 4;
+    uint16_t frag = AV_RB16(ip + 6);
+    uint32_t offset = (frag & IP_OFFSET_MASK) * 8;
+    bool more = frag & IP_FLAG_MF;
+    if (len <= ihl || offset + len - ihl > 0xFFFF || (more && (len - ihl) % 8)) {
+        //非最后一个分片的负载必须是8字节对齐的
+        ++_stats.invalid;
+        return;
+    }
+    uint32_t payload_len = len - ihl;
+
+    auto slot = findSlot(ip, now_us);
+    if (!slot) {
+        ++_stats.invalid;
+        return;
+    }
+
+    if (!more) {
+        slot->total = offset + payload_len;
+    }
+    if (offset == 0) {
+        //保留首个分片的ip首部
+        slot->header_len = ihl;
+        memcpy(slot->buffer->data(), ip, ihl);
+    }
+    //负载统一从最大首部长度之后开始存放，完成时再与首部拼接
+    memcpy(slot->buffer->data() + 60 + offset, ip + ihl, payload_len);
+
+    uint32_t first = offset / 8;
+    uint32_t last = (offset + payload_len + 7) / 8;
+    for (uint32_t i = first; i < last; ++i) {
+        auto &word = slot->bitmap[i / 64];
+        uint64_t bit = 1ULL << (i % 64);
+        if (!(word & bit)) {
+            word |= bit;
+            ++slot->blocks;
+        }
+    }
+
+    if (!slot->total || !slot->header_len || slot->blocks != (slot->total + 7) / 8) {
+        //还未收齐
+        return;
+    }
+
+    auto header_len = slot->header_len;
+    auto total = slot->total;
+    if (header_len + total > 0xFFFF) {
+        //超过ip包最大长度
+        ++_stats.invalid;
+        release(*slot);
+        return;
+    }
+
+    //首部移动到负载之前，清除分片标志并修正总长度
+    auto buffer = slot->buffer;
+    auto data = buffer->data() + 60 - header_len;
+    memmove(data, buffer->data(), header_len);
+    data[2] = (header_len + total) >> 8;
+    data[3] = (header_len + total) & 0xFF;
+    data[6] = 0;
+    data[7] = 0;
+    ++_stats.reassembled;
+    release(*slot);
+
+    if (_cb) {
+        //回调结束后buffer回到循环池
+        _cb(data, header_len + total);
+    }
+}
+
+}//namespace mediakit
@@ -0,0 +1,111 @@
+#ifndef RTP2PS_IPFRAGMENT_H
+#define RTP2PS_IPFRAGMENT_H
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "Frame.h"
+#include "ResourcePool.h"
+#include "MemoryBudget.h"
+
+namespace mediakit{
+
+/**
+ * ipv4分片重组表
+ * 重组槽位在构造时预先分配，重组缓存来自循环池，输入分片时不会开辟内存；
+ * 超时、槽位不足或者超过内存上限时淘汰最早的未完成重组
+ */
+class IpFragmentTable {
+public:
+    typedef std::function<void(char *ip, uint32_t len)> onDatagram;
+
+    //ip包最大长度(首部 + 负载)
+    static const uint32_t kMaxDatagram = 60 + 0xFFFF;
+
+    struct Stats {
+        //输入的分片数
+        uint64_t fragments = 0;
+        //重组完成的ip包数
+        uint64_t reassembled = 0;
+        //超时丢弃的重组数
+        uint64_t timeouts = 0;
+        //槽位或内存不足而淘汰的重组数
+        uint64_t evictions = 0;
+        //非法分片数
+        uint64_t invalid = 0;
+    };
+
+    /**
+     * @param slots 同时进行重组的最大ip包数
+     * @param max_bytes 重组缓存占用的内存上限
+     * @param timeout_ms 重组超时时间，以抓包时间为准
+     */
+    IpFragmentTable(int slots = 64, uint32_t max_bytes = 8 * 1024 * 1024, uint32_t timeout_ms = 3000);
+    ~IpFragmentTable() = default;
+
+    /**
+     * 设置重组完成回调，输出完整的ip包(首部 + 负载，分片标志已清除)
+     */
+    void setOnDatagram(onDatagram cb);
+
+    /**
+     * 设置内存账户，重组缓存占用的内存记在该账户上
+     */
+    void setMemoryAccount(const MemoryAccount::Ptr &account);
+
+    /**
+     * 输入一个ipv4分片
+     * @param ip ip包指针(含首部)
+     * @param len ip包长度
+     * @param now_us 分片到达时间，微秒
+     */
+    void input(const char *ip, uint32_t len, uint64_t now_us);
+
+    /**
+     * 是否为分片
+     */
+    static bool isFragment(const char *ip);
+
+    const Stats &getStats() const;
+
+    /**
+     * 是否有未完成的重组
+     */
+    bool hasPending() const;
+
+private:
+    struct Slot {
+        bool used = false;
+        uint32_t src_ip = 0;
+        uint32_t dst_ip = 0;
+        uint16_t id = 0;
+        uint8_t protocol = 0;
+        uint64_t first_us = 0;
+        uint32_t header_len = 0;
+        //负载总长度，收到最后一个分片前为0
+        uint32_t total = 0;
+        //已收到的8字节块数
+        uint32_t blocks = 0;
+        //按8字节块记录的接收位图
+        uint64_t bitmap[(0xFFFF / 8 + 64) / 64];
+        BufferRaw::Ptr buffer;
+    };
+
+    Slot *findSlot(const char *ip, uint64_t now_us);
+    void release(Slot &slot);
+    void expire(uint64_t now_us);
+
+private:
+    uint32_t _max_bytes;
+    uint32_t _used_bytes = 0;
+    uint64_t _timeout_us;
+    uint64_t _last_expire_us = 0;
+    Stats _stats;
+    onDatagram _cb;
+    MemoryAccount::Ptr _account;
+    std::vector<Slot> _slots;
+    ResourcePool<BufferRaw> _pool;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_IPFRAGMENT_H
@@ -0,0 +1,87 @@
+#include "LatencyStats.h"
+#include <math.h>
+#include "Logger.h"
+
+namespace mediakit{
+
+uint32_t LatencyHistogram::bucketOf(uint64_t us) {
+    if (us < kLinear) {
+        return (uint32_t) us;
+    }
+    uint32_t msb = 63 - __builtin_clzll(us);
+    if (msb >= kMaxBits) {
+        return kBucketCount - 1;
+    }
+    //kLinear为2^6，之后每个分段取最高位之后的5位作为子区间
+    uint32_t shift = msb - 5;
+    uint32_t sub = (uint32_t) (us >> shift) - kSubBuckets;
+    return kLinear + (msb - 6) * kSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::valueOf(uint32_t bucket) {
+    if (bucket < kLinear) {
+        return bucket;
+    }
+    uint32_t index = bucket - kLinear;
+    uint32_t shift = index / kSubBuckets + 1;
+    uint64_t lower = (uint64_t) (index % kSubBuckets + kSubBuckets) << shift;
+    return lower + (1ULL << shift) / 2;
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    ++_buckets[bucketOf(us)];
+    ++_count;
+    if (us > _max) {
+        _max = us;
+    }
+}
+
+uint64_t LatencyHistogram::getQuantile(double quantile) const {
+    if (!_count) {
+        return 0;
+    }
+    auto target = (uint64_t) ceil(quantile * _count);
+    if (!target) {
+        target = 1;
+    }
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < kBucketCount; ++i) {
+        sum += _buckets[i];
+        if (sum >= target) {
+            auto value = valueOf(i);
+            return value < _max ? value : _max;
+        }
+    }
+    return _max;
+}
+
+LatencyStats::Summary LatencyStats::getSummary(Kind kind) const {
+    auto &histogram = _histograms[kind];
+    Summary summary;
+    summary.count = histogram.getCount();
+    summary.p50 = histogram.getQuantile(0.5);
+    summary.p99 = histogram.getQuantile(0.99);
+    summary.p999 = histogram.getQuantile(0.999);
+    summary.max = histogram.getMax();
+    return summary;
+}
+
+const char *LatencyStats::getName(Kind kind) {
+    switch (kind) {
+        case FirstPacketToFrame: return "首包到帧";
+        case LastPacketToFrame: return "末包到帧";
+        case FrameToSink: return "帧到输出";
+        default: return "未知";
+    }
+}
+
+void LatencyStats::report(const std::string &flow) const {
+    for (int kind = 0; kind < KindMax; ++kind) {
+        auto summary = getSummary((Kind) kind);
+        PrintI("流[%s] %s时延(us) p50:%llu, p99:%llu, p999:%llu, 最大:%llu, 帧数:%llu", flow.data(), getName((Kind) kind),
+               (unsigned long long) summary.p50, (unsigned long long) summary.p99, (unsigned long long) summary.p999,
+               (unsigned long long) summary.max, (unsigned long long) summary.count);
+    }
+}
+
+}//namespace mediakit
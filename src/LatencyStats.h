@@ -0,0 +1,96 @@
+#ifndef RTP2PS_LATENCYSTATS_H
+#define RTP2PS_LATENCYSTATS_H
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+
+namespace mediakit{
+
+/**
+ * 时延直方图，按2的幂分段、每段32个子区间(对数线性分桶)，
+ * 相对误差约3%，内存固定，记录为O(1)，用于统计p50/p99/p999
+ */
+class LatencyHistogram {
+public:
+    //小于该值的时延逐微秒计数
+    static const uint32_t kLinear = 64;
+    //每个2的幂分段的子区间个数
+    static const uint32_t kSubBuckets = 32;
+    //最大可以记录2^kMaxBits微秒，超过的记为最大值
+    static const uint32_t kMaxBits = 40;
+    static const uint32_t kBucketCount = kLinear + (kMaxBits - 6) * kSubBuckets;
+
+    void record(uint64_t us);
+
+    /**
+     * 获取分位数
+     * @param quantile 0到1之间
+     * @return 所在区间的中点，微秒，没有记录时返回0
+     */
+    uint64_t getQuantile(double quantile) const;
+
+    uint64_t getCount() const {
+        return _count;
+    }
+
+    uint64_t getMax() const {
+        return _max;
+    }
+
+private:
+    static uint32_t bucketOf(uint64_t us);
+    static uint64_t valueOf(uint32_t bucket);
+
+private:
+    uint64_t _count = 0;
+    uint64_t _max = 0;
+    uint64_t _buckets[kBucketCount] = {0};
+};
+
+/**
+ * 单个流的端到端时延统计，时间与包的到达时间使用同一时钟(离线转换为抓包时间，实时接收为接收时间)
+ * 只在流所在的线程中记录
+ */
+class LatencyStats {
+public:
+    typedef std::shared_ptr<LatencyStats> Ptr;
+
+    typedef enum {
+        //帧内最早到达的包到帧被解码器输出
+        FirstPacketToFrame = 0,
+        //帧内最晚到达的包到帧被解码器输出
+        LastPacketToFrame,
+        //帧被解码器输出到写入输出(包括交织等待与写入耗时)
+        FrameToSink,
+        KindMax
+    } Kind;
+
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t p50 = 0;
+        uint64_t p99 = 0;
+        uint64_t p999 = 0;
+        uint64_t max = 0;
+    };
+
+    void record(Kind kind, uint64_t us) {
+        _histograms[kind].record(us);
+    }
+
+    Summary getSummary(Kind kind) const;
+
+    static const char *getName(Kind kind);
+
+    /**
+     * 输出全部统计
+     * @param flow 流名
+     */
+    void report(const std::string &flow) const;
+
+private:
+    LatencyHistogram _histograms[KindMax];
+};
+
+}//namespace mediakit
+#endif //RTP2PS_LATENCYSTATS_H
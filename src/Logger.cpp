@@ -0,0 +1,46 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <mutex>
+#include <memory>
+#include "Logger.h"
+
+using namespace std;
+
+namespace mediakit{
+
+atomic<int> Logger::s_level{LInfo};
+
+static mutex s_mtx;
+static shared_ptr<Logger::onLog> s_cb;
+
+void Logger::setLevel(LogLevel level) {
+    s_level = level;
+}
+
+LogLevel Logger::getLevel() {
+    return (LogLevel) s_level.load();
+}
+
+void Logger::setOnLog(onLog cb) {
+    lock_guard<mutex> lck(s_mtx);
+    s_cb = cb ? std::make_shared<onLog>(std::move(cb)) : nullptr;
+}
+
+void Logger::print(LogLevel level, const char *file, int line, const char *fmt, ...) {
+    shared_ptr<onLog> cb;
+    {
+        lock_guard<mutex> lck(s_mtx);
+        cb = s_cb;
+    }
+    if (!cb) {
+        return;
+    }
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    (*cb)(level, file, line, buf);
+}
+
+}//namespace mediakit
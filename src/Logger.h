@@ -0,0 +1,66 @@
+#ifndef RTP2PS_LOGGER_H
+#define RTP2PS_LOGGER_H
+
+#include <atomic>
+#include <functional>
+
+namespace mediakit{
+
+typedef enum {
+    LTrace = 0,
+    LDebug,
+    LInfo,
+    LWarn,
+    LError,
+} LogLevel;
+
+/**
+ * 日志
+ * 库内部不直接输出到标准输出，日志交给使用者设置的回调，未设置回调时丢弃；
+ * 低于日志等级的日志在格式化之前就被过滤，热路径上的跟踪日志只有一次比较的开销
+ */
+class Logger {
+public:
+    /**
+     * 日志回调
+     * @param level 日志等级
+     * @param file 源文件
+     * @param line 行号
+     * @param msg 日志内容，不含换行
+     */
+    typedef std::function<void(LogLevel level, const char *file, int line, const char *msg)> onLog;
+
+    static void setLevel(LogLevel level);
+    static LogLevel getLevel();
+
+    static bool isEnabled(LogLevel level) {
+        return level >= s_level.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * 设置日志回调，传入nullptr时关闭日志
+     */
+    static void setOnLog(onLog cb);
+
+    static void print(LogLevel level, const char *file, int line, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+private:
+    static std::atomic<int> s_level;
+};
+
+}//namespace mediakit
+
+#define PrintLog(level, ...) \
+    do { \
+        if (mediakit::Logger::isEnabled(level)) { \
+            mediakit::Logger::print(level, __FILE__, __LINE__, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define PrintT(...) PrintLog(mediakit::LTrace, ##__VA_ARGS__)
+#define PrintD(...) PrintLog(mediakit::LDebug, ##__VA_ARGS__)
+#define PrintI(...) PrintLog(mediakit::LInfo, ##__VA_ARGS__)
+#define PrintW(...) PrintLog(mediakit::LWarn, ##__VA_ARGS__)
+#define PrintE(...) PrintLog(mediakit::LError, ##__VA_ARGS__)
+
+#endif //RTP2PS_LOGGER_H
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <algorithm>
+#include "MemoryBudget.h"
+#include "Logger.h"
+#include "SlabAllocator.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//超过上限后回收到上限的80%
+#define LOW_WATERMARK(limit) ((limit) / 10 * 8)
+//超过上限的90%时限速读取
+#define HIGH_WATERMARK(limit) ((limit) / 10 * 9)
+
+//防止回收回调中再次触发回收
+static thread_local bool s_reclaiming = false;
+
+static inline void updatePeak(atomic<uint64_t> &peak, uint64_t value) {
+    auto old = peak.load(memory_order_relaxed);
+    while (value > old && !peak.compare_exchange_weak(old, value, memory_order_relaxed)) {
+    }
+}
+
+////////////MemoryAccount////////////
+
+MemoryAccount::MemoryAccount(const string &name) : _name(name), _owner(this_thread::get_id()) {
+    MemoryBudget::Instance().addAccount(this);
+}
+
+MemoryAccount::~MemoryAccount() {
+    MemoryBudget::Instance().removeAccount(this);
+    MemoryBudget::Instance().release(_used.load());
+}
+
+void MemoryAccount::setName(const string &name) {
+    lock_guard<mutex> lck(_mtx);
+    _name = name;
+}
+
+string MemoryAccount::getName() const {
+    lock_guard<mutex> lck(_mtx);
+    return _name;
+}
+
+void MemoryAccount::setOnEvict(onEvict cb) {
+    lock_guard<mutex> lck(_mtx);
+    _cb = std::move(cb);
+}
+
+bool MemoryAccount::charge(uint64_t bytes) {
+    if (!bytes) {
+        return true;
+    }
+    updatePeak(_peak, _used.fetch_add(bytes, memory_order_relaxed) + bytes);
+    auto &budget = MemoryBudget::Instance();
+    budget.charge(bytes);
+    return !budget.isOver();
+}
+
+void MemoryAccount::release(uint64_t bytes) {
+    if (!bytes) {
+        return;
+    }
+    _used.fetch_sub(bytes, memory_order_relaxed);
+    MemoryBudget::Instance().release(bytes);
+}
+
+void MemoryAccount::touch(uint64_t now_us) {
+    _last_active_us.store(now_us, memory_order_relaxed);
+}
+
+uint64_t MemoryAccount::getLastActive() const {
+    return _last_active_us.load(memory_order_relaxed);
+}
+
+MemoryAccount::Stats MemoryAccount::getStats() const {
+    Stats stats;
+    stats.used = _used.load(memory_order_relaxed);
+    stats.peak = _peak.load(memory_order_relaxed);
+    stats.evictions = _evictions.load(memory_order_relaxed);
+    stats.evicted_bytes = _evicted_bytes.load(memory_order_relaxed);
+    return stats;
+}
+
+uint64_t MemoryAccount::evict(EvictLevel level) {
+    onEvict cb;
+    {
+        lock_guard<mutex> lck(_mtx);
+        cb = _cb;
+    }
+    if (!cb) {
+        return 0;
+    }
+    auto freed = cb(level);
+    if (freed) {
+        _evictions.fetch_add(1, memory_order_relaxed);
+        _evicted_bytes.fetch_add(freed, memory_order_relaxed);
+    }
+    return freed;
+}
+
+////////////MemoryBudget////////////
+
+MemoryBudget &MemoryBudget::Instance() {
+    static MemoryBudget instance;
+    return instance;
+}
+
+void MemoryBudget::setLimit(uint64_t bytes) {
+    _limit = bytes;
+}
+
+uint64_t MemoryBudget::getLimit() const {
+    return _limit.load(memory_order_relaxed);
+}
+
+uint64_t MemoryBudget::getUsed() const {
+    return _used.load(memory_order_relaxed);
+}
+
+bool MemoryBudget::isOver() const {
+    auto limit = getLimit();
+    return limit && getUsed() > limit;
+}
+
+bool MemoryBudget::isThrottle() {
+    auto limit = getLimit();
+    if (!limit || getUsed() <= HIGH_WATERMARK(limit)) {
+        return false;
+    }
+    _throttles.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+bool MemoryBudget::reclaim() {
+    auto limit = getLimit();
+    if (!limit) {
+        return true;
+    }
+    if (s_reclaiming) {
+        //回收中，回收结束后再判断
+        return true;
+    }
+    s_reclaiming = true;
+    _reclaims.fetch_add(1, memory_order_relaxed);
+
+    //只回收本线程的账户，账户只会在创建它的线程中销毁，
+    //因此在锁内挑出候选后即可释放锁，回收回调执行期间不阻塞其他线程的账户登记与统计
+    vector<MemoryAccount *> accounts;
+    {
+        lock_guard<mutex> lck(_mtx);
+        auto self = this_thread::get_id();
+        for (auto account : _accounts) {
+            if (account->_owner == self) {
+                accounts.emplace_back(account);
+            }
+        }
+    }
+
+    auto low = LOW_WATERMARK(limit);
+    for (int level = 0; level < MemoryAccount::EvictLevelMax && getUsed() > low; ++level) {
+        if (level == MemoryAccount::EvictSortBuffer) {
+            //最久未活跃的流的排序缓存最旧
+            sort(accounts.begin(), accounts.end(), [](MemoryAccount *a, MemoryAccount *b) {
+                return a->getLastActive() < b->getLastActive();
+            });
+        } else {
+            //优先丢弃占用最大的流
+            sort(accounts.begin(), accounts.end(), [](MemoryAccount *a, MemoryAccount *b) {
+                return a->_used.load(memory_order_relaxed) > b->_used.load(memory_order_relaxed);
+            });
+        }
+        for (auto account : accounts) {
+            if (getUsed() <= low) {
+                break;
+            }
+            if (!hasAccount(account)) {
+                //已在之前的回收回调中被销毁
+                continue;
+            }
+            account->evict((MemoryAccount::EvictLevel) level);
+        }
+    }
+
+    s_reclaiming = false;
+    //空闲的大帧缓存不计入预算，但仍占用物理内存
+    SlabAllocator::trim();
+    if (getUsed() > limit) {
+        _failures.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+MemoryBudget::Stats MemoryBudget::getStats() const {
+    Stats stats;
+    stats.used = getUsed();
+    stats.peak = _peak.load(memory_order_relaxed);
+    stats.limit = getLimit();
+    stats.reclaims = _reclaims.load(memory_order_relaxed);
+    stats.failures = _failures.load(memory_order_relaxed);
+    stats.throttles = _throttles.load(memory_order_relaxed);
+    return stats;
+}
+
+void MemoryBudget::report() const {
+    auto stats = getStats();
+    PrintI("内存占用:%llu, 峰值:%llu, 上限:%llu, 回收次数:%llu, 回收失败:%llu, 限速次数:%llu",
+           (unsigned long long) stats.used, (unsigned long long) stats.peak, (unsigned long long) stats.limit,
+           (unsigned long long) stats.reclaims, (unsigned long long) stats.failures, (unsigned long long) stats.throttles);
+    auto slab = SlabAllocator::getStats();
+    PrintI("大帧缓存:%llu, 命中:%llu次, 向系统申请:%llu次, 内存紧张时释放:%llu",
+           (unsigned long long) slab.large_cached, (unsigned long long) slab.large_hits,
+           (unsigned long long) slab.large, (unsigned long long) slab.trimmed);
+    lock_guard<mutex> lck(_mtx);
+    for (auto account : _accounts) {
+        auto flow = account->getStats();
+        PrintI("流[%s] 内存占用:%llu, 峰值:%llu, 被回收次数:%llu, 被回收字节数:%llu", account->getName().data(),
+               (unsigned long long) flow.used, (unsigned long long) flow.peak,
+               (unsigned long long) flow.evictions, (unsigned long long) flow.evicted_bytes);
+    }
+}
+
+void MemoryBudget::addAccount(MemoryAccount *account) {
+    lock_guard<mutex> lck(_mtx);
+    _accounts.emplace_back(account);
+}
+
+bool MemoryBudget::hasAccount(MemoryAccount *account) const {
+    lock_guard<mutex> lck(_mtx);
+    return std::find(_accounts.begin(), _accounts.end(), account) != _accounts.end();
+}
+
+void MemoryBudget::removeAccount(MemoryAccount *account) {
+    lock_guard<mutex> lck(_mtx);
+    _accounts.erase(std::remove(_accounts.begin(), _accounts.end(), account), _accounts.end());
+}
+
+void MemoryBudget::charge(uint64_t bytes) {
+    updatePeak(_peak, _used.fetch_add(bytes, memory_order_relaxed) + bytes);
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    _used.fetch_sub(bytes, memory_order_relaxed);
+}
+
+}//namespace mediakit
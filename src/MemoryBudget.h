@@ -0,0 +1,176 @@
+#ifndef RTP2PS_MEMORYBUDGET_H
+#define RTP2PS_MEMORYBUDGET_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+
+namespace mediakit{
+
+/**
+ * 单个流的内存账户
+ * 流内缓存(排序缓存、未完成的帧、tcp环形缓存、分片重组缓存)的申请与释放都记在账户上，
+ * 同时计入进程级的MemoryBudget
+ */
+class MemoryAccount {
+public:
+    typedef std::shared_ptr<MemoryAccount> Ptr;
+
+    //回收级别，按顺序依次尝试
+    enum EvictLevel {
+        //清空排序缓存，已缓存的包按顺序输出
+        EvictSortBuffer = 0,
+        //丢弃未完成的帧
+        EvictPartialFrame,
+        EvictLevelMax
+    };
+
+    /**
+     * 回收回调，返回释放的字节数
+     */
+    typedef std::function<uint64_t(EvictLevel level)> onEvict;
+
+    struct Stats {
+        //当前占用
+        uint64_t used = 0;
+        //峰值占用
+        uint64_t peak = 0;
+        //被回收的次数
+        uint64_t evictions = 0;
+        //被回收的字节数
+        uint64_t evicted_bytes = 0;
+    };
+
+    MemoryAccount(const std::string &name);
+    ~MemoryAccount();
+
+    MemoryAccount(const MemoryAccount &) = delete;
+    MemoryAccount &operator=(const MemoryAccount &) = delete;
+
+    void setName(const std::string &name);
+    std::string getName() const;
+
+    /**
+     * 设置回收回调，只有创建账户的线程触发回收时才会执行，
+     * 流的状态不需要跨线程加锁
+     */
+    void setOnEvict(onEvict cb);
+
+    /**
+     * 记录申请的内存，不会触发回收，
+     * 因为回收回调会清空排序缓存，只能由调用者在排序与解码之外调用MemoryBudget::reclaim()
+     * @return 超过进程预算时返回false
+     */
+    bool charge(uint64_t bytes);
+
+    /**
+     * 记录释放的内存
+     */
+    void release(uint64_t bytes);
+
+    /**
+     * 更新最近活跃时间，回收排序缓存时优先回收最久未活跃的流
+     */
+    void touch(uint64_t now_us);
+    uint64_t getLastActive() const;
+
+    Stats getStats() const;
+
+private:
+    friend class MemoryBudget;
+    uint64_t evict(EvictLevel level);
+
+private:
+    std::string _name;
+    std::atomic<uint64_t> _used{0};
+    std::atomic<uint64_t> _peak{0};
+    std::atomic<uint64_t> _evictions{0};
+    std::atomic<uint64_t> _evicted_bytes{0};
+    std::atomic<uint64_t> _last_active_us{0};
+    onEvict _cb;
+    //创建账户的线程
+    std::thread::id _owner;
+    mutable std::mutex _mtx;
+};
+
+/**
+ * 进程级内存预算
+ * 全部账户的占用之和超过上限时，各线程回收自己的账户：先按最久未活跃的顺序清空排序缓存，
+ * 仍不足时再按占用从大到小丢弃未完成的帧，直到回落到低水位；
+ * 超过高水位(isThrottle()为真)时，读取方应提前回收：实时接收还要放慢读取速度，
+ * 离线解析没有发送端可以施加背压，只回收不等待
+ */
+class MemoryBudget {
+public:
+    struct Stats {
+        uint64_t used = 0;
+        uint64_t peak = 0;
+        uint64_t limit = 0;
+        //触发回收的次数
+        uint64_t reclaims = 0;
+        //回收后仍超过预算的次数
+        uint64_t failures = 0;
+        //读取方被限速的次数
+        uint64_t throttles = 0;
+    };
+
+    static MemoryBudget &Instance();
+
+    /**
+     * 设置内存上限，0为不限制
+     */
+    void setLimit(uint64_t bytes);
+    uint64_t getLimit() const;
+    uint64_t getUsed() const;
+
+    /**
+     * 是否超过上限
+     */
+    bool isOver() const;
+
+    /**
+     * 是否应当放慢读取(超过高水位)，为真时计入限速次数
+     */
+    bool isThrottle();
+
+    /**
+     * 回收内存直到低于低水位
+     * @return 回收后是否低于上限
+     */
+    bool reclaim();
+
+    Stats getStats() const;
+
+    /**
+     * 打印进程与各个流的内存占用
+     */
+    void report() const;
+
+private:
+    friend class MemoryAccount;
+    MemoryBudget() = default;
+
+    void addAccount(MemoryAccount *account);
+    void removeAccount(MemoryAccount *account);
+    bool hasAccount(MemoryAccount *account) const;
+    void charge(uint64_t bytes);
+    void release(uint64_t bytes);
+
+private:
+    std::atomic<uint64_t> _limit{0};
+    std::atomic<uint64_t> _used{0};
+    std::atomic<uint64_t> _peak{0};
+    std::atomic<uint64_t> _reclaims{0};
+    std::atomic<uint64_t> _failures{0};
+    std::atomic<uint64_t> _throttles{0};
+    mutable std::mutex _mtx;
+    std::vector<MemoryAccount *> _accounts;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_MEMORYBUDGET_H
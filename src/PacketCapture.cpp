@@ -0,0 +1,232 @@
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include "PacketCapture.h"
+#include "Logger.h"
+#include "Trace.h"
+#include "CpuPlacement.h"
+
+using namespace std;
+
+namespace mediakit{
+
+PacketCapture::PacketCapture(const Config &config) {
+    _config = config;
+    if (!_config.workers) {
+        _config.workers = 1;
+    }
+    if (!_config.fanout_group) {
+        _config.fanout_group = getpid() & 0xFFFF;
+    }
+}
+
+PacketCapture::~PacketCapture() {
+    stop();
+}
+
+void PacketCapture::setOnWorkerStart(onWorker cb) {
+    _on_start = std::move(cb);
+}
+
+void PacketCapture::setOnWorkerStop(onWorker cb) {
+    _on_stop = std::move(cb);
+}
+
+void PacketCapture::setOnPacket(onPacket cb) {
+    _on_packet = std::move(cb);
+}
+
+void PacketCapture::setOnBlockDone(onWorker cb) {
+    _on_block = std::move(cb);
+}
+
+int PacketCapture::openRing(Worker &worker) {
+    int fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        return -errno;
+    }
+    worker.fd = fd;
+
+    int version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        return -errno;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = _config.block_size;
+    req.tp_block_nr = _config.block_count;
+    req.tp_frame_size = _config.frame_size;
+    req.tp_frame_nr = (_config.block_size / _config.frame_size) * _config.block_count;
+    req.tp_retire_blk_tov = _config.block_timeout_ms;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        return -errno;
+    }
+
+    worker.ring_size = (size_t) _config.block_size * _config.block_count;
+    auto ring = mmap(nullptr, worker.ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (ring == MAP_FAILED) {
+        worker.ring_size = 0;
+        return -errno;
+    }
+    worker.ring = (char *) ring;
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_nametoindex(_config.interface.c_str());
+    if (!addr.sll_ifindex) {
+        return -ENODEV;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        return -errno;
+    }
+
+    if (_config.workers > 1) {
+        //按流哈希分流，分片先在内核重组，保证同一个ip包的分片进入同一个worker
+        int fanout = _config.fanout_group | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0) {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+void PacketCapture::closeRing(Worker &worker) {
+    if (worker.ring) {
+        munmap(worker.ring, worker.ring_size);
+        worker.ring = nullptr;
+    }
+    if (worker.fd >= 0) {
+        close(worker.fd);
+        worker.fd = -1;
+    }
+}
+
+void PacketCapture::updateKernelStats(Worker &worker) {
+    //读取后内核计数清零，需要累加
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+    if (getsockopt(worker.fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+        worker.kernel_packets += stats.tp_packets;
+        worker.kernel_drops += stats.tp_drops;
+    }
+}
+
+void PacketCapture::run(int index) {
+    auto &worker = *_workers[index];
+    //先绑定cpu，环形缓存与流处理对象都在本地numa节点上分配
+    CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleWorker, index);
+    auto ret = openRing(worker);
+    if (ret < 0) {
+        closeRing(worker);
+        worker.status = ret;
+        return;
+    }
+    if (_on_start) {
+        _on_start(index);
+    }
+    worker.status = 0;
+
+    uint32_t block_index = 0;
+    auto hdr_len = TPACKET_ALIGN(sizeof(struct tpacket3_hdr));
+    while (!_exit) {
+        auto block = (struct tpacket_block_desc *) (worker.ring + (size_t) block_index * _config.block_size);
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            struct pollfd pfd;
+            pfd.fd = worker.fd;
+            pfd.events = POLLIN | POLLERR;
+            pfd.revents = 0;
+            poll(&pfd, 1, 100);
+            continue;
+        }
+
+        auto count = block->hdr.bh1.num_pkts;
+        auto pkt = (struct tpacket3_hdr *) ((char *) block + block->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < count; ++i) {
+            auto addr = (struct sockaddr_ll *) ((char *) pkt + hdr_len);
+            //lo等网卡上本机发出的包会被抓到两次
+            if (addr->sll_pkttype != PACKET_OUTGOING && _on_packet) {
+                TraceSpan("packet");
+                _on_packet(index, (char *) pkt + pkt->tp_mac, pkt->tp_snaplen, pkt->tp_sec * 1000000ULL + pkt->tp_nsec / 1000);
+                ++worker.packets;
+            }
+            pkt = (struct tpacket3_hdr *) ((char *) pkt + pkt->tp_next_offset);
+        }
+
+        if (_on_block) {
+            _on_block(index);
+        }
+        //归还block
+        __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        ++worker.blocks;
+        block_index = (block_index + 1) % _config.block_count;
+    }
+
+    updateKernelStats(worker);
+    if (_on_stop) {
+        _on_stop(index);
+    }
+    closeRing(worker);
+}
+
+int PacketCapture::start() {
+    if (!_workers.empty()) {
+        return -EBUSY;
+    }
+    _exit = false;
+    for (uint32_t i = 0; i < _config.workers; ++i) {
+        _workers.emplace_back(new Worker);
+    }
+    for (uint32_t i = 0; i < _config.workers; ++i) {
+        _workers[i]->thread = std::thread([this, i]() {
+            run(i);
+        });
+    }
+
+    int ret = 0;
+    for (auto &worker : _workers) {
+        while (worker->status == 1) {
+            usleep(1000);
+        }
+        if (worker->status < 0 && !ret) {
+            ret = worker->status;
+        }
+    }
+    if (ret < 0) {
+        PrintE("创建抓包环形缓存失败:%s, %s", _config.interface.c_str(), strerror(-ret));
+        stop();
+    }
+    return ret;
+}
+
+void PacketCapture::stop() {
+    _exit = true;
+    for (auto &worker : _workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+PacketCapture::Stats PacketCapture::getStats() const {
+    Stats stats;
+    for (auto &worker : _workers) {
+        stats.packets += worker->packets;
+        stats.blocks += worker->blocks;
+        stats.kernel_packets += worker->kernel_packets;
+        stats.kernel_drops += worker->kernel_drops;
+    }
+    return stats;
+}
+
+}//namespace mediakit
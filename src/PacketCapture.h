@@ -0,0 +1,129 @@
+#ifndef RTP2PS_PACKETCAPTURE_H
+#define RTP2PS_PACKETCAPTURE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+
+namespace mediakit{
+
+/**
+ * 基于AF_PACKET TPACKET_V3环形缓存的实时抓包
+ * 每个worker线程有自己的socket与mmap环形缓存，多个worker通过PACKET_FANOUT按流哈希分流，
+ * 同一个流(包括ip分片)总是由同一个worker处理；
+ * 数据包在环形缓存的block中原地交给回调，整个block处理完后才归还给内核，期间数据一直有效
+ */
+class PacketCapture {
+public:
+    typedef std::function<void(int worker)> onWorker;
+    /**
+     * 数据包回调
+     * @param worker worker下标
+     * @param frame 以太网帧，指向环形缓存，可以原地修改
+     * @param len 帧长度
+     * @param ts_us 抓包时间，微秒
+     */
+    typedef std::function<void(int worker, char *frame, uint32_t len, uint64_t ts_us)> onPacket;
+
+    struct Config {
+        //网卡名
+        std::string interface;
+        //worker线程数，大于1时使用fanout分流
+        uint32_t workers = 1;
+        //block大小，必须为页大小的整数倍
+        uint32_t block_size = 1024 * 1024;
+        //每个worker的block个数
+        uint32_t block_count = 64;
+        //帧大小，TPACKET_V3中帧为变长，仅用于计算帧数
+        uint32_t frame_size = 2048;
+        //block未填满时交给用户态的超时时间，毫秒
+        uint32_t block_timeout_ms = 10;
+        //fanout组id，0时使用进程号
+        uint16_t fanout_group = 0;
+    };
+
+    struct Stats {
+        //处理的数据包数
+        uint64_t packets = 0;
+        //处理的block数
+        uint64_t blocks = 0;
+        //内核统计的接收包数
+        uint64_t kernel_packets = 0;
+        //内核因环形缓存满而丢弃的包数
+        uint64_t kernel_drops = 0;
+    };
+
+    PacketCapture(const Config &config);
+    ~PacketCapture();
+
+    PacketCapture(const PacketCapture &) = delete;
+    PacketCapture &operator=(const PacketCapture &) = delete;
+
+    /**
+     * worker线程启动回调，在worker线程中绑定cpu后调用，用于创建该worker的流处理对象
+     */
+    void setOnWorkerStart(onWorker cb);
+
+    /**
+     * worker线程退出回调，在worker线程中调用
+     */
+    void setOnWorkerStop(onWorker cb);
+
+    /**
+     * 数据包回调，在worker线程中调用
+     */
+    void setOnPacket(onPacket cb);
+
+    /**
+     * block处理完成回调，block归还内核前调用，指向该block的数据在此之后失效
+     */
+    void setOnBlockDone(onWorker cb);
+
+    /**
+     * 启动全部worker，等待环形缓存创建完成
+     * @return 成功返回0，失败返回-errno
+     */
+    int start();
+
+    /**
+     * 停止并等待全部worker退出
+     */
+    void stop();
+
+    Stats getStats() const;
+
+private:
+    struct Worker {
+        int fd = -1;
+        char *ring = nullptr;
+        size_t ring_size = 0;
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> blocks{0};
+        std::atomic<uint64_t> kernel_packets{0};
+        std::atomic<uint64_t> kernel_drops{0};
+        //环形缓存创建结果，1为未完成
+        std::atomic<int> status{1};
+        std::thread thread;
+    };
+
+    int openRing(Worker &worker);
+    void closeRing(Worker &worker);
+    void run(int index);
+    void updateKernelStats(Worker &worker);
+
+private:
+    Config _config;
+    std::atomic<bool> _exit{false};
+    onWorker _on_start;
+    onWorker _on_stop;
+    onWorker _on_block;
+    onPacket _on_packet;
+    std::vector<std::unique_ptr<Worker> > _workers;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_PACKETCAPTURE_H
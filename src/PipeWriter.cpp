@@ -0,0 +1,195 @@
+#include "PipeWriter.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "Logger.h"
+#include "CpuPlacement.h"
+
+using namespace std;
+
+namespace mediakit{
+
+bool PipeWriter::isPipePath(const std::string &path) {
+    return path == "-" || parseFd(path) >= 0;
+}
+
+int PipeWriter::parseFd(const std::string &path) {
+    if (path.compare(0, 3, "fd:") != 0 || path.size() == 3) {
+        return -1;
+    }
+    char *end = nullptr;
+    auto fd = strtol(path.c_str() + 3, &end, 10);
+    if (*end || fd < 0 || fd > INT32_MAX) {
+        return -1;
+    }
+    return (int) fd;
+}
+
+PipeWriter::PipeWriter(int fd, bool close_fd) : PipeWriter(fd, close_fd, Config()) {}
+
+PipeWriter::PipeWriter(int fd, bool close_fd, const Config &config) {
+    _fd = fd;
+    _close_fd = close_fd;
+    _config = config;
+    if (_config.buffer_count < 2) {
+        _config.buffer_count = 2;
+    }
+    if (!_config.buffer_size) {
+        _config.buffer_size = 64 * 1024;
+    }
+    _buffers.resize(_config.buffer_count);
+    for (uint32_t i = 0; i < _config.buffer_count; ++i) {
+        _buffers[i].resize(_config.buffer_size);
+        _free.emplace_back(_config.buffer_count - i - 1);
+    }
+    _thread = std::thread([this]() {
+        CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleWriter, 0);
+        run();
+    });
+}
+
+PipeWriter::~PipeWriter() {
+    //等待全部数据写出
+    flush();
+    {
+        lock_guard<mutex> lck(_mtx);
+        _exit = true;
+    }
+    _cv_write.notify_one();
+    _thread.join();
+    if (_stats.stalls || _stats.dropped) {
+        PrintI("管道输出:%llu字节, 背压等待:%llu次, 丢弃:%llu字节", (unsigned long long) _stats.bytes,
+               (unsigned long long) _stats.stalls, (unsigned long long) _stats.dropped);
+    }
+    if (_close_fd) {
+        close(_fd);
+    }
+}
+
+void PipeWriter::inputFrame(const Frame::Ptr &frame) {
+    write(frame->data(), frame->size());
+}
+
+void PipeWriter::write(const char *data, size_t len) {
+    if (_error.load(std::memory_order_relaxed)) {
+        lock_guard<mutex> lck(_mtx);
+        _stats.dropped += len;
+        return;
+    }
+    while (len) {
+        if (_cur < 0) {
+            obtain();
+        }
+        auto n = min((size_t) (_config.buffer_size - _cur_len), len);
+        memcpy(_buffers[_cur].data() + _cur_len, data, n);
+        _cur_len += n;
+        data += n;
+        len -= n;
+        if (_cur_len == _config.buffer_size) {
+            flush();
+        }
+    }
+    if (_idle.load(std::memory_order_relaxed)) {
+        //写线程空闲，不必等缓存写满
+        flush();
+    }
+}
+
+void PipeWriter::flush() {
+    if (_cur < 0 || !_cur_len) {
+        return;
+    }
+    {
+        lock_guard<mutex> lck(_mtx);
+        _queue.push_back({(uint32_t) _cur, _cur_len});
+        _idle = false;
+    }
+    _cv_write.notify_one();
+    _cur = -1;
+    _cur_len = 0;
+}
+
+void PipeWriter::obtain() {
+    unique_lock<mutex> lck(_mtx);
+    if (_free.empty()) {
+        ++_stats.stalls;
+        _cv_free.wait(lck, [this]() {
+            return !_free.empty();
+        });
+    }
+    _cur = _free.back();
+    _free.pop_back();
+    _cur_len = 0;
+}
+
+bool PipeWriter::hasError() const {
+    return _error;
+}
+
+PipeWriter::Stats PipeWriter::getStats() const {
+    lock_guard<mutex> lck(_mtx);
+    return _stats;
+}
+
+void PipeWriter::run() {
+    while (true) {
+        Block block;
+        {
+            unique_lock<mutex> lck(_mtx);
+            if (_queue.empty()) {
+                _idle = true;
+                _cv_write.wait(lck, [this]() {
+                    return _exit || !_queue.empty();
+                });
+                if (_queue.empty()) {
+                    break;
+                }
+            }
+            block = _queue.front();
+            _queue.pop_front();
+        }
+
+        uint64_t writes = 0;
+        bool ok = !_error && writeAll(_buffers[block.index].data(), block.len, writes);
+        {
+            lock_guard<mutex> lck(_mtx);
+            _stats.writes += writes;
+            if (ok) {
+                _stats.bytes += block.len;
+            } else {
+                _stats.dropped += block.len;
+            }
+            _free.emplace_back(block.index);
+        }
+        _cv_free.notify_one();
+    }
+}
+
+bool PipeWriter::writeAll(const char *data, size_t len, uint64_t &writes) {
+    while (len) {
+        auto n = ::write(_fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            //非阻塞fd，等待可写
+            struct pollfd pfd = {_fd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n <= 0) {
+            //对端关闭(EPIPE)时之后的数据全部丢弃，不阻塞流处理
+            PrintE("管道写入失败, fd:%d, %s", _fd, n < 0 ? strerror(errno) : "写入0字节");
+            _error = true;
+            return false;
+        }
+        ++writes;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+}//namespace mediakit
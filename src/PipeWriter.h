@@ -0,0 +1,119 @@
+#ifndef RTP2PS_PIPEWRITER_H
+#define RTP2PS_PIPEWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include "Frame.h"
+
+namespace mediakit{
+
+/**
+ * 输出到管道、标准输出或socket等文件描述符
+ * 帧数据拷贝进当前缓存后由独立的写线程写出，写线程空闲时立即提交当前缓存，
+ * 消费者快时延迟最小，消费者慢时数据在缓存中积累为大块写入；
+ * 全部缓存都在等待写出时写入方才等待(有界背压)，不会在每一帧上阻塞
+ */
+class PipeWriter : public FrameWriterInterface {
+public:
+    typedef std::shared_ptr<PipeWriter> Ptr;
+
+    struct Config {
+        //单个缓存大小
+        uint32_t buffer_size = 1024 * 1024;
+        //缓存个数，至少为2
+        uint32_t buffer_count = 3;
+    };
+
+    struct Stats {
+        //写出的字节数
+        uint64_t bytes = 0;
+        //write调用次数
+        uint64_t writes = 0;
+        //因缓存耗尽而等待的次数
+        uint64_t stalls = 0;
+        //对端关闭或写入失败后丢弃的字节数
+        uint64_t dropped = 0;
+    };
+
+    /**
+     * 是否为管道输出路径："-"为标准输出，"fd:N"为已打开的文件描述符
+     */
+    static bool isPipePath(const std::string &path);
+
+    /**
+     * 解析"fd:N"中的文件描述符，不是该格式时返回-1
+     */
+    static int parseFd(const std::string &path);
+
+    /**
+     * @param fd 文件描述符，可以是非阻塞的
+     * @param close_fd 析构时是否关闭fd
+     */
+    PipeWriter(int fd, bool close_fd);
+    PipeWriter(int fd, bool close_fd, const Config &config);
+    ~PipeWriter() override;
+
+    void inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * 写入数据
+     */
+    void write(const char *data, size_t len);
+
+    /**
+     * 提交当前缓存，不等待写出完成
+     */
+    void flush();
+
+    /**
+     * 对端是否已关闭或写入失败，之后的数据被丢弃
+     */
+    bool hasError() const;
+
+    Stats getStats() const;
+
+private:
+    struct Block {
+        uint32_t index;
+        uint32_t len;
+    };
+
+    void run();
+    bool writeAll(const char *data, size_t len, uint64_t &writes);
+
+    /**
+     * 获取空闲缓存作为当前缓存，全部缓存都在等待写出时等待
+     */
+    void obtain();
+
+private:
+    int _fd;
+    bool _close_fd;
+    Config _config;
+    bool _exit = false;
+    std::atomic<bool> _error{false};
+    //写线程是否在等待数据
+    std::atomic<bool> _idle{true};
+    std::vector<std::vector<char> > _buffers;
+    std::vector<uint32_t> _free;
+    //等待写出的缓存
+    std::deque<Block> _queue;
+    //当前写入的缓存下标，-1为没有
+    int _cur = -1;
+    uint32_t _cur_len = 0;
+    Stats _stats;
+    mutable std::mutex _mtx;
+    std::condition_variable _cv_write;
+    std::condition_variable _cv_free;
+    std::thread _thread;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_PIPEWRITER_H
@@ -0,0 +1,176 @@
+#include "PsInterleaver.h"
+#include "PsMuxer.h"
+#include "Logger.h"
+
+namespace mediakit{
+
+PsInterleaver::PsInterleaver(const FrameWriterInterface::Ptr &writer) {
+    _writer = writer;
+}
+
+PsInterleaver::~PsInterleaver() {
+    flush();
+}
+
+void PsInterleaver::setTrack(int track_index, TrackType type, CodecId codec, int samplerate) {
+    auto &track = _tracks[track_index];
+    track.type = type;
+    track.codec = codec;
+    track.cycle_ms = samplerate > 0 ? (int64_t) (1000 * (1ULL << 32) / samplerate) : 0;
+}
+
+void PsInterleaver::setArrivalTime(uint64_t us) {
+    _arrival_ms = us / 1000;
+}
+
+void PsInterleaver::inputPacket(int track_index) {
+    auto &track = _tracks[track_index];
+    if (!track.arrived) {
+        track.arrived = true;
+        track.arrival_ms = _arrival_ms;
+    }
+}
+
+void PsInterleaver::inputFrame(int track_index, const Frame::Ptr &frame) {
+    auto &track = _tracks[track_index];
+    //rtp时间戳回环后毫秒时间戳也会回环，展开为单调的64位时间戳
+    int64_t stamp = track.base + frame->dts();
+    if (!track.started) {
+        track.started = true;
+        track.last = stamp;
+        track.offset = (int64_t) (track.arrived ? track.arrival_ms : _arrival_ms) - stamp;
+    } else if (track.cycle_ms) {
+        if (stamp - track.last < -track.cycle_ms / 2) {
+            track.base += track.cycle_ms;
+            stamp += track.cycle_ms;
+        } else if (stamp - track.last > track.cycle_ms / 2) {
+            //回环之前的迟到帧
+            stamp -= track.cycle_ms;
+        }
+    }
+    if (stamp > track.last) {
+        track.last = stamp;
+    }
+    track.frames.emplace_back(stamp + track.offset, frame);
+    pump(false);
+}
+
+void PsInterleaver::flush() {
+    pump(true);
+}
+
+void PsInterleaver::saveState(CheckpointWriter &writer) const {
+    writer.write(_arrival_ms);
+    writer.write(_need_psm);
+    for (auto &track : _tracks) {
+        writer.write(track.started);
+        writer.write(track.arrived);
+        writer.write(track.arrival_ms);
+        writer.write(track.base);
+        writer.write(track.last);
+        writer.write(track.offset);
+        writer.write((uint32_t) track.frames.size());
+        for (auto &pr : track.frames) {
+            writer.write(pr.first);
+            Checkpoint::saveFrame(writer, *pr.second);
+        }
+    }
+}
+
+bool PsInterleaver::loadState(CheckpointReader &reader) {
+    if (!reader.read(_arrival_ms) || !reader.read(_need_psm)) {
+        return false;
+    }
+    for (auto &track : _tracks) {
+        uint32_t count;
+        if (!reader.read(track.started) || !reader.read(track.arrived) || !reader.read(track.arrival_ms) || !reader.read(track.base) || !reader.read(track.last)
+            || !reader.read(track.offset) || !reader.read(count)) {
+            return false;
+        }
+        track.frames.clear();
+        for (uint32_t i = 0; i < count; ++i) {
+            int64_t stamp;
+            auto frame = obtainObj();
+            if (!reader.read(stamp) || !Checkpoint::loadFrame(reader, *frame)) {
+                return false;
+            }
+            track.frames.emplace_back(stamp, std::move(frame));
+        }
+    }
+    return true;
+}
+
+void PsInterleaver::pump(bool all) {
+    auto &first = _tracks[0].frames;
+    auto &second = _tracks[1].frames;
+    while (true) {
+        int index = -1;
+        if (!first.empty() && !second.empty()) {
+            index = first.front().first <= second.front().first ? 0 : 1;
+        } else {
+            //另一个track没有数据，缓存超过上限后不再等待
+            for (int i = 0; i < 2; ++i) {
+                auto &frames = _tracks[i].frames;
+                if (!frames.empty() && (all || frames.size() > kMaxFrames || frames.back().first - frames.front().first > kMaxDelayMs)) {
+                    index = i;
+                }
+            }
+        }
+        if (index < 0) {
+            break;
+        }
+        auto &frames = _tracks[index].frames;
+        auto stamp = frames.front().first;
+        auto frame = std::move(frames.front().second);
+        frames.pop_front();
+        output(index, stamp, frame);
+    }
+}
+
+void PsInterleaver::output(int track_index, int64_t stamp, const Frame::Ptr &frame) {
+    auto &track = _tracks[track_index];
+    if (track.type == TrackAudio) {
+        outputAudio(track, stamp, frame);
+        return;
+    }
+    if (PsMuxer::isKeyPack((uint8_t *) frame->data(), frame->size())) {
+        //设备的PSM中可能没有音频流
+        _need_psm = true;
+    }
+    _writer->inputFrame(frame);
+}
+
+void PsInterleaver::outputAudio(const Track &track, int64_t stamp, const Frame::Ptr &frame) {
+    auto stream_type = PsMuxer::getStreamType(track.codec);
+    if (!stream_type) {
+        PrintW("不支持封装为ps的音频编码:%d", (int) track.codec);
+        return;
+    }
+    //换算到视频的时间轴，视频ps流中的pts一般与rtp时间戳一致
+    int64_t offset = track.offset;
+    for (auto &that : _tracks) {
+        if (that.type == TrackVideo && that.started) {
+            offset = that.offset;
+        }
+    }
+    auto dts = (uint32_t) (stamp - offset);
+    uint64_t pts = (uint64_t) dts * 90;
+
+    auto out = obtainObj();
+    out->_buffer.clear();
+    out->_codec_id = track.codec;
+    out->_dts = dts;
+    out->_pts = 0;
+    out->_prefix_size = 0;
+    auto arrival = frame->getArrival();
+    out->_arrival = arrival ? *arrival : FrameArrival();
+    PsMuxer::writePackHeader(out->_buffer, pts);
+    if (_need_psm) {
+        PsMuxer::writePsm(out->_buffer, stream_type, PsMuxer::kAudioStreamId);
+        _need_psm = false;
+    }
+    PsMuxer::writePes(out->_buffer, PsMuxer::kAudioStreamId, pts, frame->data(), frame->size());
+    _writer->inputFrame(out);
+}
+
+}//namespace mediakit
@@ -0,0 +1,102 @@
+#ifndef RTP2PS_PSINTERLEAVER_H
+#define RTP2PS_PSINTERLEAVER_H
+
+#include <stdint.h>
+#include <deque>
+#include "Frame.h"
+#include "Checkpoint.h"
+
+namespace mediakit{
+
+/**
+ * 把视频(ps流)与音频(独立rtp流)两个track的帧按时间戳交织输出到同一个ps流
+ * 两个流的rtp时间戳起点无关，各自以第一个rtp包的到达时间对齐；
+ * 视频帧原样输出，音频帧封装为ps包(包头 + PES)，其pts换算到视频的时间轴上，
+ * 输出的第一个音频帧之前以及每个视频关键帧之后的第一个音频帧之前插入描述音频流的PSM
+ */
+class PsInterleaver : public ResourcePoolHelper<FrameImp> {
+public:
+    typedef std::shared_ptr<PsInterleaver> Ptr;
+
+    //一个track没有数据时，另一个track最多缓存的时长，毫秒
+    static const int64_t kMaxDelayMs = 500;
+    //一个track最多缓存的帧数
+    static const size_t kMaxFrames = 256;
+
+    PsInterleaver(const FrameWriterInterface::Ptr &writer);
+    ~PsInterleaver();
+
+    /**
+     * 设置track参数
+     * @param track_index track下标索引
+     * @param type track类型
+     * @param codec 编码类型，视频为CodecInvalid(ps流)
+     * @param samplerate rtp时间戳基准时钟
+     */
+    void setTrack(int track_index, TrackType type, CodecId codec, int samplerate);
+
+    /**
+     * 当前数据的到达时间，用于对齐两个track的时间戳
+     */
+    void setArrivalTime(uint64_t us);
+
+    /**
+     * track收到rtp包(排序前)，第一个包的到达时间作为该track时间轴对齐的基准；
+     * 帧要等排序以及下一帧的包到达后才输出，以帧的输出时间对齐会引入与排序缓存和帧间隔相关的偏差
+     */
+    void inputPacket(int track_index);
+
+    /**
+     * 输入一个track的帧
+     */
+    void inputFrame(int track_index, const Frame::Ptr &frame);
+
+    /**
+     * 输出全部缓存的帧
+     */
+    void flush();
+
+    /**
+     * 保存与恢复时间轴与缓存的帧，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const;
+    bool loadState(CheckpointReader &reader);
+
+private:
+    struct Track {
+        TrackType type = TrackInvalid;
+        CodecId codec = CodecInvalid;
+        //rtp时间戳回环对应的毫秒数
+        int64_t cycle_ms = 0;
+        bool started = false;
+        //已收到rtp包
+        bool arrived = false;
+        //第一个rtp包的到达时间，毫秒
+        uint64_t arrival_ms = 0;
+        //时间戳回环累加值
+        int64_t base = 0;
+        int64_t last = 0;
+        //时间戳到公共时间轴的偏移
+        int64_t offset = 0;
+        //<公共时间轴上的时间戳, 帧>
+        std::deque<std::pair<int64_t, Frame::Ptr> > frames;
+    };
+
+    /**
+     * 按时间戳顺序输出可以确定顺序的帧
+     * @param all 是否输出全部帧
+     */
+    void pump(bool all);
+    void output(int track_index, int64_t stamp, const Frame::Ptr &frame);
+    void outputAudio(const Track &track, int64_t stamp, const Frame::Ptr &frame);
+
+private:
+    Track _tracks[2];
+    uint64_t _arrival_ms = 0;
+    //下一个音频帧前需要插入PSM
+    bool _need_psm = true;
+    FrameWriterInterface::Ptr _writer;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_PSINTERLEAVER_H
@@ -0,0 +1,182 @@
+#include "PsMuxer.h"
+
+namespace mediakit{
+
+//PES包的最大负载，PES_packet_length为16bit，减去3字节标志与5字节pts
+#define PES_MAX_PAYLOAD (0xFFFF - 8)
+//mux_rate与rate_bound，单位50字节/秒
+#define PS_MUX_RATE 6106
+
+static uint32_t crc32Mpeg(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+PsMuxer::PsMuxer(const FrameWriterInterface::Ptr &writer) {
+    _writer = writer;
+}
+
+uint8_t PsMuxer::getStreamType(CodecId codec) {
+    switch (codec) {
+        case CodecH264: return 0x1B;
+        case CodecH265: return 0x24;
+        case CodecAAC: return 0x0F;
+        case CodecG711A: return 0x90;
+        case CodecG711U: return 0x91;
+        default: return 0;
+    }
+}
+
+void PsMuxer::writePackHeader(BufferLikeString &buffer, uint64_t scr) {
+    char header[14];
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x01;
+    header[3] = (char) 0xBA;
+    header[4] = (char) (0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03));
+    header[5] = (char) ((scr >> 20) & 0xFF);
+    header[6] = (char) (0x04 | ((scr >> 12) & 0xF8) | ((scr >> 13) & 0x03));
+    header[7] = (char) ((scr >> 5) & 0xFF);
+    header[8] = (char) (0x04 | ((scr << 3) & 0xF8));
+    header[9] = 0x01;
+    header[10] = (char) ((PS_MUX_RATE >> 14) & 0xFF);
+    header[11] = (char) ((PS_MUX_RATE >> 6) & 0xFF);
+    header[12] = (char) (((PS_MUX_RATE << 2) & 0xFC) | 0x03);
+    //无填充字节
+    header[13] = (char) 0xF8;
+    buffer.append(header, sizeof(header));
+}
+
+void PsMuxer::writeSystemHeader(BufferLikeString &buffer) {
+    char header[15];
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x01;
+    header[3] = (char) 0xBB;
+    header[4] = 0x00;
+    header[5] = 9;
+    header[6] = (char) (0x80 | ((PS_MUX_RATE >> 15) & 0x7F));
+    header[7] = (char) ((PS_MUX_RATE >> 7) & 0xFF);
+    header[8] = (char) (((PS_MUX_RATE << 1) & 0xFE) | 0x01);
+    //audio_bound = 1
+    header[9] = 0x04;
+    //音视频锁定，video_bound = 1
+    header[10] = (char) 0xE1;
+    header[11] = 0x7F;
+    //视频流，缓存上限400 * 1024字节
+    header[12] = (char) kVideoStreamId;
+    header[13] = (char) (0xE0 | 0x20 | (400 >> 8));
+    header[14] = (char) (400 & 0xFF);
+    buffer.append(header, sizeof(header));
+}
+
+void PsMuxer::writePsm(BufferLikeString &buffer, uint8_t stream_type, uint8_t stream_id) {
+    uint8_t psm[20];
+    psm[0] = 0x00;
+    psm[1] = 0x00;
+    psm[2] = 0x01;
+    psm[3] = 0xBC;
+    //PSM长度
+    psm[4] = 0x00;
+    psm[5] = 14;
+    //current_next_indicator + 版本号
+    psm[6] = 0xE0;
+    psm[7] = 0xFF;
+    //program_stream_info_length
+    psm[8] = 0x00;
+    psm[9] = 0x00;
+    //elementary_stream_map_length
+    psm[10] = 0x00;
+    psm[11] = 4;
+    psm[12] = stream_type;
+    psm[13] = stream_id;
+    psm[14] = 0x00;
+    psm[15] = 0x00;
+    auto crc = crc32Mpeg(psm, 16);
+    psm[16] = crc >> 24;
+    psm[17] = (crc >> 16) & 0xFF;
+    psm[18] = (crc >> 8) & 0xFF;
+    psm[19] = crc & 0xFF;
+    buffer.append((char *) psm, sizeof(psm));
+}
+
+void PsMuxer::writePes(BufferLikeString &buffer, uint8_t stream_id, uint64_t pts, const char *data, uint32_t size) {
+    pts &= 0x1FFFFFFFFULL;
+    bool first = true;
+    while (size) {
+        //后续PES不带pts，负载可以多5字节
+        uint32_t max_payload = first ? PES_MAX_PAYLOAD : PES_MAX_PAYLOAD + 5;
+        uint32_t payload_size = size > max_payload ? max_payload : size;
+        uint32_t pes_len = payload_size + (first ? 8 : 3);
+        char header[14];
+        header[0] = 0x00;
+        header[1] = 0x00;
+        header[2] = 0x01;
+        header[3] = (char) stream_id;
+        header[4] = (char) (pes_len >> 8);
+        header[5] = (char) (pes_len & 0xFF);
+        header[6] = (char) 0x80;
+        if (first) {
+            //只有pts
+            header[7] = (char) 0x80;
+            header[8] = 5;
+            header[9] = (char) (0x21 | ((pts >> 29) & 0x0E));
+            header[10] = (char) ((pts >> 22) & 0xFF);
+            header[11] = (char) (0x01 | ((pts >> 14) & 0xFE));
+            header[12] = (char) ((pts >> 7) & 0xFF);
+            header[13] = (char) (0x01 | ((pts << 1) & 0xFE));
+            buffer.append(header, 14);
+        } else {
+            header[7] = 0x00;
+            header[8] = 0x00;
+            buffer.append(header, 9);
+        }
+        buffer.append(data, payload_size);
+        data += payload_size;
+        size -= payload_size;
+        first = false;
+    }
+}
+
+bool PsMuxer::isKeyPack(const uint8_t *data, uint32_t size) {
+    if (size < 18 || data[0] || data[1] || data[2] != 0x01 || data[3] != 0xBA) {
+        return false;
+    }
+    uint32_t pos = 14 + (data[13] & 0x07);
+    return pos + 4 <= size && !data[pos] && !data[pos + 1] && data[pos + 2] == 0x01 && data[pos + 3] == 0xBB;
+}
+
+void PsMuxer::inputFrame(const Frame::Ptr &frame) {
+    auto stream_type = getStreamType(frame->getCodecId());
+    if (!stream_type || !_writer) {
+        return;
+    }
+    //rtp时间戳为显示时间戳，没有b帧的解码顺序信息，只写pts
+    uint64_t pts = (uint64_t) frame->pts() * 90;
+    auto out = obtainObj();
+    out->_buffer.clear();
+    out->_codec_id = frame->getCodecId();
+    out->_dts = frame->dts();
+    out->_pts = frame->pts();
+    out->_prefix_size = 0;
+    auto arrival = frame->getArrival();
+    out->_arrival = arrival ? *arrival : FrameArrival();
+    //ps头 + 每64K一个PES头
+    out->_buffer.reserve(frame->size() + 64 + 9 * (frame->size() / PES_MAX_PAYLOAD + 1));
+
+    writePackHeader(out->_buffer, pts);
+    if (frame->keyFrame()) {
+        writeSystemHeader(out->_buffer);
+        writePsm(out->_buffer, stream_type, kVideoStreamId);
+    }
+    writePes(out->_buffer, kVideoStreamId, pts, frame->data(), frame->size());
+    _writer->inputFrame(out);
+}
+
+}//namespace mediakit
@@ -0,0 +1,65 @@
+#ifndef RTP2PS_PSMUXER_H
+#define RTP2PS_PSMUXER_H
+
+#include <stdint.h>
+#include "Frame.h"
+
+namespace mediakit{
+
+/**
+ * 把h264/h265裸流帧封装为ps流，每帧一个ps包，关键帧前输出系统头与PSM
+ * 同时提供ps包头、PSM与PES的写入函数，供音频交织输出使用
+ */
+class PsMuxer : public FrameWriterInterface, public ResourcePoolHelper<FrameImp> {
+public:
+    typedef std::shared_ptr<PsMuxer> Ptr;
+
+    static const uint8_t kVideoStreamId = 0xE0;
+    static const uint8_t kAudioStreamId = 0xC0;
+
+    PsMuxer(const FrameWriterInterface::Ptr &writer);
+    ~PsMuxer() override {}
+
+    /**
+     * 输入Annex-B格式的视频帧，封装后输出
+     */
+    void inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * PSM中的stream_type，音频采用GB28181的取值，不支持返回0
+     */
+    static uint8_t getStreamType(CodecId codec);
+
+    /**
+     * 写入ps包头
+     * @param scr 系统时钟，90KHz
+     */
+    static void writePackHeader(BufferLikeString &buffer, uint64_t scr);
+
+    /**
+     * 写入只包含视频流的系统头
+     */
+    static void writeSystemHeader(BufferLikeString &buffer);
+
+    /**
+     * 写入只描述一个流的PSM
+     */
+    static void writePsm(BufferLikeString &buffer, uint8_t stream_type, uint8_t stream_id);
+
+    /**
+     * 写入PES，超过PES最大长度时拆分为多个，只有第一个带pts
+     * @param pts 显示时间戳，90KHz
+     */
+    static void writePes(BufferLikeString &buffer, uint8_t stream_id, uint64_t pts, const char *data, uint32_t size);
+
+    /**
+     * ps包头之后是否为系统头，设备只在关键帧前输出系统头与PSM
+     */
+    static bool isKeyPack(const uint8_t *data, uint32_t size);
+
+private:
+    FrameWriterInterface::Ptr _writer;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_PSMUXER_H
@@ -1,13 +1,25 @@
 #include "RtpReceiver.hpp"
+#include <time.h>
+#include "Trace.h"
+#include "util.h"
 
+//分片重组后的udp负载最大可达64K
+#define RTP_MAX_SIZE (64 * 1024)
 
-#define AV_RB16(x)                           \
-    ((((const uint8_t*)(x))[0] << 8) |          \
-      ((const uint8_t*)(x))[1])
-
-#define RTP_MAX_SIZE (10 * 1024)
+static uint64_t getMonotonicMicrosecond() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
-RtpReceiver::RtpReceiver() {
+RtpReceiver::RtpReceiver() : _rtp_decoder{{CodecInvalid, 2 * 1024 * 1024}, {CodecInvalid, 2 * 1024 * 1024}} {
+    _tracks[0].type = TrackVideo;
+    _tracks[0].samplerate = 90000;
+    for (auto &codec : _pt_codec) {
+        codec = CodecMax;
+    }
+    _pt_codec[98] = CodecH264;
+    _pt_codec[100] = CodecH265;
     int index = 0;
     for (auto &sortor : _rtp_sortor) {
         sortor.setOnSort([this, index](uint16_t seq, RtpPacket::Ptr &packet) {
@@ -15,23 +27,329 @@ RtpReceiver::RtpReceiver() {
         });
         ++index;
     }
-    _rtp_decoder = std::make_shared<CommonRtpDecoder>(CodecInvalid,  2 * 1024 * 1024);
+    _account = std::make_shared<MemoryAccount>("rtp");
+    _account->setOnEvict([this](MemoryAccount::EvictLevel level) {
+        return onEvict(level);
+    });
+    for (auto &decoder : _rtp_decoder) {
+        decoder.setMemoryAccount(_account);
+    }
+}
+RtpReceiver::~RtpReceiver() {
+    _account->setOnEvict(nullptr);
 }
-RtpReceiver::~RtpReceiver() {}
 
-void RtpReceiver::onRtpSorted(const RtpPacket::Ptr &rtp, int track_index) {
+void RtpReceiver::setFrameWriter(const FrameWriterInterface::Ptr &writer) {
+    _writer = writer;
+    updateWriter();
+}
+
+void RtpReceiver::setTrack(int track_index, const TrackConfig &config) {
+    _tracks[track_index] = config;
+    auto &decoder = _rtp_decoder[track_index];
+    decoder.setCodecId(config.codec);
+    decoder.setAudioConfig(config.samplerate, config.channels);
+    updateWriter();
+}
+
+const RtpReceiver::TrackConfig &RtpReceiver::getTrack(int track_index) const {
+    return _tracks[track_index];
+}
+
+void RtpReceiver::setArrivalTime(uint64_t us) {
+    _arrival_us = us;
+    if (_interleaver) {
+        _interleaver->setArrivalTime(us);
+    }
+}
+
+void RtpReceiver::setPayloadType(uint8_t pt, CodecId codec) {
+    _pt_codec[pt & 0x7F] = codec;
+}
+
+void RtpReceiver::setOutputFormat(OutputFormat format) {
+    _format = format;
+    updateWriter();
+}
+
+void RtpReceiver::updateWriter() {
+    //替换前输出缓存的帧
+    if (_interleaver) {
+        _interleaver->flush();
+    }
+    _interleaver = nullptr;
+    auto sink = _writer;
+    if (_writer && _latency) {
+        auto writer = _writer;
+        sink = std::make_shared<FrameWriterInterfaceHelper>([this, writer](const Frame::Ptr &frame) {
+            onFrameSink(frame, writer);
+        });
+    }
+    FrameWriterInterface::Ptr writers[2] = {sink, sink};
+    if (_writer && _tracks[0].type != TrackInvalid && _tracks[1].type != TrackInvalid) {
+        //两个track交织输出
+        auto interleaver = std::make_shared<PsInterleaver>(sink);
+        for (int track_index = 0; track_index < 2; ++track_index) {
+            auto &track = _tracks[track_index];
+            interleaver->setTrack(track_index, track.type, track.codec, track.samplerate);
+            writers[track_index] = std::make_shared<FrameWriterInterfaceHelper>([interleaver, track_index](const Frame::Ptr &frame) {
+                interleaver->inputFrame(track_index, frame);
+            });
+        }
+        _interleaver = interleaver;
+    }
+    for (int track_index = 0; track_index < 2; ++track_index) {
+        auto &writer = writers[track_index];
+        if (writer && _latency) {
+            //h264/h265封装为ps后再统计，ps帧带有原始帧的时延戳
+            auto next = writer;
+            writer = std::make_shared<FrameWriterInterfaceHelper>([this, next](const Frame::Ptr &frame) {
+                onFrameEmit(frame);
+                next->inputFrame(frame);
+            });
+        }
+        _rtp_decoder[track_index].setFrameWriter(writer);
+        //交织输出的视频必须是ps流
+        bool es = _format == OutputEs && !_interleaver;
+        _h26x_writer[track_index] = writer && !es ? std::make_shared<PsMuxer>(writer) : writer;
+        if (_h26x_decoder[track_index]) {
+            _h26x_decoder[track_index]->setFrameWriter(_h26x_writer[track_index]);
+        }
+    }
+}
+
+void RtpReceiver::setLatencyStats(const LatencyStats::Ptr &stats) {
+    _latency = stats;
+    updateWriter();
+}
+
+const LatencyStats::Ptr &RtpReceiver::getLatencyStats() const {
+    return _latency;
+}
+
+void RtpReceiver::onFrameEmit(const Frame::Ptr &frame) {
+    auto arrival = frame->getArrival();
+    if (!arrival || !arrival->first_us) {
+        //断点恢复的帧没有时延戳
+        return;
+    }
+    arrival->emit_us = _clock_us;
+    _latency->record(LatencyStats::FirstPacketToFrame, _clock_us > arrival->first_us ? _clock_us - arrival->first_us : 0);
+    _latency->record(LatencyStats::LastPacketToFrame, _clock_us > arrival->last_us ? _clock_us - arrival->last_us : 0);
+}
 
-    _rtp_decoder->inputRtp(rtp);
-    
+void RtpReceiver::onFrameSink(const Frame::Ptr &frame, const FrameWriterInterface::Ptr &writer) {
+    auto arrival = frame->getArrival();
+    uint64_t emit_us = arrival ? arrival->emit_us : 0;
+    auto start = getMonotonicMicrosecond();
+    writer->inputFrame(frame);
+    if (!emit_us) {
+        return;
+    }
+    //交织等待的时间按到达时间的时钟计算，写入耗时按实际时间计算
+    auto wait = _clock_us > emit_us ? _clock_us - emit_us : 0;
+    _latency->record(LatencyStats::FrameToSink, wait + getMonotonicMicrosecond() - start);
+}
+
+H26xRtpDecoder &RtpReceiver::getH26xDecoder(int track_index, CodecId codec) {
+    auto &decoder = _h26x_decoder[track_index];
+    if (!decoder) {
+        decoder.reset(new H26xRtpDecoder(codec, 2 * 1024 * 1024));
+        decoder->setMemoryAccount(_account);
+        decoder->setFrameWriter(_h26x_writer[track_index]);
+    } else {
+        decoder->setCodecId(codec);
+    }
+    return *decoder;
+}
+
+const MemoryAccount::Ptr &RtpReceiver::getMemoryAccount() const {
+    return _account;
+}
+
+void RtpReceiver::syncMemory() {
+    uint64_t bytes = 0;
+    for (auto &sortor : _rtp_sortor) {
+        bytes += sortor.getCacheBytes();
+    }
+    bool ok = true;
+    if (bytes > _sort_charged) {
+        ok = _account->charge(bytes - _sort_charged);
+    } else if (bytes < _sort_charged) {
+        _account->release(_sort_charged - bytes);
+    }
+    _sort_charged = bytes;
+    if (!ok || MemoryBudget::Instance().isOver()) {
+        //排序与解码已结束，可以安全的回收
+        MemoryBudget::Instance().reclaim();
+    }
+}
+
+uint64_t RtpReceiver::onEvict(MemoryAccount::EvictLevel level) {
+    auto used = _account->getStats().used;
+    switch (level) {
+        case MemoryAccount::EvictSortBuffer:
+            //排序缓存中的包按顺序解码，不再等待乱序包
+            flush();
+            break;
+        case MemoryAccount::EvictPartialFrame:
+            for (auto &decoder : _rtp_decoder) {
+                decoder.dropFrame();
+            }
+            for (auto &decoder : _h26x_decoder) {
+                if (decoder) {
+                    decoder->dropFrame();
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    auto now = _account->getStats().used;
+    return used > now ? used - now : 0;
+}
+
+void RtpReceiver::onRtpSorted(const RtpPacket::Ptr &rtp, int track_index) {
+    TraceSpan("inputRtp");
+    auto codec = _tracks[track_index].codec;
+    if (codec == CodecInvalid && _pt_codec[rtp->PT] != CodecMax) {
+        //ps视频track按负载类型选择解码器
+        codec = _pt_codec[rtp->PT];
+    }
+    if (codec == CodecH264 || codec == CodecH265) {
+        getH26xDecoder(track_index, codec).inputRtp(rtp);
+        return;
+    }
+    _rtp_decoder[track_index].inputRtp(rtp);
 }
 
 bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate, unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len) {
+    TraceSpan("handleOneRtp");
+    PrintT("handleOneRtp");
+    ++_stats.packets;
+    uint32_t hash = 0;
+    if (checkDuplicate(track_index, rtp_raw_ptr, rtp_raw_len, hash)) {
+        return true;
+    }
+    auto rtp_ptr = parseRtp(track_index, type, samplerate, rtp_raw_ptr, rtp_raw_len);
+    if (!rtp_ptr) {
+        ++_stats.parse_errors;
+        return false;
+    }
+    _dup_filter[track_index].mark(rtp_ptr->sequence, hash);
+    rtp_ptr->arrival_us = _arrival_us;
+    onArrival(track_index, _arrival_us);
+
+    if (_interleaver) {
+        _interleaver->inputPacket(track_index);
+    }
+    //排序rtp
+    auto seq = rtp_ptr->sequence;
+    {
+        TraceSpan("sortPacket");
+        _rtp_sortor[track_index].sortPacket(seq, std::move(rtp_ptr));
+    }
+    syncMemory();
+    return true;
+}
+
+size_t RtpReceiver::handleRtpBatch(const RtpPacketDesc *descs, size_t count) {
+    TraceSpan("handleRtpBatch");
+    //预取距离
+    static const size_t kPrefetch = 4;
+    RtpPacket::Ptr packets[kMaxBatch];
+    size_t parsed = 0;
+
+    while (count) {
+        auto n = count > kMaxBatch ? kMaxBatch : count;
+        for (size_t i = 0; i < kPrefetch && i < n; ++i) {
+            __builtin_prefetch(descs[i].ptr);
+        }
+        //解析rtp头，遇到可能触发ssrc切换的包时截断，该包在下一批中第一个解析
+        {
+            TraceSpan("parseRtp");
+            for (size_t i = 0; i < n; ++i) {
+                if (i + kPrefetch < n) {
+                    __builtin_prefetch(descs[i + kPrefetch].ptr);
+                }
+                auto &desc = descs[i];
+                if (i && isSsrcMismatch(desc.track_index, desc.ptr, desc.len)) {
+                    n = i;
+                    break;
+                }
+                uint32_t hash = 0;
+                if (checkDuplicate(desc.track_index, desc.ptr, desc.len, hash)) {
+                    packets[i] = nullptr;
+                    continue;
+                }
+                packets[i] = parseRtp(desc.track_index, desc.type, desc.samplerate, desc.ptr, desc.len);
+                if (!packets[i]) {
+                    ++_stats.parse_errors;
+                    continue;
+                }
+                _dup_filter[desc.track_index].mark(packets[i]->sequence, hash);
+                packets[i]->arrival_us = desc.arrival_us;
+            }
+        }
+        _stats.packets += n;
+
+        //按输入顺序排序，两个track交织输出时的结果与批量的划分无关
+        for (size_t i = 0; i < n; ++i) {
+            if (!packets[i]) {
+                continue;
+            }
+            auto track_index = descs[i].track_index;
+            auto seq = packets[i]->sequence;
+            TraceSpan("sortPacket");
+            onArrival(track_index, descs[i].arrival_us);
+            if (_interleaver) {
+                setArrivalTime(descs[i].arrival_us);
+                _interleaver->inputPacket(track_index);
+            }
+            _rtp_sortor[track_index].sortPacket(seq, std::move(packets[i]));
+            packets[i] = nullptr;
+            ++parsed;
+        }
+
+        syncMemory();
+        descs += n;
+        count -= n;
+    }
+    return parsed;
+}
+
+bool RtpReceiver::isSsrcMismatch(int track_index, const unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len) const {
+    if (rtp_raw_len < 12 || !_ssrc[track_index] || _ssrc_fixed[track_index]) {
+        return false;
+    }
+    uint32_t ssrc;
+    memcpy(&ssrc, rtp_raw_ptr + 8, 4);
+    return ntohl(ssrc) != _ssrc[track_index];
+}
+
+bool RtpReceiver::checkDuplicate(int track_index, const unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len, uint32_t &hash) {
     if (rtp_raw_len < 12) {
-         printf("rtp包太小: %d\n", rtp_raw_len);
         return false;
     }
+    auto &filter = _dup_filter[track_index];
+    if (filter.isHashCheck()) {
+        //ssrc切换后的第一个包也需要记录摘要
+        hash = DuplicateFilter::hashPacket(rtp_raw_ptr, rtp_raw_len);
+    }
+    uint32_t ssrc;
+    memcpy(&ssrc, rtp_raw_ptr + 8, 4);
+    if (ntohl(ssrc) != _ssrc[track_index]) {
+        //ssrc的处理交给parseRtp
+        return false;
+    }
+    return filter.isDuplicate(AV_RB16(rtp_raw_ptr + 2), hash);
+}
 
-    printf("handleOneRtp\n");
+RtpPacket::Ptr RtpReceiver::parseRtp(int track_index, TrackType type, int samplerate, unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len) {
+    if (rtp_raw_len < 12) {
+        PrintW("rtp包太小: %d", rtp_raw_len);
+        return nullptr;
+    }
 
     uint32_t version = rtp_raw_ptr[0] >> 6;
     uint8_t padding = 0;
@@ -41,14 +359,17 @@ bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate,
     if (rtp_raw_ptr[0] & 0x20) {
         //获取padding大小
         padding = rtp_raw_ptr[rtp_raw_len - 1];
-        //移除padding flag
-        rtp_raw_ptr[0] &= ~0x20;
-        //移除padding字节
+        if (padding > rtp_raw_len - 12) {
+            PrintW("非法的rtp padding: %d", padding);
+            return nullptr;
+        }
+        //移除padding字节，padding flag在拷贝后移除，不修改输入数据
         rtp_raw_len -= padding;
     }
 
     if (version != 2) {
-        throw std::invalid_argument("非法的rtp，version != 2");
+        PrintW("非法的rtp，version != 2");
+        return nullptr;
     }
 
     auto rtp_ptr = _rtp_pool.obtain();
@@ -69,7 +390,7 @@ bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate,
 
     if (!samplerate) {
         //无法把时间戳转换成毫秒
-        return false;
+        return nullptr;
     }
     //时间戳转换成毫秒
     rtp.timeStamp = rtp.timeStamp * 1000LL / samplerate;
@@ -77,6 +398,25 @@ bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate,
     //ssrc,内存对齐
     memcpy(&rtp.ssrc, rtp_raw_ptr + 8, 4);
     rtp.ssrc = ntohl(rtp.ssrc);
+    if (_ssrc[track_index] != rtp.ssrc) {
+        if (_ssrc[track_index] == 0) {
+            //锁定第一个包的ssrc
+            _ssrc[track_index] = rtp.ssrc;
+        } else {
+            ++_stats.ssrc_errors;
+            PrintT("ssrc错误:%u != %u", rtp.ssrc, _ssrc[track_index]);
+            if (!_ssrc_fixed[track_index] && _ssrc_err_count[track_index]++ > kMaxSsrcErrors) {
+                //ssrc切换后清除老数据
+                PrintW("ssrc更换:%u -> %u", _ssrc[track_index], rtp.ssrc);
+                _rtp_sortor[track_index].clear();
+                _dup_filter[track_index].clear();
+                _ssrc[track_index] = rtp.ssrc;
+            }
+            return nullptr;
+        }
+    }
+    //ssrc匹配正确，不匹配计数清零
+    _ssrc_err_count[track_index] = 0;
 
 
 
@@ -90,13 +430,13 @@ bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate,
     }
 
     if (rtp_raw_len + 4 <= rtp.offset) {
-        printf("无有效负载的rtp包:%d <= %d\n", rtp_raw_len, (int) rtp.offset);
-        return false;
+        PrintW("无有效负载的rtp包:%d <= %d", rtp_raw_len, (int) rtp.offset);
+        return nullptr;
     }
 
     if (rtp_raw_len > RTP_MAX_SIZE) {
-        printf("超大的rtp包::%d > %d\n", rtp_raw_len, RTP_MAX_SIZE);
-        return false;
+        PrintW("超大的rtp包::%d > %d", rtp_raw_len, RTP_MAX_SIZE);
+        return nullptr;
     }
 
     //设置rtp负载长度
@@ -109,10 +449,164 @@ bool RtpReceiver::handleOneRtp(int track_index, TrackType type, int samplerate,
     payload_ptr[3] = (rtp_raw_len & 0x00FF);
     //拷贝rtp负载
     memcpy(payload_ptr + 4, rtp_raw_ptr, rtp_raw_len);
+    //移除padding flag
+    payload_ptr[4] &= ~0x20;
+    return std::move(rtp_ptr);
+}
 
-    //排序rtp
-    auto seq = rtp_ptr->sequence;
-    _rtp_sortor[track_index].sortPacket(seq, std::move(rtp_ptr));
+void RtpReceiver::flush() {
+    for (auto &sortor : _rtp_sortor) {
+        sortor.flush();
+    }
+    if (_interleaver) {
+        _interleaver->flush();
+    }
+    syncMemory();
+}
+
+void RtpReceiver::flushTrack(int track_index) {
+    _rtp_sortor[track_index].flush();
+    _rtp_decoder[track_index].flushFrame();
+    if (_h26x_decoder[track_index]) {
+        _h26x_decoder[track_index]->flushFrame();
+    }
+}
+
+void RtpReceiver::flushFrames() {
+    for (int track_index = 0; track_index < 2; ++track_index) {
+        flushTrack(track_index);
+    }
+    if (_interleaver) {
+        _interleaver->flush();
+    }
+    syncMemory();
+}
+
+void RtpReceiver::setMarkerFlush(bool enable) {
+    for (auto &decoder : _rtp_decoder) {
+        decoder.setMarkerFlush(enable);
+    }
+}
+
+void RtpReceiver::setIdleTimeout(uint32_t ms) {
+    _idle_timeout_us = ms * 1000ULL;
+}
+
+void RtpReceiver::checkIdle(uint64_t now_us) {
+    if (!_idle_timeout_us) {
+        return;
+    }
+    if (now_us > _clock_us) {
+        _clock_us = now_us;
+    }
+    bool flushed = false;
+    bool all_idle = true;
+    for (int track_index = 0; track_index < 2; ++track_index) {
+        if (_tracks[track_index].type == TrackInvalid) {
+            continue;
+        }
+        if (!_track_idle[track_index] && now_us >= _last_arrival_us[track_index] + _idle_timeout_us) {
+            flushTrack(track_index);
+            _track_idle[track_index] = true;
+            flushed = true;
+        }
+        all_idle = all_idle && _track_idle[track_index];
+    }
+    if (flushed) {
+        if (all_idle && _interleaver) {
+            _interleaver->flush();
+        }
+        syncMemory();
+    }
+}
+
+void RtpReceiver::setSsrc(int track_index, uint32_t ssrc) {
+    _ssrc[track_index] = ssrc;
+    _ssrc_fixed[track_index] = ssrc != 0;
+    _ssrc_err_count[track_index] = 0;
+    _dup_filter[track_index].clear();
+}
+
+const RtpReceiver::Stats &RtpReceiver::getStats() const {
+    _stats.duplicates = 0;
+    _stats.hash_mismatches = 0;
+    for (auto &filter : _dup_filter) {
+        _stats.duplicates += filter.getStats().duplicates;
+        _stats.hash_mismatches += filter.getStats().hash_mismatches;
+    }
+    return _stats;
+}
+
+void RtpReceiver::setDuplicateHash(bool enable) {
+    for (auto &filter : _dup_filter) {
+        filter.setHashCheck(enable);
+    }
+}
+
+void RtpReceiver::saveState(CheckpointWriter &writer) const {
+    for (int track_index = 0; track_index < 2; ++track_index) {
+        auto &track = _tracks[track_index];
+        writer.write(track.type);
+        writer.write(track.codec);
+        writer.write(_ssrc[track_index]);
+        writer.write(_ssrc_err_count[track_index]);
+        _dup_filter[track_index].saveState(writer);
+        _rtp_sortor[track_index].saveState(writer, [](CheckpointWriter &writer, const RtpPacket::Ptr &rtp) {
+            Checkpoint::saveRtp(writer, *rtp);
+        });
+        _rtp_decoder[track_index].saveState(writer);
+        auto &h26x = _h26x_decoder[track_index];
+        writer.write(h26x ? h26x->getCodecId() : CodecInvalid);
+        if (h26x) {
+            h26x->saveState(writer);
+        }
+    }
+    writer.write(_stats.packets);
+    writer.write(_stats.parse_errors);
+    writer.write(_stats.ssrc_errors);
+    writer.write(_last_arrival_us);
+    writer.write(_track_idle);
+    writer.write((bool) _interleaver);
+    if (_interleaver) {
+        _interleaver->saveState(writer);
+    }
+}
+
+bool RtpReceiver::loadState(CheckpointReader &reader) {
+    for (int track_index = 0; track_index < 2; ++track_index) {
+        auto &track = _tracks[track_index];
+        TrackType type;
+        CodecId codec;
+        if (!reader.read(type) || !reader.read(codec)) {
+            return false;
+        }
+        if (type != track.type || codec != track.codec) {
+            PrintE("track%d参数与断点不一致", track_index);
+            return false;
+        }
+        CodecId h26x;
+        auto load_rtp = [this](CheckpointReader &reader, RtpPacket::Ptr &rtp) {
+            rtp = _rtp_pool.obtain();
+            return Checkpoint::loadRtp(reader, *rtp);
+        };
+        if (!reader.read(_ssrc[track_index]) || !reader.read(_ssrc_err_count[track_index])
+            || !_dup_filter[track_index].loadState(reader) || !_rtp_sortor[track_index].loadState(reader, load_rtp)
+            || !_rtp_decoder[track_index].loadState(reader) || !reader.read(h26x)) {
+            return false;
+        }
+        if (h26x != CodecInvalid && !getH26xDecoder(track_index, h26x).loadState(reader)) {
+            return false;
+        }
+    }
+    bool interleaved;
+    if (!reader.read(_stats.packets) || !reader.read(_stats.parse_errors) || !reader.read(_stats.ssrc_errors)
+        || !reader.read(_last_arrival_us) || !reader.read(_track_idle) || !reader.read(interleaved)) {
+        return false;
+    }
+    if (interleaved != (bool) _interleaver || (_interleaver && !_interleaver->loadState(reader))) {
+        return false;
+    }
+    syncMemory();
     return true;
 }
 
@@ -120,6 +614,7 @@ void RtpReceiver::clear() {
     for (auto &sortor : _rtp_sortor) {
         sortor.clear();
     }
+    syncMemory();
 }
 
 void RtpReceiver::setPoolSize(int size) {
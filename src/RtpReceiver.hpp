@@ -7,6 +7,13 @@
 #include <stdexcept>
 #include "ResourcePool.h"
 #include "CommonRtp.h"
+#include "MemoryBudget.h"
+#include "PsInterleaver.h"
+#include "PsMuxer.h"
+#include "H26xRtp.h"
+#include "DuplicateFilter.h"
+#include "Checkpoint.h"
+#include "LatencyStats.h"
 
 
 
@@ -22,7 +29,7 @@ public:
     ~PacketSortor() = default;
 
     void setOnSort(function<void(SEQ seq, T &packet)> cb) {
-        printf("setOnSort\n");
+        PrintT("setOnSort");
         _cb = std::move(cb);
     }
 
@@ -34,6 +41,7 @@ public:
         _rtp_sort_cache_map.clear();
         _next_seq_out = 0;
         _max_sort_size = kMin;
+        _cache_bytes = 0;
     }
 
     /**
@@ -50,13 +58,20 @@ public:
         return _seq_cycle_count;
     }
 
+    /**
+     * 获取排序缓存中数据的字节数
+     */
+    uint64_t getCacheBytes() const {
+        return _cache_bytes;
+    }
+
     /**
      * 输入并排序
      * @param seq 序列号
      * @param packet 包负载
      */
     void sortPacket(SEQ seq, T packet) {
-        printf("sortPacket   seq : %d\n", seq);
+        PrintT("sortPacket   seq : %d", seq);
         if (seq < _next_seq_out) {
             if (_next_seq_out - seq < kMax) {
                 //过滤seq回退包(回环包除外)
@@ -68,22 +83,64 @@ public:
         }
 
         //放入排序缓存，使用map来排序
-        _rtp_sort_cache_map.emplace(seq, std::move(packet)); 
+        auto bytes = packet->size();
+        if (_rtp_sort_cache_map.emplace(seq, std::move(packet)).second) {
+            _cache_bytes += bytes;
+        }
         //尝试输出排序后的包
         tryPopPacket();
     }
 
     void flush(){
-        printf("flush\n");
+        PrintT("flush");
         //清空缓存
         while (!_rtp_sort_cache_map.empty()) {
             popIterator(_rtp_sort_cache_map.begin());
         }
     }
 
+    /**
+     * 保存排序状态与缓存中的包，用于断点续传
+     * @param save 包的保存函数，参数为(writer, packet)
+     */
+    template<typename SavePacket>
+    void saveState(CheckpointWriter &writer, SavePacket &&save) const {
+        writer.write(_next_seq_out);
+        writer.write(_seq_cycle_count);
+        writer.write(_max_sort_size);
+        writer.write((uint32_t) _rtp_sort_cache_map.size());
+        for (auto &pr : _rtp_sort_cache_map) {
+            writer.write(pr.first);
+            save(writer, pr.second);
+        }
+    }
+
+    /**
+     * 恢复saveState()保存的状态
+     * @param load 包的恢复函数，参数为(reader, packet)，失败返回false
+     */
+    template<typename LoadPacket>
+    bool loadState(CheckpointReader &reader, LoadPacket &&load) {
+        clear();
+        uint32_t count;
+        if (!reader.read(_next_seq_out) || !reader.read(_seq_cycle_count) || !reader.read(_max_sort_size) || !reader.read(count)) {
+            return false;
+        }
+        for (uint32_t i = 0; i < count; ++i) {
+            SEQ seq;
+            T packet;
+            if (!reader.read(seq) || !load(reader, packet)) {
+                return false;
+            }
+            _cache_bytes += packet->size();
+            _rtp_sort_cache_map.emplace(seq, std::move(packet));
+        }
+        return true;
+    }
+
 private:
     void popPacket() {
-        printf("realpopPacket\n");
+        PrintT("realpopPacket");
         auto it = _rtp_sort_cache_map.begin();
         if (it->first >= _next_seq_out) {
             //过滤回跳包
@@ -102,6 +159,7 @@ private:
             auto hit = _rtp_sort_cache_map.upper_bound((SEQ) (_next_seq_out - _rtp_sort_cache_map.size()));
             while (hit != _rtp_sort_cache_map.end()) {
                 //回环前，清空剩余的大的SEQ的数据
+                _cache_bytes -= hit->second->size();
                 _cb(hit->first, hit->second);
                 hit = _rtp_sort_cache_map.erase(hit);
             }
@@ -110,18 +168,20 @@ private:
             return;
         }
         //删除回跳的数据包
+        _cache_bytes -= it->second->size();
         _rtp_sort_cache_map.erase(it);
     }
 
     void popIterator(typename map<SEQ, T>::iterator it) {
-        printf("popIterator\n");
+        PrintT("popIterator");
+        _cache_bytes -= it->second->size();
         _cb(it->first, it->second);
         _next_seq_out = it->first + 1;
         _rtp_sort_cache_map.erase(it);
     }
 
     void tryPopPacket() {
-        printf("tryPopPacket\n");
+        PrintT("tryPopPacket");
         int count = 0;
         while ((!_rtp_sort_cache_map.empty() && _rtp_sort_cache_map.begin()->first == _next_seq_out)) {
             //找到下个包，直接输出
@@ -139,7 +199,7 @@ private:
     }
 
     void setSortSize() {
-        printf("setSortSize\n");
+        PrintT("setSortSize");
         _max_sort_size = kMin + _rtp_sort_cache_map.size();
         if (_max_sort_size > kMax) {
             _max_sort_size = kMax;
@@ -155,15 +215,181 @@ private:
     uint32_t _max_sort_size = kMin;  // 默认为10
     //rtp排序缓存，使用map，根据seq排序
     map<SEQ, T> _rtp_sort_cache_map;
+    //排序缓存中数据的字节数
+    uint64_t _cache_bytes = 0;
     //回调
     function<void(SEQ seq, T &packet)> _cb;
 };
 
+/**
+ * 批量输入时单个rtp包的描述
+ */
+struct RtpPacketDesc {
+    //track下标索引
+    int track_index;
+    //track类型
+    TrackType type;
+    //rtp时间戳基准时钟
+    int samplerate;
+    //rtp数据指针，批量处理完成前必须有效
+    unsigned char *ptr;
+    //rtp数据长度
+    unsigned int len;
+    //到达时间，微秒，排序前设置，交织输出的结果与批量的划分无关
+    uint64_t arrival_us;
+};
+
 class RtpReceiver {
 public:
+    struct Stats {
+        //输入的rtp包数
+        uint64_t packets = 0;
+        //解析失败的rtp包数，包括ssrc不匹配的包
+        uint64_t parse_errors = 0;
+        //ssrc不匹配的rtp包数
+        uint64_t ssrc_errors = 0;
+        //丢弃的重复包数，不计入解析失败
+        uint64_t duplicates = 0;
+        //序列号重复但负载不同的包数，开启负载哈希时统计
+        uint64_t hash_mismatches = 0;
+    };
+
+    //track参数
+    struct TrackConfig {
+        //TrackInvalid表示未使用
+        TrackType type = TrackInvalid;
+        //编码类型，CodecInvalid为ps流
+        CodecId codec = CodecInvalid;
+        //rtp时间戳基准时钟
+        int samplerate = 0;
+        //音频声道数
+        int channels = 1;
+    };
+
+    //h264/h265的输出格式
+    typedef enum {
+        //封装为ps流
+        OutputPs = 0,
+        //Annex-B裸流
+        OutputEs,
+    } OutputFormat;
+
+    //连续多少个ssrc不匹配的包后切换到新的ssrc
+    static const uint32_t kMaxSsrcErrors = 10;
+
+    //单次批量处理的最大包数
+    static const size_t kMaxBatch = 64;
+
     RtpReceiver();
     virtual ~RtpReceiver();
 
+    /**
+     * 设置解码后帧的输出目标，这是流水线中唯一的虚函数边界
+     */
+    void setFrameWriter(const FrameWriterInterface::Ptr &writer);
+
+    /**
+     * 本流的内存账户，记录排序缓存与未完成帧占用的内存
+     */
+    const MemoryAccount::Ptr &getMemoryAccount() const;
+
+    /**
+     * 不再等待乱序包，排序缓存中的包按顺序解码输出
+     */
+    void flush();
+
+    /**
+     * 输入结束：不再等待乱序包，输出全部未完成的帧与交织缓存
+     */
+    void flushFrames();
+
+    /**
+     * 收到marker位的包时立即输出ps流与音频帧，不再等待下一帧的第一个包，减少一帧间隔的延迟；
+     * h264/h265总是按marker位输出
+     */
+    void setMarkerFlush(bool enable);
+
+    /**
+     * 设置空闲超时，track超过该时间没有收到包时输出其未完成的帧，全部track都空闲时同时输出交织缓存
+     * 每个包输入前按其到达时间检查，没有输入时由checkIdle()检查
+     * @param ms 超时时间，毫秒，0为不检查
+     */
+    void setIdleTimeout(uint32_t ms);
+
+    uint32_t getIdleTimeout() const {
+        return (uint32_t) (_idle_timeout_us / 1000);
+    }
+
+    /**
+     * 检查空闲超时，由定时器调用
+     * @param now_us 当前时间，微秒，与到达时间使用同一时钟
+     */
+    void checkIdle(uint64_t now_us);
+
+    /**
+     * 开启端到端时延统计：rtp包到达到帧被解码器输出，以及帧被输出到写入输出
+     * 时间使用包的到达时间(setArrivalTime)的时钟，空闲超时输出的帧使用checkIdle()的时间
+     * @param stats 为空时关闭
+     */
+    void setLatencyStats(const LatencyStats::Ptr &stats);
+
+    const LatencyStats::Ptr &getLatencyStats() const;
+
+    /**
+     * 指定track的ssrc，不匹配的包被丢弃，不会自动切换到新的ssrc
+     * 未指定时锁定第一个包的ssrc，连续kMaxSsrcErrors个不匹配的包后切换
+     * @param track_index track下标索引
+     * @param ssrc 为0时恢复为自动锁定
+     */
+    void setSsrc(int track_index, uint32_t ssrc);
+
+    const Stats &getStats() const;
+
+    /**
+     * 重复包过滤同时比较负载摘要，用于多个源使用相同ssrc的场景
+     */
+    void setDuplicateHash(bool enable);
+
+    /**
+     * 设置track参数，默认只有track 0为ps视频流；
+     * 两个track都使用时，两路帧按时间戳交织输出到同一个ps流中
+     * @param track_index track下标索引
+     * @param config track参数
+     */
+    void setTrack(int track_index, const TrackConfig &config);
+
+    const TrackConfig &getTrack(int track_index) const;
+
+    /**
+     * 设置当前数据的到达时间，两个track以各自第一帧的到达时间对齐
+     */
+    void setArrivalTime(uint64_t us);
+
+    /**
+     * 指定rtp负载类型对应的编码，只对编码为ps(CodecInvalid)的视频track生效
+     * 默认按GB28181的约定：98为h264，100为h265，其他为ps
+     * @param pt 负载类型
+     * @param codec CodecH264/CodecH265，CodecInvalid为ps
+     */
+    void setPayloadType(uint8_t pt, CodecId codec);
+
+    /**
+     * 设置h264/h265的输出格式，默认封装为ps流；与音频交织输出时总是封装为ps流
+     */
+    void setOutputFormat(OutputFormat format);
+
+    /**
+     * 保存排序缓存、未完成帧、交织缓存以及ssrc等全部流状态，用于断点续传
+     * 调用前批量缓存中的包必须已经处理
+     */
+    void saveState(CheckpointWriter &writer) const;
+
+    /**
+     * 恢复saveState()保存的状态，track参数与输出格式必须与保存时一致
+     * @return 数据损坏或者参数不一致时返回false
+     */
+    bool loadState(CheckpointReader &reader);
+
 protected:
     /**
      * 输入数据指针生成并排序rtp包
@@ -176,6 +402,18 @@ protected:
      */
     bool handleOneRtp(int track_index, TrackType type, int samplerate, unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len);
 
+    /**
+     * 批量输入rtp包
+     * 先在一个循环内解析全部rtp头(预取后续包的数据)，再按输入顺序依次排序和解码，减少单包调用开销；
+     * 一个接收器只有视频与音频两个track，只有一个track时按输入顺序即按track分组，两个track时交织输出需要按输入顺序，
+     * 每个包排序前设置其到达时间，输出与批量的划分无关；
+     * ssrc不匹配的包可能触发ssrc切换并清空排序缓存，在该包处把批量拆开，之前的包先排序，避免老ssrc的包进入切换后的排序缓存
+     * @param descs rtp包描述数组
+     * @param count 数组长度
+     * @return 解析成功的包数
+     */
+    size_t handleRtpBatch(const RtpPacketDesc *descs, size_t count);
+
     /**
      * rtp数据包排序后输出
      * @param rtp rtp数据包
@@ -188,14 +426,112 @@ protected:
     int getJitterSize(int track_index);
     int getCycleCount(int track_index);
 
+private:
+    /**
+     * 在解析与拷贝之前检查重复包，只检查ssrc已锁定的包
+     * @param hash 返回负载摘要，记录序列号时使用
+     */
+    bool checkDuplicate(int track_index, const unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len, uint32_t &hash);
+
+    /**
+     * 是否为可能触发ssrc切换的包，即ssrc已锁定且未固定时ssrc不匹配的包
+     */
+    bool isSsrcMismatch(int track_index, const unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len) const;
+
+    /**
+     * 解析rtp头并拷贝到rtp包对象
+     * @return 解析失败返回nullptr
+     */
+    RtpPacket::Ptr parseRtp(int track_index, TrackType type, int samplerate, unsigned char *rtp_raw_ptr, unsigned int rtp_raw_len);
+
+    /**
+     * 根据track参数设置解码器的输出目标
+     */
+    void updateWriter();
+
+    /**
+     * 获取h264/h265解码器，第一次使用时创建
+     */
+    H26xRtpDecoder &getH26xDecoder(int track_index, CodecId codec);
+
+    /**
+     * 同步排序缓存的记账，超过内存预算时触发回收
+     */
+    void syncMemory();
+
+    /**
+     * 排序缓存按顺序解码后输出track未完成的帧
+     */
+    void flushTrack(int track_index);
+
+    /**
+     * 记录track收到包的到达时间，开启空闲超时时先检查其他track是否空闲
+     */
+    void onArrival(int track_index, uint64_t arrival_us) {
+        _clock_us = arrival_us;
+        if (_idle_timeout_us) {
+            checkIdle(arrival_us);
+            _last_arrival_us[track_index] = arrival_us;
+            _track_idle[track_index] = false;
+        }
+    }
+
+    /**
+     * 内存回收回调
+     */
+    uint64_t onEvict(MemoryAccount::EvictLevel level);
+
+    /**
+     * 帧被解码器输出，统计包到帧的时延并记录输出时间
+     */
+    void onFrameEmit(const Frame::Ptr &frame);
+
+    /**
+     * 帧写入输出，统计帧到输出的时延
+     */
+    void onFrameSink(const Frame::Ptr &frame, const FrameWriterInterface::Ptr &writer);
+
 private:
     uint32_t _ssrc[2] = {0, 0};
     //ssrc不匹配计数
     uint32_t _ssrc_err_count[2] = {0, 0};
+    //ssrc由使用者指定，不自动切换
+    bool _ssrc_fixed[2] = {false, false};
+    //重复包过滤
+    DuplicateFilter _dup_filter[2];
     //rtp排序缓存，根据seq排序
     PacketSortor<RtpPacket::Ptr> _rtp_sortor[2];
     //rtp循环池
     ResourcePool<RtpPacket> _rtp_pool;
-    std::shared_ptr<CommonRtpDecoder> _rtp_decoder;
+    //每个track一个解码器
+    CommonRtpDecoder _rtp_decoder[2];
+    //负载类型为h264/h265时使用的解码器
+    std::unique_ptr<H26xRtpDecoder> _h26x_decoder[2];
+    TrackConfig _tracks[2];
+    //负载类型对应的编码，CodecMax为未指定
+    CodecId _pt_codec[128];
+    OutputFormat _format = OutputPs;
+    FrameWriterInterface::Ptr _writer;
+    //h264/h265解码器的输出目标
+    FrameWriterInterface::Ptr _h26x_writer[2];
+    //两个track都使用时的交织输出
+    PsInterleaver::Ptr _interleaver;
+    MemoryAccount::Ptr _account;
+    //已记账的排序缓存字节数
+    uint64_t _sort_charged = 0;
+    //空闲超时，微秒，0为不检查
+    uint64_t _idle_timeout_us = 0;
+    //当前数据的到达时间，微秒
+    uint64_t _arrival_us = 0;
+    //各track最后收到包的到达时间
+    uint64_t _last_arrival_us[2] = {0, 0};
+    //track已空闲超时，未完成的帧已输出
+    bool _track_idle[2] = {true, true};
+    //时延统计，为空时不统计
+    LatencyStats::Ptr _latency;
+    //时延统计的当前时间，最近的到达时间或空闲检查时间
+    uint64_t _clock_us = 0;
+    //重复包统计在获取时从过滤器汇总
+    mutable Stats _stats;
 };
 }
\ No newline at end of file
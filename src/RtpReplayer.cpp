@@ -0,0 +1,206 @@
+#include "RtpReplayer.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "Logger.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//单次sendmmsg最多发送的包数
+static const uint32_t kSendBatch = 64;
+//每个socket批量缓存的大小，可以容纳最大的udp包
+static const uint32_t kBatchBuffer = 256 * 1024;
+//晚于计划时间超过该值的包计入late
+static const uint64_t kLateUs = 1000;
+
+static uint64_t getMonotonicMicrosecond() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+RtpReplayer::RtpReplayer(const Config &config) {
+    _config = config;
+    if (!_config.copies) {
+        _config.copies = 1;
+    }
+    if (!_config.sockets) {
+        _config.sockets = 1;
+    }
+    if (_config.sockets > _config.copies) {
+        //多余的socket不会被使用
+        _config.sockets = _config.copies;
+    }
+    memset(&_dst_addr, 0, sizeof(_dst_addr));
+}
+
+RtpReplayer::~RtpReplayer() {
+    for (auto &batch : _batches) {
+        if (batch.fd >= 0) {
+            close(batch.fd);
+        }
+    }
+}
+
+int RtpReplayer::start() {
+    if (inet_pton(AF_INET, _config.dst_ip.c_str(), &_dst_addr) != 1) {
+        PrintE("非法的目标ip:%s", _config.dst_ip.c_str());
+        return -EINVAL;
+    }
+    _batches.resize(_config.sockets);
+    for (auto &batch : _batches) {
+        batch.fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (batch.fd < 0) {
+            int err = errno;
+            PrintE("创建socket失败:%s", strerror(err));
+            return -err;
+        }
+        int size = (int) _config.send_buffer;
+        setsockopt(batch.fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+
+        batch.msgs.resize(kSendBatch);
+        batch.iovs.resize(kSendBatch);
+        batch.addrs.resize(kSendBatch);
+        batch.buffer.resize(kBatchBuffer);
+        memset(batch.msgs.data(), 0, kSendBatch * sizeof(struct mmsghdr));
+        for (uint32_t i = 0; i < kSendBatch; ++i) {
+            auto &addr = batch.addrs[i];
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr = _dst_addr;
+            auto &hdr = batch.msgs[i].msg_hdr;
+            hdr.msg_name = &addr;
+            hdr.msg_namelen = sizeof(addr);
+            hdr.msg_iov = &batch.iovs[i];
+            hdr.msg_iovlen = 1;
+        }
+    }
+    return 0;
+}
+
+void RtpReplayer::stop() {
+    _exit = true;
+}
+
+void RtpReplayer::waitUntil(uint64_t arrival_us) {
+    auto offset = arrival_us > _first_arrival_us ? arrival_us - _first_arrival_us : 0;
+    auto due = _first_send_us + (uint64_t) (offset / _config.speed);
+    auto now = getMonotonicMicrosecond();
+    if (due > now) {
+        //先发出已到期的包再等待
+        flush();
+        struct timespec ts;
+        ts.tv_sec = due / 1000000;
+        ts.tv_nsec = (due % 1000000) * 1000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR && !_exit) {
+        }
+        now = getMonotonicMicrosecond();
+    }
+    if (now > due) {
+        auto lag = now - due;
+        if (lag > _stats.max_lag_us) {
+            _stats.max_lag_us = lag;
+        }
+        if (lag > kLateUs) {
+            ++_stats.late;
+        }
+    }
+}
+
+void RtpReplayer::inputPacket(uint16_t dst_port, uint64_t arrival_us, const char *rtp, uint32_t len) {
+    if (_exit || _batches.empty() || len > kBatchBuffer) {
+        return;
+    }
+    if (!_started) {
+        _started = true;
+        _first_arrival_us = arrival_us;
+        _first_send_us = _last_send_us = getMonotonicMicrosecond();
+    } else if (_config.speed > 0) {
+        waitUntil(arrival_us);
+        if (_exit) {
+            return;
+        }
+    }
+
+    uint32_t ssrc = 0;
+    if (len >= 12) {
+        memcpy(&ssrc, rtp + 8, 4);
+        ssrc = ntohl(ssrc);
+    }
+    uint16_t base_port = _config.dst_port ? _config.dst_port : dst_port;
+    for (uint32_t k = 0; k < _config.copies; ++k) {
+        auto &batch = _batches[k % _batches.size()];
+        if (batch.count == kSendBatch || batch.used + len > kBatchBuffer) {
+            flushBatch(batch);
+        }
+        auto ptr = batch.buffer.data() + batch.used;
+        memcpy(ptr, rtp, len);
+        if (len >= 12 && k && _config.ssrc_step) {
+            uint32_t value = htonl(ssrc + k * _config.ssrc_step);
+            memcpy(ptr + 8, &value, 4);
+        }
+        batch.iovs[batch.count].iov_base = ptr;
+        batch.iovs[batch.count].iov_len = len;
+        batch.addrs[batch.count].sin_port = htons((uint16_t) (base_port + k * _config.port_step));
+        batch.used += len;
+        ++batch.count;
+    }
+}
+
+void RtpReplayer::flush() {
+    for (auto &batch : _batches) {
+        flushBatch(batch);
+    }
+}
+
+void RtpReplayer::flushBatch(Batch &batch) {
+    if (!batch.count) {
+        return;
+    }
+    TraceSpan("sendmmsg");
+    uint32_t offset = 0;
+    while (offset < batch.count) {
+        int n = sendmmsg(batch.fd, batch.msgs.data() + offset, batch.count - offset, 0);
+        ++_stats.sends;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                //发送缓存满，等待后重试
+                struct pollfd pfd = {batch.fd, POLLOUT, 0};
+                poll(&pfd, 1, 1);
+                continue;
+            }
+            if (!_stats.errors) {
+                PrintW("发送失败:%s", strerror(errno));
+            }
+            //丢弃失败的包，继续发送之后的包
+            ++_stats.errors;
+            ++offset;
+            continue;
+        }
+        for (int i = 0; i < n; ++i) {
+            _stats.bytes += batch.msgs[offset + i].msg_len;
+        }
+        _stats.packets += n;
+        offset += n;
+    }
+    batch.count = 0;
+    batch.used = 0;
+    _last_send_us = getMonotonicMicrosecond();
+}
+
+RtpReplayer::Stats RtpReplayer::getStats() const {
+    Stats stats = _stats;
+    stats.duration_us = _last_send_us - _first_send_us;
+    return stats;
+}
+
+}//namespace mediakit
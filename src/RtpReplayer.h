@@ -0,0 +1,125 @@
+#ifndef RTP2PS_RTPREPLAYER_H
+#define RTP2PS_RTPREPLAYER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace mediakit{
+
+/**
+ * 按抓包时间回放rtp流，用于本机对实时接收(服务模式)压测
+ * 每个rtp包按原始时间间隔(或N倍速、不限速)通过udp发出，可以复制成多份：
+ * 第k份的ssrc加上k*ssrc_step，目标端口加上k*port_step，轮流使用多个socket(源端口不同)，
+ * 一份抓包即可模拟大量不同的流；
+ * 到期的包先放入每个socket的批量缓存，在需要等待下一个包或缓存满时由sendmmsg一次发出
+ */
+class RtpReplayer {
+public:
+    typedef std::shared_ptr<RtpReplayer> Ptr;
+
+    struct Config {
+        //目标ip
+        std::string dst_ip = "127.0.0.1";
+        //目标端口，0为使用抓包中的目的端口
+        uint16_t dst_port = 0;
+        //第k份的目标端口加上k*port_step，0为全部发往同一端口(服务模式的ssrc复用端口)
+        uint16_t port_step = 0;
+        //每个流复制的份数
+        uint32_t copies = 1;
+        //第k份的ssrc加上k*ssrc_step
+        uint32_t ssrc_step = 1;
+        //发送socket个数，第k份使用第k%sockets个socket
+        uint32_t sockets = 8;
+        //回放速度倍数，0为不限速
+        double speed = 1.0;
+        //socket发送缓存大小
+        uint32_t send_buffer = 4 * 1024 * 1024;
+    };
+
+    struct Stats {
+        //发出的包数
+        uint64_t packets = 0;
+        //发出的字节数
+        uint64_t bytes = 0;
+        //sendmmsg调用次数
+        uint64_t sends = 0;
+        //发送失败而丢弃的包数
+        uint64_t errors = 0;
+        //晚于计划时间1ms以上发出的包数
+        uint64_t late = 0;
+        //最大延迟，微秒
+        uint64_t max_lag_us = 0;
+        //第一个包到最后一个包的发送耗时，微秒
+        uint64_t duration_us = 0;
+    };
+
+    RtpReplayer(const Config &config);
+    ~RtpReplayer();
+
+    RtpReplayer(const RtpReplayer &) = delete;
+    RtpReplayer &operator=(const RtpReplayer &) = delete;
+
+    /**
+     * 创建socket
+     * @return 成功返回0，失败返回-errno
+     */
+    int start();
+
+    /**
+     * 输入一个rtp包，到期前等待，每份拷贝后放入批量缓存
+     * @param dst_port 抓包中的目的端口
+     * @param arrival_us 抓包时间，微秒
+     */
+    void inputPacket(uint16_t dst_port, uint64_t arrival_us, const char *rtp, uint32_t len);
+
+    /**
+     * 发出全部批量缓存中的包
+     */
+    void flush();
+
+    /**
+     * 停止回放，之后输入的包被忽略，可以在其他线程调用
+     */
+    void stop();
+
+    Stats getStats() const;
+
+private:
+    struct Batch {
+        int fd = -1;
+        uint32_t count = 0;
+        //缓存中已使用的字节数
+        uint32_t used = 0;
+        std::vector<struct mmsghdr> msgs;
+        std::vector<struct iovec> iovs;
+        std::vector<struct sockaddr_in> addrs;
+        std::vector<char> buffer;
+    };
+
+    void flushBatch(Batch &batch);
+
+    /**
+     * 等待到包的计划发送时间
+     */
+    void waitUntil(uint64_t arrival_us);
+
+private:
+    Config _config;
+    struct in_addr _dst_addr;
+    std::atomic<bool> _exit{false};
+    bool _started = false;
+    //第一个包的抓包时间与发送时间
+    uint64_t _first_arrival_us = 0;
+    uint64_t _first_send_us = 0;
+    uint64_t _last_send_us = 0;
+    std::vector<Batch> _batches;
+    Stats _stats;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_RTPREPLAYER_H
@@ -0,0 +1,659 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <sstream>
+#include "RtpServer.h"
+#include "RtpReceiver.hpp"
+#include "Logger.h"
+#include "Trace.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//单次recvmmsg最多接收的包数
+static const int kRecvBatch = 64;
+//单次可读事件中最多调用recvmmsg的次数，避免一个socket长期占用poller
+static const int kMaxRecvRounds = 16;
+
+static uint64_t getCurrentMicrosecond() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static inline uint32_t readSsrc(const char *rtp) {
+    uint32_t ssrc;
+    memcpy(&ssrc, rtp + 8, 4);
+    return ntohl(ssrc);
+}
+
+/**
+ * 服务模式下的单个流，只在负责它的poller线程中访问
+ */
+class RtpSession : public RtpReceiver {
+public:
+    RtpSession(const string &name, uint32_t ssrc) {
+        getMemoryAccount()->setName(name);
+        if (ssrc) {
+            setSsrc(0, ssrc);
+        }
+    }
+
+    ~RtpSession() override {
+        //会话结束，输出最后一帧
+        flushFrames();
+        if (getLatencyStats()) {
+            getLatencyStats()->report(getMemoryAccount()->getName());
+        }
+    }
+
+    void inputRtp(char **packets, uint32_t *lens, int count, uint64_t now_us) {
+        getMemoryAccount()->touch(now_us);
+        RtpPacketDesc descs[kMaxBatch];
+        while (count > 0) {
+            int n = count > (int) kMaxBatch ? (int) kMaxBatch : count;
+            for (int i = 0; i < n; ++i) {
+                auto &desc = descs[i];
+                desc.track_index = 0;
+                desc.type = TrackVideo;
+                desc.samplerate = 90000;
+                desc.ptr = (unsigned char *) packets[i];
+                desc.len = lens[i];
+                desc.arrival_us = now_us;
+            }
+            handleRtpBatch(descs, n);
+            packets += n;
+            lens += n;
+            count -= n;
+        }
+    }
+};
+
+RtpServer::RtpServer(const Config &config) {
+    _config = config;
+    if (!_config.pollers) {
+        auto count = sysconf(_SC_NPROCESSORS_ONLN);
+        _config.pollers = count > 0 ? count : 1;
+    }
+}
+
+RtpServer::~RtpServer() {
+    stop();
+}
+
+void RtpServer::setOnCreateOutput(onCreateOutput cb) {
+    _create_output = std::move(cb);
+}
+
+int RtpServer::createUdpSocket(uint16_t port, bool reuse_port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    int on = 1;
+    if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        auto err = -errno;
+        close(fd);
+        return err;
+    }
+    int size = _config.recv_buffer;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        auto err = -errno;
+        close(fd);
+        return err;
+    }
+    return fd;
+}
+
+int RtpServer::start() {
+    if (!_pollers.empty()) {
+        return -EBUSY;
+    }
+    for (uint32_t i = 0; i < _config.pollers; ++i) {
+        std::unique_ptr<Poller> poller(new Poller);
+        poller->poller = std::make_shared<EventPoller>(i);
+        poller->buffer.resize((size_t) kRecvBatch * _config.max_packet);
+        if (_config.idle_timeout_ms) {
+            //按超时的一半检查，帧最多晚于超时半个周期输出
+            auto ptr = poller.get();
+            auto interval = _config.idle_timeout_ms / 2 ? _config.idle_timeout_ms / 2 : 1;
+            poller->poller->setOnTimer(interval, [ptr]() {
+                auto now = getCurrentMicrosecond();
+                for (auto &pr : ptr->sessions) {
+                    pr.second->checkIdle(now);
+                }
+            });
+        }
+        if (_config.mux_port) {
+            //每个poller一个socket，内核按四元组哈希分流
+            poller->mux_fd = createUdpSocket(_config.mux_port, true);
+            if (poller->mux_fd < 0) {
+                auto err = poller->mux_fd;
+                PrintE("监听udp端口%u失败:%s", _config.mux_port, strerror(-err));
+                _pollers.clear();
+                return err;
+            }
+            auto ptr = poller.get();
+            auto fd = poller->mux_fd;
+            poller->poller->addEvent(fd, EventPoller::Event_Read, [this, ptr, fd](int event) {
+                onRead(*ptr, fd, nullptr);
+            });
+        }
+        _pollers.emplace_back(std::move(poller));
+    }
+
+    auto ret = startControl();
+    if (ret < 0) {
+        stop();
+        return ret;
+    }
+    for (auto &poller : _pollers) {
+        poller->poller->start();
+    }
+    PrintI("服务已启动, poller数:%u, 复用端口:%u, 控制接口:%s", _config.pollers, _config.mux_port, _config.control_path.c_str());
+    return 0;
+}
+
+void RtpServer::stop() {
+    if (_control) {
+        _control->shutdown();
+        _control = nullptr;
+    }
+    for (auto &pr : _control_buffers) {
+        close(pr.first);
+    }
+    _control_buffers.clear();
+    if (_control_fd >= 0) {
+        close(_control_fd);
+        _control_fd = -1;
+        unlink(_config.control_path.c_str());
+    }
+
+    for (auto &poller : _pollers) {
+        poller->poller->shutdown();
+    }
+    //poller线程已经退出，在本线程中销毁会话，等待输出写完
+    unordered_map<int, Session::Ptr> sessions;
+    {
+        lock_guard<mutex> lck(_mtx);
+        sessions.swap(_sessions);
+    }
+    for (auto &poller : _pollers) {
+        poller->sessions.clear();
+        poller->ssrc_map.clear();
+        if (poller->mux_fd >= 0) {
+            close(poller->mux_fd);
+        }
+    }
+    for (auto &pr : sessions) {
+        if (pr.second->fd >= 0) {
+            close(pr.second->fd);
+        }
+    }
+    _pollers.clear();
+}
+
+void RtpServer::onRead(Poller &poller, int fd, const Session::Ptr &session) {
+    struct mmsghdr msgs[kRecvBatch];
+    struct iovec iovs[kRecvBatch];
+    char *packets[kRecvBatch];
+    uint32_t lens[kRecvBatch];
+
+    int rounds = kMaxRecvRounds;
+    auto &budget = MemoryBudget::Instance();
+    if (budget.isThrottle()) {
+        //接近内存上限，先回收本poller的流；poller不能阻塞，只减少本次读取的轮数，
+        //其余数据留在socket缓存中，udp没有背压，缓存满后由内核丢弃
+        budget.reclaim();
+        rounds = 1;
+    }
+    for (int round = 0; round < rounds; ++round) {
+        TraceSpan("recvBatch");
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < kRecvBatch; ++i) {
+            iovs[i].iov_base = poller.buffer.data() + (size_t) i * _config.max_packet;
+            iovs[i].iov_len = _config.max_packet;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count = recvmmsg(fd, msgs, kRecvBatch, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            break;
+        }
+
+        int valid = 0;
+        uint64_t bytes = 0;
+        for (int i = 0; i < count; ++i) {
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                poller.truncated.fetch_add(1, memory_order_relaxed);
+                continue;
+            }
+            packets[valid] = (char *) iovs[i].iov_base;
+            lens[valid] = msgs[i].msg_len;
+            bytes += msgs[i].msg_len;
+            ++valid;
+        }
+        poller.packets.fetch_add(count, memory_order_relaxed);
+        poller.bytes.fetch_add(bytes, memory_order_relaxed);
+        onPackets(poller, packets, lens, valid, session);
+        if (count < kRecvBatch) {
+            break;
+        }
+    }
+}
+
+void RtpServer::onPackets(Poller &poller, char **packets, uint32_t *lens, int count, const Session::Ptr &session) {
+    if (session) {
+        //独占端口
+        inputSession(poller, session, packets, lens, count);
+        return;
+    }
+
+    //复用端口，连续的同一ssrc的包一起处理
+    int start = 0;
+    while (start < count) {
+        if (lens[start] < 12) {
+            poller.unknown_ssrc.fetch_add(1, memory_order_relaxed);
+            ++start;
+            continue;
+        }
+        auto ssrc = readSsrc(packets[start]);
+        int end = start + 1;
+        while (end < count && lens[end] >= 12 && readSsrc(packets[end]) == ssrc) {
+            ++end;
+        }
+        auto it = poller.ssrc_map.find(ssrc);
+        if (it == poller.ssrc_map.end()) {
+            poller.unknown_ssrc.fetch_add(end - start, memory_order_relaxed);
+        } else {
+            inputSession(poller, it->second, packets + start, lens + start, end - start);
+        }
+        start = end;
+    }
+}
+
+void RtpServer::inputSession(Poller &poller, const Session::Ptr &session, char **packets, uint32_t *lens, int count) {
+    int index = poller.poller->getIndex();
+    int owner = session->owner.load(memory_order_acquire);
+    if (owner < 0 && session->owner.compare_exchange_strong(owner, index)) {
+        owner = index;
+    }
+
+    uint64_t bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        bytes += lens[i];
+    }
+    session->packets.fetch_add(count, memory_order_relaxed);
+    session->bytes.fetch_add(bytes, memory_order_relaxed);
+
+    if (owner == index) {
+        auto rtp_session = getSession(poller, session);
+        if (rtp_session) {
+            rtp_session->inputRtp(packets, lens, count, getCurrentMicrosecond());
+        }
+        return;
+    }
+
+    //源端口变化等原因导致同一ssrc的包被分到了其他poller，拷贝后转发给负责的poller
+    auto copy = std::make_shared<vector<string> >();
+    copy->reserve(count);
+    for (int i = 0; i < count; ++i) {
+        copy->emplace_back(packets[i], lens[i]);
+    }
+    poller.forwarded.fetch_add(count, memory_order_relaxed);
+    auto target = _pollers[owner].get();
+    target->poller->async([this, target, session, copy]() {
+        auto rtp_session = getSession(*target, session);
+        if (!rtp_session) {
+            return;
+        }
+        char *packets[kRecvBatch];
+        uint32_t lens[kRecvBatch];
+        int n = 0;
+        for (auto &packet : *copy) {
+            packets[n] = (char *) packet.data();
+            lens[n] = packet.size();
+            if (++n == kRecvBatch) {
+                rtp_session->inputRtp(packets, lens, n, getCurrentMicrosecond());
+                n = 0;
+            }
+        }
+        if (n) {
+            rtp_session->inputRtp(packets, lens, n, getCurrentMicrosecond());
+        }
+    });
+}
+
+shared_ptr<RtpSession> RtpServer::getSession(Poller &poller, const Session::Ptr &session) {
+    auto it = poller.sessions.find(session->id);
+    if (it != poller.sessions.end()) {
+        return it->second;
+    }
+    if (session->closed) {
+        return nullptr;
+    }
+    string output;
+    {
+        lock_guard<mutex> lck(_mtx);
+        output = session->output;
+    }
+    //在本poller线程中创建，内存位于本地numa节点
+    auto rtp_session = std::make_shared<RtpSession>(session->name, session->ssrc);
+    rtp_session->setMarkerFlush(_config.marker_flush);
+    rtp_session->setIdleTimeout(_config.idle_timeout_ms);
+    if (_config.latency) {
+        rtp_session->setLatencyStats(std::make_shared<LatencyStats>());
+    }
+    if (_create_output) {
+        rtp_session->setFrameWriter(_create_output(session->name, output));
+    }
+    poller.sessions.emplace(session->id, rtp_session);
+    PrintI("会话%d开始接收, ssrc:%08X, poller:%d", session->id, session->ssrc, poller.poller->getIndex());
+    return rtp_session;
+}
+
+void RtpServer::removeSession(Poller &poller, const Session::Ptr &session) {
+    auto it = poller.ssrc_map.find(session->ssrc);
+    if (it != poller.ssrc_map.end() && it->second == session) {
+        poller.ssrc_map.erase(it);
+    }
+    if (session->fd >= 0 && session->owner == poller.poller->getIndex()) {
+        poller.poller->delEvent(session->fd);
+        close(session->fd);
+        session->fd = -1;
+    }
+    poller.sessions.erase(session->id);
+}
+
+int RtpServer::openSession(uint32_t ssrc, uint16_t port, const string &output, string &err) {
+    if (_pollers.empty()) {
+        err = "server not started";
+        return -1;
+    }
+    if (!port && !_config.mux_port) {
+        err = "no mux port";
+        return -1;
+    }
+    if (!port && !ssrc) {
+        err = "ssrc required on mux port";
+        return -1;
+    }
+
+    auto session = std::make_shared<Session>();
+    session->ssrc = ssrc;
+    session->port = port;
+    session->output = output;
+    if (port) {
+        session->fd = createUdpSocket(port, false);
+        if (session->fd < 0) {
+            err = strerror(-session->fd);
+            return -1;
+        }
+    }
+
+    {
+        lock_guard<mutex> lck(_mtx);
+        if (!port) {
+            for (auto &pr : _sessions) {
+                if (!pr.second->port && pr.second->ssrc == ssrc) {
+                    err = "ssrc already opened";
+                    return -1;
+                }
+            }
+        }
+        session->id = ++_last_id;
+        _sessions.emplace(session->id, session);
+    }
+
+    char name[32];
+    if (ssrc) {
+        snprintf(name, sizeof(name), "%08X", ssrc);
+    } else {
+        snprintf(name, sizeof(name), "port%u", port);
+    }
+    session->name = name;
+
+    if (port) {
+        //独占端口的会话固定由一个poller负责
+        auto index = session->id % _pollers.size();
+        session->owner = index;
+        auto target = _pollers[index].get();
+        target->poller->async([this, target, session]() {
+            auto fd = session->fd;
+            target->poller->addEvent(fd, EventPoller::Event_Read, [this, target, session, fd](int event) {
+                onRead(*target, fd, session);
+            });
+        });
+    } else {
+        for (auto &poller : _pollers) {
+            auto target = poller.get();
+            target->poller->async([target, session]() {
+                target->ssrc_map[session->ssrc] = session;
+            });
+        }
+    }
+    PrintI("打开会话%d, ssrc:%08X, 端口:%u", session->id, ssrc, port ? port : _config.mux_port);
+    return session->id;
+}
+
+bool RtpServer::closeSession(int id) {
+    Session::Ptr session;
+    {
+        lock_guard<mutex> lck(_mtx);
+        auto it = _sessions.find(id);
+        if (it == _sessions.end()) {
+            return false;
+        }
+        session = it->second;
+        _sessions.erase(it);
+    }
+    session->closed = true;
+    for (auto &poller : _pollers) {
+        auto target = poller.get();
+        target->poller->async([this, target, session]() {
+            removeSession(*target, session);
+        });
+    }
+    PrintI("关闭会话%d", id);
+    return true;
+}
+
+bool RtpServer::setOutput(int id, const string &output) {
+    Session::Ptr session;
+    int owner;
+    {
+        lock_guard<mutex> lck(_mtx);
+        auto it = _sessions.find(id);
+        if (it == _sessions.end()) {
+            return false;
+        }
+        session = it->second;
+        session->output = output;
+        owner = session->owner;
+    }
+    if (owner < 0) {
+        //尚未开始接收，创建会话时使用新路径
+        return true;
+    }
+    auto target = _pollers[owner].get();
+    target->poller->async([this, target, session, output]() {
+        auto it = target->sessions.find(session->id);
+        if (it == target->sessions.end() || !_create_output) {
+            return;
+        }
+        //旧的输出在此处销毁
+        it->second->setFrameWriter(_create_output(session->name, output));
+    });
+    return true;
+}
+
+RtpServer::Stats RtpServer::getStats() const {
+    Stats stats;
+    for (auto &poller : _pollers) {
+        stats.packets += poller->packets;
+        stats.bytes += poller->bytes;
+        stats.unknown_ssrc += poller->unknown_ssrc;
+        stats.forwarded += poller->forwarded;
+        stats.truncated += poller->truncated;
+    }
+    return stats;
+}
+
+int RtpServer::startControl() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (_config.control_path.size() >= sizeof(addr.sun_path)) {
+        close(fd);
+        return -ENAMETOOLONG;
+    }
+    strcpy(addr.sun_path, _config.control_path.c_str());
+    //上次异常退出遗留的socket文件
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        auto err = -errno;
+        PrintE("监听控制接口失败:%s, %s", _config.control_path.c_str(), strerror(errno));
+        close(fd);
+        return err;
+    }
+    _control_fd = fd;
+    _control = std::make_shared<EventPoller>(-1);
+    _control->addEvent(fd, EventPoller::Event_Read, [this](int event) {
+        onControlAccept();
+    });
+    return _control->start();
+}
+
+void RtpServer::onControlAccept() {
+    while (true) {
+        int fd = accept4(_control_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            break;
+        }
+        _control_buffers[fd];
+        _control->addEvent(fd, EventPoller::Event_Read | EventPoller::Event_Error, [this, fd](int event) {
+            onControlRead(fd);
+        });
+    }
+}
+
+void RtpServer::onControlRead(int fd) {
+    char buf[4096];
+    auto &buffer = _control_buffers[fd];
+    while (true) {
+        auto n = read(fd, buf, sizeof(buf));
+        if (n > 0) {
+            buffer.append(buf, n);
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            break;
+        }
+        //对端关闭
+        _control->delEvent(fd);
+        _control_buffers.erase(fd);
+        close(fd);
+        return;
+    }
+
+    size_t pos;
+    while ((pos = buffer.find('\n')) != string::npos) {
+        auto line = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        auto reply = onCommand(line);
+        //应答很短，不处理部分写入
+        auto ret = write(fd, reply.data(), reply.size());
+        (void) ret;
+    }
+    if (buffer.size() > sizeof(buf)) {
+        //超长的命令
+        buffer.clear();
+    }
+}
+
+string RtpServer::onCommand(const string &line) {
+    istringstream ss(line);
+    string cmd;
+    ss >> cmd;
+    if (cmd == "open") {
+        string ssrc, output;
+        uint32_t port = 0;
+        ss >> ssrc >> port >> output;
+        if (ssrc.empty() || port > 0xFFFF) {
+            return "err usage: open <ssrc> <port> [output]\n";
+        }
+        string err;
+        auto id = openSession(strtoul(ssrc.c_str(), nullptr, 0), port, output, err);
+        if (id < 0) {
+            return "err " + err + "\n";
+        }
+        return "ok " + to_string(id) + "\n";
+    }
+    if (cmd == "close") {
+        int id = -1;
+        ss >> id;
+        return closeSession(id) ? "ok\n" : "err no such session\n";
+    }
+    if (cmd == "output") {
+        int id = -1;
+        string output;
+        ss >> id >> output;
+        if (output.empty()) {
+            return "err usage: output <id> <path>\n";
+        }
+        return setOutput(id, output) ? "ok\n" : "err no such session\n";
+    }
+    if (cmd == "list") {
+        return listSessions();
+    }
+    if (cmd == "stats") {
+        auto stats = getStats();
+        char buf[256];
+        snprintf(buf, sizeof(buf), "ok packets=%llu bytes=%llu unknown_ssrc=%llu forwarded=%llu truncated=%llu\n",
+                 (unsigned long long) stats.packets, (unsigned long long) stats.bytes,
+                 (unsigned long long) stats.unknown_ssrc, (unsigned long long) stats.forwarded,
+                 (unsigned long long) stats.truncated);
+        return buf;
+    }
+    return "err unknown command\n";
+}
+
+string RtpServer::listSessions() {
+    string ret;
+    char buf[512];
+    lock_guard<mutex> lck(_mtx);
+    for (auto &pr : _sessions) {
+        auto &session = *pr.second;
+        snprintf(buf, sizeof(buf), "%d ssrc=%08X port=%u poller=%d packets=%llu bytes=%llu output=%s\n",
+                 session.id, session.ssrc, session.port ? session.port : _config.mux_port, session.owner.load(),
+                 (unsigned long long) session.packets, (unsigned long long) session.bytes,
+                 session.output.empty() ? "-" : session.output.c_str());
+        ret += buf;
+    }
+    ret += "end\n";
+    return ret;
+}
+
+}//namespace mediakit
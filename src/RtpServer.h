@@ -0,0 +1,178 @@
+#ifndef RTP2PS_RTPSERVER_H
+#define RTP2PS_RTPSERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include "EventPoller.h"
+#include "Frame.h"
+
+namespace mediakit{
+
+class RtpSession;
+
+/**
+ * 常驻服务模式，接收大量udp承载的ps rtp流
+ * 每个cpu一个EventPoller，复用端口上每个poller有一个SO_REUSEPORT的socket，由内核按四元组分流；
+ * 复用端口上的流按ssrc路由到会话，会话由第一个收到其数据的poller负责解析与输出，
+ * 其他poller收到的包转发给该poller，因此每个会话的排序、解码与写入只在一个线程中进行；
+ * 独占端口的会话由一个poller接收；
+ * 会话通过unix socket控制接口打开、关闭与设置输出路径，每行一条命令：
+ *   open <ssrc> <port> [output]  打开会话，port为0时使用复用端口，返回"ok <id>"
+ *   close <id>                   关闭会话
+ *   output <id> <path>           设置输出路径
+ *   list                         列出会话，以"end"结束
+ *   stats                        服务统计
+ */
+class RtpServer {
+public:
+    /**
+     * 创建会话输出
+     * @param name 会话名
+     * @param output 控制接口指定的输出路径，可能为空
+     */
+    typedef std::function<FrameWriterInterface::Ptr(const std::string &name, const std::string &output)> onCreateOutput;
+
+    struct Config {
+        //ssrc复用端口，0为不使用
+        uint16_t mux_port = 0;
+        //poller个数，0为在线cpu个数
+        uint32_t pollers = 0;
+        //控制接口unix socket路径
+        std::string control_path = "/tmp/rtp2ps.sock";
+        //socket接收缓存大小
+        uint32_t recv_buffer = 4 * 1024 * 1024;
+        //单个udp包的最大长度，超过的包被丢弃
+        uint32_t max_packet = 9216;
+        //收到marker位的包时立即输出帧
+        bool marker_flush = false;
+        //空闲超时，毫秒，超时后输出未完成的帧，0为不检查
+        uint32_t idle_timeout_ms = 0;
+        //统计每个会话的端到端时延，会话关闭时输出
+        bool latency = false;
+    };
+
+    struct Stats {
+        //接收的udp包数
+        uint64_t packets = 0;
+        //接收的字节数
+        uint64_t bytes = 0;
+        //ssrc未注册而丢弃的包数
+        uint64_t unknown_ssrc = 0;
+        //转发到其他poller的包数
+        uint64_t forwarded = 0;
+        //超过max_packet而丢弃的包数
+        uint64_t truncated = 0;
+    };
+
+    RtpServer(const Config &config);
+    ~RtpServer();
+
+    RtpServer(const RtpServer &) = delete;
+    RtpServer &operator=(const RtpServer &) = delete;
+
+    void setOnCreateOutput(onCreateOutput cb);
+
+    /**
+     * 创建socket并启动全部poller
+     * @return 成功返回0，失败返回-errno
+     */
+    int start();
+
+    /**
+     * 停止全部poller，关闭全部会话
+     */
+    void stop();
+
+    /**
+     * 打开会话，线程安全
+     * @param ssrc 会话ssrc，独占端口时可为0(锁定第一个包的ssrc)
+     * @param port 独占端口，0为使用复用端口
+     * @param output 输出路径，为空时由onCreateOutput决定
+     * @param err 失败原因
+     * @return 会话id，失败返回-1
+     */
+    int openSession(uint32_t ssrc, uint16_t port, const std::string &output, std::string &err);
+
+    /**
+     * 关闭会话，线程安全
+     */
+    bool closeSession(int id);
+
+    /**
+     * 设置会话输出路径，线程安全；已经在输出的会话切换到新文件
+     */
+    bool setOutput(int id, const std::string &output);
+
+    Stats getStats() const;
+
+private:
+    struct Session {
+        typedef std::shared_ptr<Session> Ptr;
+        int id;
+        uint32_t ssrc;
+        uint16_t port;
+        int fd = -1;
+        std::string name;
+        //受RtpServer::_mtx保护
+        std::string output;
+        //负责解析与输出的poller下标，-1为尚未确定
+        std::atomic<int> owner{-1};
+        //已关闭，转发中的包不再创建会话
+        std::atomic<bool> closed{false};
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+    };
+
+    struct Poller {
+        EventPoller::Ptr poller;
+        //复用端口的socket
+        int mux_fd = -1;
+        //复用端口的ssrc路由表，只在本poller线程中访问
+        std::unordered_map<uint32_t, Session::Ptr> ssrc_map;
+        //本poller负责的会话
+        std::unordered_map<int, std::shared_ptr<RtpSession> > sessions;
+        //recvmmsg缓存
+        std::vector<char> buffer;
+        //统计，只在本poller线程中写
+        std::atomic<uint64_t> packets{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> unknown_ssrc{0};
+        std::atomic<uint64_t> forwarded{0};
+        std::atomic<uint64_t> truncated{0};
+    };
+
+    int createUdpSocket(uint16_t port, bool reuse_port);
+    void onRead(Poller &poller, int fd, const Session::Ptr &session);
+    void onPackets(Poller &poller, char **packets, uint32_t *lens, int count, const Session::Ptr &session);
+    void inputSession(Poller &poller, const Session::Ptr &session, char **packets, uint32_t *lens, int count);
+    std::shared_ptr<RtpSession> getSession(Poller &poller, const Session::Ptr &session);
+    void removeSession(Poller &poller, const Session::Ptr &session);
+
+    int startControl();
+    void onControlAccept();
+    void onControlRead(int fd);
+    std::string onCommand(const std::string &line);
+    std::string listSessions();
+
+private:
+    Config _config;
+    onCreateOutput _create_output;
+    std::vector<std::unique_ptr<Poller> > _pollers;
+    //控制接口在单独的poller中处理
+    EventPoller::Ptr _control;
+    int _control_fd = -1;
+    std::unordered_map<int, std::string> _control_buffers;
+
+    mutable std::mutex _mtx;
+    int _last_id = 0;
+    std::unordered_map<int, Session::Ptr> _sessions;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_RTPSERVER_H
@@ -0,0 +1,179 @@
+#include "RtpSplitter.h"
+#include "util.h"
+
+//rtcp与rtp复用时的判断依据(RFC 5761)
+static inline bool isRtcp(const char *payload) {
+    return (uint8_t) payload[1] >= 192 && (uint8_t) payload[1] <= 223;
+}
+
+namespace mediakit{
+
+void RtpSplitter::setOnRtp(onRtp cb) {
+    _cb = std::move(cb);
+}
+
+void RtpSplitter::reset() {
+    _mode = 0;
+    _ssrc = 0;
+}
+
+uint64_t RtpSplitter::getResyncCount() const {
+    return _resync_count;
+}
+
+void RtpSplitter::saveState(CheckpointWriter &writer) const {
+    writer.write(_mode);
+    writer.write(_ssrc);
+    writer.write(_resync_count);
+}
+
+bool RtpSplitter::loadState(CheckpointReader &reader) {
+    return reader.read(_mode) && reader.read(_ssrc) && reader.read(_resync_count);
+}
+
+int RtpSplitter::frameSize(const char *data, uint32_t len, uint32_t &header_size) {
+    if (len < 1) {
+        return 0;
+    }
+    if (_mode == 0) {
+        //根据首个字节探测封装方式
+        _mode = data[0] == '$' ? 2 : 1;
+    }
+
+    uint32_t size;
+    if (_mode == 2) {
+        if (data[0] != '$') {
+            return -1;
+        }
+        if (len < 4) {
+            return 0;
+        }
+        header_size = 4;
+        size = AV_RB16(data + 2);
+    } else {
+        if (len < 2) {
+            return 0;
+        }
+        header_size = 2;
+        size = AV_RB16(data);
+    }
+
+    //rtp/rtcp最少4个字节
+    if (size < 4) {
+        return -1;
+    }
+    if (len > header_size && ((uint8_t) data[header_size] >> 6) != 2) {
+        //rtp/rtcp version必须为2
+        return -1;
+    }
+    return header_size + size;
+}
+
+bool RtpSplitter::isPlausible(const char *data, uint32_t len) {
+    uint32_t header_size;
+    auto size = frameSize(data, len, header_size);
+    if (size <= 0) {
+        return size == 0;
+    }
+    if (_ssrc && len >= header_size + 12 && !isRtcp(data + header_size) && AV_RB32(data + header_size + 8) != _ssrc) {
+        //ssrc不一致，不是真正的帧头
+        return false;
+    }
+    if ((uint32_t) size >= len) {
+        //下个帧头不在数据内，无法进一步校验
+        return true;
+    }
+    return frameSize(data + size, len - size, header_size) >= 0;
+}
+
+bool RtpSplitter::isFrameStart(const char *data, uint32_t len) {
+    //使用独立的拆包器探测，不影响已有流的封装方式
+    RtpSplitter probe;
+    uint32_t header_size;
+    if (probe.frameSize(data, len, header_size) <= 0 || len <= header_size) {
+        return false;
+    }
+    return probe.isPlausible(data, len);
+}
+
+//完整的rtp帧(不含rtcp)，返回帧长度，否则返回0
+static uint32_t wholeRtpFrame(const char *data, uint32_t len, uint32_t &ssrc) {
+    RtpSplitter probe;
+    uint32_t header_size;
+    auto size = probe.frameSize(data, len, header_size);
+    if (size <= 0 || (uint32_t) size > len || (uint32_t) size < header_size + 12 || isRtcp(data + header_size)) {
+        return 0;
+    }
+    ssrc = AV_RB32(data + header_size + 8);
+    return size;
+}
+
+int RtpSplitter::findFrameStart(const char *data, uint32_t len) {
+    uint32_t ssrc;
+    if (wholeRtpFrame(data, len, ssrc) == len) {
+        return 0;
+    }
+    for (uint32_t i = 0; i + 2 < len; ++i) {
+        auto size = wholeRtpFrame(data + i, len - i, ssrc);
+        uint32_t next_ssrc;
+        if (size && wholeRtpFrame(data + i + size, len - i - size, next_ssrc) && next_ssrc == ssrc) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32_t RtpSplitter::resync(const char *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; ++i) {
+        if (isPlausible(data + i, len - i)) {
+            return i;
+        }
+    }
+    return len;
+}
+
+void RtpSplitter::onFrame(char *frame, uint32_t header_size, uint32_t frame_size) {
+    auto payload = frame + header_size;
+    auto len = frame_size - header_size;
+    if (_mode == 2 && (frame[1] & 0x01)) {
+        //interleaved奇数通道为rtcp
+        return;
+    }
+    if (isRtcp(payload)) {
+        return;
+    }
+    if (len < 12) {
+        return;
+    }
+    //记录ssrc，用于重新同步时校验帧头
+    _ssrc = AV_RB32(payload + 8);
+    if (_cb) {
+        _cb(payload, len, _mode == 2 ? (uint8_t) frame[1] : -1);
+    }
+}
+
+uint32_t RtpSplitter::input(char *data, uint32_t len) {
+    uint32_t offset = 0;
+    while (offset < len) {
+        uint32_t header_size;
+        auto size = frameSize(data + offset, len - offset, header_size);
+        if (size == 0) {
+            break;
+        }
+        if (size < 0) {
+            //帧头非法，跳过并查找下个合法的帧头
+            ++_resync_count;
+            offset += 1 + resync(data + offset + 1, len - offset - 1);
+            continue;
+        }
+        if (offset + size > len) {
+            //不完整的帧，等待后续数据
+            break;
+        }
+        onFrame(data + offset, header_size, size);
+        offset += size;
+    }
+    return offset;
+}
+
+}//namespace mediakit
@@ -0,0 +1,105 @@
+#ifndef RTP2PS_RTPSPLITTER_H
+#define RTP2PS_RTPSPLITTER_H
+
+#include <stdint.h>
+#include <functional>
+#include "Checkpoint.h"
+
+namespace mediakit{
+
+/**
+ * tcp承载rtp的拆包器
+ * 支持RFC 4571(2字节长度前缀)以及rtsp interleaved('$' + 通道号 + 2字节长度)两种封装，
+ * 首个帧头决定封装方式
+ */
+class RtpSplitter {
+public:
+    /**
+     * rtp包回调
+     * @param channel '$' interleaved封装的通道号，RFC 4571封装没有通道号，为-1
+     */
+    typedef std::function<void(char *rtp, uint32_t len, int channel)> onRtp;
+
+    RtpSplitter() = default;
+    ~RtpSplitter() = default;
+
+    /**
+     * 设置rtp包回调，rtp指针直接指向输入数据，不做拷贝
+     */
+    void setOnRtp(onRtp cb);
+
+    /**
+     * 输入连续的tcp负载，只消费其中完整的帧
+     * @param data 数据指针
+     * @param len 数据长度
+     * @return 已消费的字节数，剩余不完整的帧由调用者缓存
+     */
+    uint32_t input(char *data, uint32_t len);
+
+    /**
+     * 解析帧头
+     * @param data 帧头指针
+     * @param len 可用数据长度
+     * @param header_size 返回帧头长度
+     * @return 0:数据不足，>0:整帧长度(含帧头)，<0:帧头非法，需要重新同步
+     */
+    int frameSize(const char *data, uint32_t len, uint32_t &header_size);
+
+    /**
+     * 输出一个完整帧，rtcp等非rtp负载会被忽略
+     * @param frame 帧指针(含帧头)
+     * @param header_size 帧头长度
+     * @param frame_size 整帧长度
+     */
+    void onFrame(char *frame, uint32_t header_size, uint32_t frame_size);
+
+    /**
+     * 在数据中查找下一个合法的帧头
+     * @return 合法帧头的偏移量，未找到时返回可以丢弃的字节数
+     */
+    uint32_t resync(const char *data, uint32_t len);
+
+    /**
+     * 数据是否以RFC 4571或'$' interleaved帧头开始，用于判断tcp流是否承载rtp
+     * @param data tcp负载
+     * @param len 负载长度，至少要包含帧头与rtp首字节
+     */
+    static bool isFrameStart(const char *data, uint32_t len);
+
+    /**
+     * 在流中间的一段数据里查找rtp帧的起点，用于没有抓到syn包的tcp流
+     * 要求连续两个完整的rtp帧ssrc相同，或者数据恰好是一个完整的rtp帧，其他协议的数据几乎不会满足
+     * @return 帧起点的偏移，未找到返回-1
+     */
+    static int findFrameStart(const char *data, uint32_t len);
+
+    /**
+     * 重置封装方式探测
+     */
+    void reset();
+
+    /**
+     * 非法帧头导致的重新同步次数
+     */
+    uint64_t getResyncCount() const;
+
+    /**
+     * 保存/恢复封装方式等状态，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const;
+    bool loadState(CheckpointReader &reader);
+
+private:
+    bool isPlausible(const char *data, uint32_t len);
+
+private:
+    //0:未知，1:RFC 4571，2:'$' interleaved
+    int _mode = 0;
+    //最近一个rtp包的ssrc
+    uint32_t _ssrc = 0;
+    uint64_t _resync_count = 0;
+    onRtp _cb;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_RTPSPLITTER_H
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "SegmentWriter.h"
+#include "Logger.h"
+#include "util.h"
+
+//判断关键帧时最多扫描的字节数
+#define CUT_SCAN_SIZE (64 * 1024)
+//相邻帧时间戳的最大间隔(毫秒)，超过时认为时间戳回环或跳变，不计入分段时长
+#define MAX_FRAME_GAP_MS (10 * 1000)
+
+using namespace std;
+
+namespace mediakit{
+
+static inline bool isStartCode(const uint8_t *ptr) {
+    return ptr[0] == 0x00 && ptr[1] == 0x00 && ptr[2] == 0x01;
+}
+
+//是否为关键帧相关的nalu，h264为idr/sps，h265为irap/vps/sps；同一字节按两种编码解释会误判，必须先确定编码
+static inline bool isKeyNalu(CodecId codec, uint8_t header) {
+    switch (codec) {
+        case CodecH264: {
+            auto type = header & 0x1F;
+            return type == 5 || type == 7;
+        }
+        case CodecH265: {
+            auto type = (header >> 1) & 0x3F;
+            return (type >= 19 && type <= 21) || type == 32 || type == 33;
+        }
+        default: return false;
+    }
+}
+
+//从节目流映射中获取视频编码，没有视频时返回CodecInvalid
+static CodecId parsePsm(const uint8_t *psm, uint32_t size) {
+    if (size < 12) {
+        return CodecInvalid;
+    }
+    uint32_t pos = 10 + AV_RB16(psm + 8);
+    if (pos + 2 > size) {
+        return CodecInvalid;
+    }
+    auto end = min(size, pos + 2 + AV_RB16(psm + pos));
+    pos += 2;
+    while (pos + 4 <= end) {
+        auto stream_type = psm[pos];
+        auto stream_id = psm[pos + 1];
+        if (stream_id >= 0xE0 && stream_id <= 0xEF) {
+            switch (stream_type) {
+                case 0x1B: return CodecH264;
+                case 0x24: return CodecH265;
+                default: return CodecInvalid;
+            }
+        }
+        pos += 4 + AV_RB16(psm + pos + 2);
+    }
+    return CodecInvalid;
+}
+
+SegmentWriter::SegmentWriter(const Config &config, onCreateWriter cb) {
+    _config = config;
+    _cb = std::move(cb);
+    if (!_config.prealloc_size) {
+        _config.prealloc_size = _config.max_size;
+    }
+}
+
+SegmentWriter::~SegmentWriter() {
+    closeSegment();
+}
+
+uint32_t SegmentWriter::getSegmentIndex() const {
+    return _index;
+}
+
+string SegmentWriter::formatPath(const string &tmpl, const string &flow, uint32_t index, time_t now) {
+    //先替换自定义的格式，其余交给strftime
+    string fmt;
+    for (size_t i = 0; i < tmpl.size(); ++i) {
+        if (tmpl[i] != '%' || i + 1 == tmpl.size()) {
+            fmt.push_back(tmpl[i]);
+            continue;
+        }
+        switch (tmpl[i + 1]) {
+            case 'f':
+                fmt.append(flow);
+                break;
+            case 'n':
+                fmt.append(to_string(index));
+                break;
+            case 't':
+                fmt.append(to_string((long long) now));
+                break;
+            case '%':
+                fmt.append("%%");
+                break;
+            default:
+                fmt.push_back('%');
+                fmt.push_back(tmpl[i + 1]);
+                break;
+        }
+        ++i;
+    }
+
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char buf[1024];
+    auto size = strftime(buf, sizeof(buf), fmt.data(), &tm);
+    if (!size) {
+        return fmt;
+    }
+    return string(buf, size);
+}
+
+bool SegmentWriter::isCutPoint(const char *data, uint32_t size, CodecId &video_codec) {
+    auto ptr = (const uint8_t *) data;
+    if (size < 14 || !isStartCode(ptr) || ptr[3] != 0xBA) {
+        return false;
+    }
+    //mpeg2 ps包头14字节加填充字节
+    uint32_t pos = (ptr[4] >> 6) == 0x01 ? 14 + (ptr[13] & 0x07) : 12;
+    auto end = min(size, (uint32_t) CUT_SCAN_SIZE);
+    while (pos + 6 <= end) {
+        if (!isStartCode(ptr + pos)) {
+            break;
+        }
+        auto stream_id = ptr[pos + 3];
+        uint32_t len = AV_RB16(ptr + pos + 4);
+        if (stream_id == 0xBC) {
+            auto codec = parsePsm(ptr + pos, min(end, pos + 6 + len) - pos);
+            if (codec != CodecInvalid) {
+                video_codec = codec;
+            }
+        }
+        if (stream_id == 0xBB || stream_id == 0xBC) {
+            //系统头或节目流映射只在关键帧前出现
+            return true;
+        }
+        if (stream_id == 0xBA) {
+            break;
+        }
+        auto pes_end = len ? min(end, pos + 6 + len) : end;
+        if (stream_id >= 0xE0 && stream_id <= 0xEF && pos + 9 <= end && video_codec != CodecInvalid) {
+            //视频pes，按已知的编码查找负载中的关键帧nalu
+            for (auto i = pos + 9 + ptr[pos + 8]; i + 3 < pes_end; ++i) {
+                if (isStartCode(ptr + i) && isKeyNalu(video_codec, ptr[i + 3])) {
+                    return true;
+                }
+            }
+        }
+        pos = pes_end;
+    }
+    return false;
+}
+
+void SegmentWriter::openSegment() {
+    _path = formatPath(_config.path_template, _config.flow, _index, time(nullptr));
+    _base_size = 0;
+    if (_config.prealloc_size) {
+        //预分配但不改变文件长度，写入时可以直接追加
+        int fd = open(_path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0) {
+                _base_size = st.st_size;
+            }
+            if (fallocate(fd, FALLOC_FL_KEEP_SIZE, _base_size, _config.prealloc_size) < 0) {
+                PrintW("预分配文件失败:%s, %s", _path.c_str(), strerror(errno));
+            }
+            close(fd);
+        }
+    }
+    _writer = _cb(_path);
+    _bytes = 0;
+    _opened = true;
+}
+
+void SegmentWriter::closeSegment() {
+    if (!_opened) {
+        return;
+    }
+    //先销毁写文件对象，保证数据全部写入
+    _writer = nullptr;
+    _opened = false;
+    if (_config.prealloc_size && truncate(_path.c_str(), _base_size + _bytes) < 0) {
+        PrintW("截断文件失败:%s, %s", _path.c_str(), strerror(errno));
+    }
+    ++_index;
+}
+
+void SegmentWriter::updateElapsed(uint32_t dts) {
+    if (!_has_dts) {
+        _has_dts = true;
+        _last_dts = dts;
+        return;
+    }
+    //按有符号数计算差值，rtp时间戳回环后仍能得到正确的间隔
+    auto diff = (int32_t) (dts - _last_dts);
+    if (diff > 0 && diff <= MAX_FRAME_GAP_MS) {
+        _elapsed_ms += diff;
+    }
+    if (diff > 0 || diff < -MAX_FRAME_GAP_MS) {
+        //正常递增或者时间戳回环/跳变，以新的时间戳为基准；小幅回退(乱序)保持原基准
+        _last_dts = dts;
+    }
+}
+
+void SegmentWriter::inputFrame(const Frame::Ptr &frame) {
+    auto codec = frame->getCodecId();
+    if (codec == CodecH264 || codec == CodecH265) {
+        _video_codec = codec;
+    } else if (_video_codec == CodecInvalid) {
+        //透传的ps流，从节目流映射中获取视频编码
+        isCutPoint(frame->data(), frame->size(), _video_codec);
+    }
+    updateElapsed(frame->dts());
+    if (_opened) {
+        auto duration = _elapsed_ms - _first_elapsed_ms;
+        bool over_duration = _config.max_duration_ms && duration >= _config.max_duration_ms;
+        bool over_size = _config.max_size && _bytes + frame->size() > _config.max_size;
+        if ((over_duration || over_size) && isCutPoint(frame->data(), frame->size(), _video_codec)) {
+            closeSegment();
+        } else if ((over_duration && duration >= 2 * (uint64_t) _config.max_duration_ms) ||
+                   (over_size && _bytes + frame->size() > 2 * _config.max_size)) {
+            //长时间没有关键帧，在ps包头处强制切分
+            if (frame->size() >= 4 && isStartCode((uint8_t *) frame->data()) && (uint8_t) frame->data()[3] == 0xBA) {
+                closeSegment();
+            }
+        }
+    }
+
+    if (!_opened) {
+        openSegment();
+        _first_elapsed_ms = _elapsed_ms;
+    }
+    if (_writer) {
+        _writer->inputFrame(frame);
+    }
+    _bytes += frame->size();
+}
+
+}//namespace mediakit
@@ -0,0 +1,101 @@
+#ifndef RTP2PS_SEGMENTWRITER_H
+#define RTP2PS_SEGMENTWRITER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <string>
+#include <functional>
+#include "Frame.h"
+
+namespace mediakit{
+
+/**
+ * 分段输出
+ * 按时长或大小切换输出文件，只在ps包头且为关键帧处切分；
+ * 新文件先用fallocate预分配空间，关闭时截断到实际长度
+ */
+class SegmentWriter : public FrameWriterInterface {
+public:
+    typedef std::shared_ptr<SegmentWriter> Ptr;
+    //根据文件路径创建实际写文件的对象
+    typedef std::function<FrameWriterInterface::Ptr(const std::string &path)> onCreateWriter;
+
+    struct Config {
+        /**
+         * 文件名模板，支持:
+         * %f 流标识，%n 分段序号，%t unix时间戳(秒)，以及strftime的全部时间格式(本地时间)
+         */
+        std::string path_template;
+        //流标识
+        std::string flow = "0";
+        //单个分段最大时长，毫秒，0为不限制
+        uint32_t max_duration_ms = 0;
+        //单个分段最大字节数，0为不限制
+        uint64_t max_size = 0;
+        //预分配大小，0时取max_size
+        uint64_t prealloc_size = 0;
+    };
+
+    /**
+     * @param config 分段配置
+     * @param cb 创建写文件对象的回调
+     */
+    SegmentWriter(const Config &config, onCreateWriter cb);
+    ~SegmentWriter() override;
+
+    void inputFrame(const Frame::Ptr &frame) override;
+
+    /**
+     * 当前分段序号
+     */
+    uint32_t getSegmentIndex() const;
+
+    /**
+     * 生成文件名
+     * @param tmpl 文件名模板
+     * @param flow 流标识
+     * @param index 分段序号
+     * @param now 时间
+     */
+    static std::string formatPath(const std::string &tmpl, const std::string &flow, uint32_t index, time_t now);
+
+    /**
+     * 判断帧是否可以作为分段起点：以ps包头开始，
+     * 并且携带系统头/节目流映射(GB28181关键帧)或者视频编码对应的关键帧nalu
+     * @param video_codec 视频编码，遇到节目流映射时更新；未知时只按系统头/节目流映射判断
+     */
+    static bool isCutPoint(const char *data, uint32_t size, CodecId &video_codec);
+
+private:
+    void openSegment();
+    void closeSegment();
+    /**
+     * 累加相邻帧的时间戳间隔，得到不受rtp时间戳回环影响的累计时长
+     */
+    void updateElapsed(uint32_t dts);
+
+private:
+    Config _config;
+    onCreateWriter _cb;
+    bool _opened = false;
+    //当前分段序号
+    uint32_t _index = 0;
+    //视频编码，来自帧的编码或节目流映射
+    CodecId _video_codec = CodecInvalid;
+    //已收到过帧，_last_dts有效
+    bool _has_dts = false;
+    //上一帧的时间戳(毫秒)
+    uint32_t _last_dts = 0;
+    //累计时长(毫秒)，时间戳回环与跳变不计入
+    uint64_t _elapsed_ms = 0;
+    //当前分段起点的累计时长
+    uint64_t _first_elapsed_ms = 0;
+    uint64_t _bytes = 0;
+    //文件已存在时原有的长度
+    uint64_t _base_size = 0;
+    std::string _path;
+    FrameWriterInterface::Ptr _writer;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_SEGMENTWRITER_H
@@ -0,0 +1,358 @@
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <mutex>
+#include "SlabAllocator.h"
+#include "HugePage.h"
+#include "CpuPlacement.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//大内存申请的分级标记
+#define LARGE_CLASS 0xFFFFFFFF
+
+#define ALL_CLASS_COUNT (SlabAllocator::kClassCount + SlabAllocator::kLargeClassCount)
+
+static const size_t kClassSize[ALL_CLASS_COUNT] = {1536, 4 * 1024, 10 * 1024, 64 * 1024,
+                                                   128 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024, 2048 * 1024, 4096 * 1024};
+
+struct Arena;
+
+//内存块头部，在内存块的整个生命周期内保持不变
+struct BlockHeader {
+    Arena *arena;
+    uint32_t cls;
+    uint32_t reserved;
+};
+
+//空闲内存块，链表指针存放在负载中
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+struct Arena {
+    FreeBlock *free_list[SlabAllocator::kClassCount] = {nullptr};
+    //其他线程释放的内存块
+    atomic<FreeBlock *> remote_list[SlabAllocator::kClassCount];
+    //本线程缓存的大帧缓存
+    FreeBlock *large_list[SlabAllocator::kLargeClassCount] = {nullptr};
+    size_t large_bytes = 0;
+    //线程退出后在孤儿链表中的下一个arena
+    Arena *next_orphan = nullptr;
+
+    Arena() {
+        for (auto &list : remote_list) {
+            list = nullptr;
+        }
+    }
+};
+
+static atomic<uint64_t> s_chunks{0};
+static atomic<uint64_t> s_hugetlb_chunks{0};
+static atomic<uint64_t> s_large{0};
+static atomic<uint64_t> s_remote_frees{0};
+static atomic<uint64_t> s_large_hits{0};
+static atomic<uint64_t> s_large_cached{0};
+static atomic<uint64_t> s_trimmed{0};
+
+//进程级共享的大帧缓存
+static mutex s_shared_mtx;
+static FreeBlock *s_shared_list[SlabAllocator::kLargeClassCount] = {nullptr};
+static size_t s_shared_bytes = 0;
+
+//线程退出后留下的arena，其中的内存块可能还在被使用，交给新线程继续使用
+static mutex s_orphan_mtx;
+static Arena *s_orphans = nullptr;
+
+class ArenaHolder {
+public:
+    ~ArenaHolder() {
+        if (!arena) {
+            return;
+        }
+        lock_guard<mutex> lck(s_orphan_mtx);
+        arena->next_orphan = s_orphans;
+        s_orphans = arena;
+        arena = nullptr;
+    }
+
+    Arena *get() {
+        if (arena) {
+            return arena;
+        }
+        {
+            lock_guard<mutex> lck(s_orphan_mtx);
+            if (s_orphans) {
+                arena = s_orphans;
+                s_orphans = arena->next_orphan;
+                arena->next_orphan = nullptr;
+            }
+        }
+        if (!arena) {
+            arena = new Arena;
+        }
+        return arena;
+    }
+
+public:
+    Arena *arena = nullptr;
+};
+
+static thread_local ArenaHolder s_holder;
+
+static inline int classOf(size_t size) {
+    for (int i = 0; i < ALL_CLASS_COUNT; ++i) {
+        if (size <= kClassSize[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static inline FreeBlock *blockOf(BlockHeader *header) {
+    return (FreeBlock *) (header + 1);
+}
+
+static inline BlockHeader *headerOf(void *ptr) {
+    return (BlockHeader *) ptr - 1;
+}
+
+static void *allocateLarge(int cls) {
+    auto index = cls - SlabAllocator::kClassCount;
+    auto size = kClassSize[cls];
+    auto arena = s_holder.get();
+    auto block = arena->large_list[index];
+    if (block) {
+        arena->large_list[index] = block->next;
+        arena->large_bytes -= size;
+    } else {
+        lock_guard<mutex> lck(s_shared_mtx);
+        block = s_shared_list[index];
+        if (block) {
+            s_shared_list[index] = block->next;
+            s_shared_bytes -= size;
+        }
+    }
+
+    BlockHeader *header;
+    if (block) {
+        ++s_large_hits;
+        s_large_cached -= size;
+        header = headerOf(block);
+    } else {
+        header = (BlockHeader *) malloc(sizeof(BlockHeader) + size);
+        if (!header) {
+            return nullptr;
+        }
+        ++s_large;
+        header->cls = cls;
+        header->reserved = 0;
+    }
+    //记录申请的线程，由该线程释放时放入线程缓存
+    header->arena = arena;
+    return blockOf(header);
+}
+
+static void deallocateLarge(BlockHeader *header) {
+    auto index = header->cls - SlabAllocator::kClassCount;
+    auto size = kClassSize[header->cls];
+    auto block = blockOf(header);
+    auto arena = s_holder.arena;
+    if (arena && header->arena == arena && arena->large_bytes + size <= SlabAllocator::kThreadCacheSize) {
+        block->next = arena->large_list[index];
+        arena->large_list[index] = block;
+        arena->large_bytes += size;
+        s_large_cached += size;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lck(s_shared_mtx);
+        if (s_shared_bytes + size <= SlabAllocator::kSharedCacheSize) {
+            block->next = s_shared_list[index];
+            s_shared_list[index] = block;
+            s_shared_bytes += size;
+            s_large_cached += size;
+            return;
+        }
+    }
+    free(header);
+}
+
+static uint64_t freeList(FreeBlock *block, size_t size) {
+    uint64_t bytes = 0;
+    while (block) {
+        auto next = block->next;
+        free(headerOf(block));
+        bytes += size;
+        block = next;
+    }
+    return bytes;
+}
+
+static bool refill(Arena *arena, int cls) {
+    char *ptr;
+    if (HugePage::isEnabled()) {
+        bool hugetlb;
+        ptr = (char *) HugePage::map(SlabAllocator::kChunkSize, &hugetlb);
+        if (!ptr) {
+            return false;
+        }
+        if (hugetlb) {
+            ++s_hugetlb_chunks;
+        }
+    } else {
+        ptr = (char *) mmap(nullptr, SlabAllocator::kChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return false;
+        }
+    }
+    ++s_chunks;
+    //在本线程首次访问，内存分配在本地numa节点
+    CpuPlacement::firstTouch(ptr, SlabAllocator::kChunkSize);
+    auto stride = sizeof(BlockHeader) + kClassSize[cls];
+    auto count = SlabAllocator::kChunkSize / stride;
+    FreeBlock *head = arena->free_list[cls];
+    //倒序切分，使得链表按地址递增
+    for (auto i = count; i > 0; --i) {
+        auto header = (BlockHeader *) (ptr + (i - 1) * stride);
+        header->arena = arena;
+        header->cls = cls;
+        header->reserved = 0;
+        auto block = blockOf(header);
+        block->next = head;
+        head = block;
+    }
+    arena->free_list[cls] = head;
+    return true;
+}
+
+void *SlabAllocator::allocate(size_t size, size_t &capacity) {
+    auto cls = classOf(size);
+    if (cls >= kClassCount) {
+        auto ptr = allocateLarge(cls);
+        if (ptr) {
+            capacity = kClassSize[cls];
+        }
+        return ptr;
+    }
+    if (cls < 0) {
+        auto header = (BlockHeader *) malloc(sizeof(BlockHeader) + size);
+        if (!header) {
+            return nullptr;
+        }
+        ++s_large;
+        header->arena = nullptr;
+        header->cls = LARGE_CLASS;
+        capacity = size;
+        return header + 1;
+    }
+
+    auto arena = s_holder.get();
+    auto block = arena->free_list[cls];
+    if (!block) {
+        //取回其他线程释放的内存块
+        block = arena->remote_list[cls].exchange(nullptr, memory_order_acquire);
+        if (!block) {
+            if (!refill(arena, cls)) {
+                return nullptr;
+            }
+            block = arena->free_list[cls];
+        }
+    }
+    arena->free_list[cls] = block->next;
+    capacity = kClassSize[cls];
+    return block;
+}
+
+void SlabAllocator::deallocate(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    auto header = headerOf(ptr);
+    if (header->cls == LARGE_CLASS) {
+        free(header);
+        return;
+    }
+    if (header->cls >= kClassCount) {
+        deallocateLarge(header);
+        return;
+    }
+
+    auto arena = header->arena;
+    auto block = (FreeBlock *) ptr;
+    if (arena == s_holder.arena) {
+        block->next = arena->free_list[header->cls];
+        arena->free_list[header->cls] = block;
+        return;
+    }
+
+    //其他线程的内存块，放入其无锁回收链表
+    ++s_remote_frees;
+    auto &list = arena->remote_list[header->cls];
+    auto head = list.load(memory_order_relaxed);
+    do {
+        block->next = head;
+    } while (!list.compare_exchange_weak(head, block, memory_order_release, memory_order_relaxed));
+}
+
+size_t SlabAllocator::roundUp(size_t size) {
+    auto cls = classOf(size);
+    return cls < 0 ? size : kClassSize[cls];
+}
+
+void SlabAllocator::warmUp(uint32_t chunks) {
+    auto arena = s_holder.get();
+    for (int cls = 0; cls < kClassCount; ++cls) {
+        for (uint32_t i = 0; i < chunks; ++i) {
+            if (!refill(arena, cls)) {
+                return;
+            }
+        }
+    }
+}
+
+uint64_t SlabAllocator::trim() {
+    uint64_t bytes = 0;
+    auto arena = s_holder.arena;
+    if (arena) {
+        for (int i = 0; i < kLargeClassCount; ++i) {
+            bytes += freeList(arena->large_list[i], kClassSize[kClassCount + i]);
+            arena->large_list[i] = nullptr;
+        }
+        arena->large_bytes = 0;
+    }
+
+    FreeBlock *lists[kLargeClassCount];
+    {
+        lock_guard<mutex> lck(s_shared_mtx);
+        for (int i = 0; i < kLargeClassCount; ++i) {
+            lists[i] = s_shared_list[i];
+            s_shared_list[i] = nullptr;
+        }
+        s_shared_bytes = 0;
+    }
+    //在锁外释放
+    for (int i = 0; i < kLargeClassCount; ++i) {
+        bytes += freeList(lists[i], kClassSize[kClassCount + i]);
+    }
+    s_large_cached -= bytes;
+    s_trimmed += bytes;
+    return bytes;
+}
+
+SlabAllocator::Stats SlabAllocator::getStats() {
+    Stats stats;
+    stats.chunks = s_chunks.load();
+    stats.hugetlb_chunks = s_hugetlb_chunks.load();
+    stats.large = s_large.load();
+    stats.remote_frees = s_remote_frees.load();
+    stats.large_hits = s_large_hits.load();
+    stats.large_cached = s_large_cached.load();
+    stats.trimmed = s_trimmed.load();
+    return stats;
+}
+
+}//namespace mediakit
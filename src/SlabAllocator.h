@@ -0,0 +1,121 @@
+#ifndef RTP2PS_SLABALLOCATOR_H
+#define RTP2PS_SLABALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+
+namespace mediakit{
+
+/**
+ * 按固定尺寸分级的slab内存分配器
+ * 尺寸分为1.5K(一个以太网MTU)、4K、10K、64K四级，每个线程有自己的arena，
+ * arena按2MB的块向系统申请内存(启用大页时使用HugePage)并切分成固定大小的内存块，申请与释放都是O(1)的链表操作，
+ * 同一级的内存块大小相同，不会产生碎片；
+ * 其他线程释放的内存块放入所属arena的无锁回收链表，由所属线程在下次申请时取回；
+ * 64K到4M之间按2的幂分级(大帧缓存)，使用malloc申请，释放后缓存在本线程，超过线程缓存上限或者由其他线程释放时
+ * 放入进程级的共享缓存，所有流共用，帧缓存扩容时不必每次都向系统申请；内存紧张时由trim()释放缓存；
+ * 超过4M的申请直接使用malloc
+ */
+class SlabAllocator {
+public:
+    //尺寸分级个数
+    static const int kClassCount = 4;
+    //大帧缓存的分级个数，128K到4M
+    static const int kLargeClassCount = 6;
+    //每个线程缓存的大帧缓存上限
+    static const size_t kThreadCacheSize = 16 * 1024 * 1024;
+    //进程级共享缓存的大帧缓存上限
+    static const size_t kSharedCacheSize = 64 * 1024 * 1024;
+    //单次向系统申请的内存大小
+    static const size_t kChunkSize = 2 * 1024 * 1024;
+
+    struct Stats {
+        //向系统申请的块数
+        uint64_t chunks = 0;
+        //使用MAP_HUGETLB大页的块数
+        uint64_t hugetlb_chunks = 0;
+        //使用malloc的大内存申请次数
+        uint64_t large = 0;
+        //跨线程释放次数
+        uint64_t remote_frees = 0;
+        //大帧缓存命中次数
+        uint64_t large_hits = 0;
+        //当前缓存的大帧缓存字节数
+        uint64_t large_cached = 0;
+        //trim()释放的字节数
+        uint64_t trimmed = 0;
+    };
+
+    /**
+     * 申请内存
+     * @param size 申请的大小
+     * @param capacity 返回实际可用的大小(所在分级的大小)
+     */
+    static void *allocate(size_t size, size_t &capacity);
+
+    /**
+     * 释放allocate()申请的内存，可以在任意线程调用
+     */
+    static void deallocate(void *ptr);
+
+    /**
+     * 申请size字节时实际可用的大小
+     */
+    static size_t roundUp(size_t size);
+
+    /**
+     * 为当前线程的arena预先申请内存并按页写入，
+     * 线程绑定cpu后调用，使内存位于本地numa节点
+     * @param chunks 每个分级预先申请的块数
+     */
+    static void warmUp(uint32_t chunks);
+
+    /**
+     * 释放本线程与进程级共享缓存中的大帧缓存，内存紧张时调用
+     * @return 释放的字节数
+     */
+    static uint64_t trim();
+
+    static Stats getStats();
+};
+
+/**
+ * 基于SlabAllocator的stl分配器
+ */
+template<typename T>
+class SlabStlAllocator {
+public:
+    typedef T value_type;
+
+    SlabStlAllocator() = default;
+
+    template<typename U>
+    SlabStlAllocator(const SlabStlAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        size_t capacity;
+        auto ptr = SlabAllocator::allocate(n * sizeof(T), capacity);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return (T *) ptr;
+    }
+
+    void deallocate(T *ptr, size_t) {
+        SlabAllocator::deallocate(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const SlabStlAllocator<U> &) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const SlabStlAllocator<U> &) const {
+        return false;
+    }
+};
+
+}//namespace mediakit
+#endif //RTP2PS_SLABALLOCATOR_H
@@ -0,0 +1,350 @@
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+#include "TcpStream.h"
+
+using namespace std;
+
+namespace mediakit{
+
+//序列号差值，考虑回环
+static inline int32_t seqDiff(uint32_t a, uint32_t b) {
+    return (int32_t) (a - b);
+}
+
+TcpStream::TcpStream(uint32_t capacity) {
+    if (!capacity || (capacity & (capacity - 1))) {
+        throw std::invalid_argument("TcpStream capacity必须为2的幂");
+    }
+    _capacity = capacity;
+    _ring = new char[capacity];
+}
+
+TcpStream::~TcpStream() {
+    delete [] _ring;
+    if (_account) {
+        _account->release(_capacity);
+    }
+}
+
+void TcpStream::setMemoryAccount(const MemoryAccount::Ptr &account) {
+    if (_account) {
+        _account->release(_capacity);
+    }
+    _account = account;
+    if (_account) {
+        _account->charge(_capacity);
+    }
+}
+
+void TcpStream::setOnRtp(RtpSplitter::onRtp cb) {
+    _splitter.setOnRtp(std::move(cb));
+}
+
+uint32_t TcpStream::getPendingSize() const {
+    return _tail_seq - _head_seq;
+}
+
+uint32_t TcpStream::getEndSeq() const {
+    return _tail_seq;
+}
+
+uint64_t TcpStream::getLostBytes() const {
+    return _lost_bytes;
+}
+
+uint64_t TcpStream::getResyncCount() const {
+    return _splitter.getResyncCount();
+}
+
+void TcpStream::flush() {
+    drain();
+    while (true) {
+        if (!skipGap()) {
+            if (!getPendingSize()) {
+                break;
+            }
+            //剩余的帧不会再补全，也可能是重新同步时误判的帧头，跳过一个字节继续查找
+            ++_lost_bytes;
+            ++_head_seq;
+            _need_resync = true;
+        }
+        drain();
+    }
+}
+
+void TcpStream::saveState(CheckpointWriter &writer) const {
+    writer.write(_inited);
+    writer.write(_need_resync);
+    writer.write(_head_seq);
+    writer.write(_tail_seq);
+    writer.write(_lost_bytes);
+    string data(getPendingSize(), '\0');
+    peek(_head_seq, &data[0], data.size());
+    writer.writeBytes(data.data(), data.size());
+    writer.write((uint32_t) _out_of_order.size());
+    for (auto &range : _out_of_order) {
+        data.resize(range.second - range.first);
+        peek(range.first, &data[0], data.size());
+        writer.write(range.first);
+        writer.writeBytes(data.data(), data.size());
+    }
+    _splitter.saveState(writer);
+}
+
+bool TcpStream::loadState(CheckpointReader &reader) {
+    const char *data;
+    uint32_t size;
+    uint32_t count;
+    if (!reader.read(_inited) || !reader.read(_need_resync) || !reader.read(_head_seq) || !reader.read(_tail_seq)
+        || !reader.read(_lost_bytes) || !reader.readBytes(data, size) || size != getPendingSize() || size > _capacity
+        || !reader.read(count)) {
+        return false;
+    }
+    write(_head_seq, data, size);
+    _out_of_order.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t start;
+        if (!reader.read(start) || !reader.readBytes(data, size) || seqDiff(start + size, _head_seq) > (int32_t) _capacity) {
+            return false;
+        }
+        write(start, data, size);
+        _out_of_order.emplace_back(start, start + size);
+    }
+    return _splitter.loadState(reader);
+}
+
+void TcpStream::write(uint32_t seq, const char *data, uint32_t len) {
+    auto pos = seq & (_capacity - 1);
+    auto first = min(len, _capacity - pos);
+    memcpy(_ring + pos, data, first);
+    if (first < len) {
+        memcpy(_ring, data + first, len - first);
+    }
+}
+
+void TcpStream::peek(uint32_t seq, char *out, uint32_t len) const {
+    auto pos = seq & (_capacity - 1);
+    auto first = min(len, _capacity - pos);
+    memcpy(out, _ring + pos, first);
+    if (first < len) {
+        memcpy(out + first, _ring, len - first);
+    }
+}
+
+void TcpStream::inputData(char *data, uint32_t len) {
+    if (!_inited) {
+        _inited = true;
+        _head_seq = _tail_seq = 0;
+    }
+    inputSegment(_tail_seq, data, len);
+}
+
+void TcpStream::inputSegment(uint32_t seq, char *data, uint32_t len, bool syn) {
+    if (syn) {
+        //syn包占用一个序列号，之后重新开始拆包
+        _inited = true;
+        _need_resync = false;
+        _head_seq = _tail_seq = seq + 1;
+        _out_of_order.clear();
+        _splitter.reset();
+        return;
+    }
+    if (!len) {
+        return;
+    }
+    if (!_inited) {
+        //未抓到syn包，从第一个分片开始
+        _inited = true;
+        _head_seq = _tail_seq = seq;
+    }
+
+    auto overlap = seqDiff(_tail_seq, seq);
+    if (overlap > 0) {
+        //重传的数据，去掉已经收到的部分
+        if ((uint32_t) overlap >= len) {
+            return;
+        }
+        data += overlap;
+        len -= overlap;
+        seq = _tail_seq;
+    }
+
+    if (seq == _tail_seq && _out_of_order.empty()) {
+        inputInOrder(data, len);
+        return;
+    }
+
+    if (len > _capacity) {
+        //超大乱序分片，不可能缓存
+        _lost_bytes += len;
+        return;
+    }
+
+    while (seqDiff(seq + len, _head_seq) > (int32_t) _capacity) {
+        //缓存溢出，说明缺失的分片已经不会再到达了
+        if (!skipGap()) {
+            //没有可用的乱序数据，直接跳到该分片
+            _lost_bytes += seqDiff(seq, _head_seq);
+            _head_seq = _tail_seq = seq;
+            _need_resync = true;
+            break;
+        }
+    }
+
+    write(seq, data, len);
+    if (seq == _tail_seq) {
+        _tail_seq += len;
+    } else {
+        addOutOfOrder(seq, seq + len);
+    }
+    mergeOutOfOrder();
+    drain();
+}
+
+void TcpStream::inputInOrder(char *data, uint32_t len) {
+    while (len && _head_seq != _tail_seq) {
+        //缓存中有不完整的帧，只拷贝补全该帧所需的数据
+        auto need = completeSize();
+        if (!need) {
+            write(_tail_seq, data, len);
+            _tail_seq += len;
+            drain();
+            return;
+        }
+        auto take = min(need, len);
+        write(_tail_seq, data, take);
+        _tail_seq += take;
+        data += take;
+        len -= take;
+        drain();
+    }
+    if (!len) {
+        return;
+    }
+
+    //缓存为空，直接在原始数据上拆包
+    auto consumed = _splitter.input(data, len);
+    _head_seq = _tail_seq = _tail_seq + consumed;
+    if (consumed < len) {
+        write(_tail_seq, data + consumed, len - consumed);
+        _tail_seq += len - consumed;
+    }
+}
+
+uint32_t TcpStream::completeSize() {
+    if (_need_resync) {
+        return 0;
+    }
+    char header[6];
+    auto pending = getPendingSize();
+    auto n = min(pending, (uint32_t) sizeof(header));
+    peek(_head_seq, header, n);
+    uint32_t header_size;
+    auto size = _splitter.frameSize(header, n, header_size);
+    if (size == 0) {
+        //帧头不完整，先补全帧头
+        return sizeof(header) - n;
+    }
+    if (size < 0 || (uint32_t) size <= pending) {
+        return 0;
+    }
+    return size - pending;
+}
+
+void TcpStream::addOutOfOrder(uint32_t start, uint32_t end) {
+    auto head = _head_seq;
+    _out_of_order.emplace_back(start, end);
+    sort(_out_of_order.begin(), _out_of_order.end(), [head](const pair<uint32_t, uint32_t> &a, const pair<uint32_t, uint32_t> &b) {
+        return (uint32_t) (a.first - head) < (uint32_t) (b.first - head);
+    });
+    //合并重叠的区间
+    auto out = _out_of_order.begin();
+    for (auto it = _out_of_order.begin() + 1; it != _out_of_order.end(); ++it) {
+        if (seqDiff(it->first, out->second) <= 0) {
+            if (seqDiff(it->second, out->second) > 0) {
+                out->second = it->second;
+            }
+            continue;
+        }
+        *(++out) = *it;
+    }
+    _out_of_order.erase(out + 1, _out_of_order.end());
+}
+
+void TcpStream::mergeOutOfOrder() {
+    auto it = _out_of_order.begin();
+    for (; it != _out_of_order.end() && seqDiff(it->first, _tail_seq) <= 0; ++it) {
+        if (seqDiff(it->second, _tail_seq) > 0) {
+            _tail_seq = it->second;
+        }
+    }
+    _out_of_order.erase(_out_of_order.begin(), it);
+}
+
+bool TcpStream::skipGap() {
+    if (_out_of_order.empty()) {
+        return false;
+    }
+    //丢弃缺口之前不完整的帧，从下一段乱序数据重新开始拆包
+    auto &range = _out_of_order.front();
+    _lost_bytes += seqDiff(range.first, _head_seq);
+    _head_seq = range.first;
+    _tail_seq = range.second;
+    _out_of_order.erase(_out_of_order.begin());
+    mergeOutOfOrder();
+    _need_resync = true;
+    return true;
+}
+
+void TcpStream::resync() {
+    auto pending = getPendingSize();
+    _scratch.resize(pending);
+    peek(_head_seq, &_scratch[0], pending);
+    auto offset = _splitter.resync(_scratch.data(), pending);
+    _lost_bytes += offset;
+    _head_seq += offset;
+    _need_resync = false;
+}
+
+void TcpStream::drain() {
+    if (_need_resync) {
+        resync();
+    }
+    while (true) {
+        auto pending = getPendingSize();
+        if (!pending) {
+            break;
+        }
+        char header[6];
+        auto n = min(pending, (uint32_t) sizeof(header));
+        peek(_head_seq, header, n);
+        uint32_t header_size;
+        auto size = _splitter.frameSize(header, n, header_size);
+        if (size < 0) {
+            //帧头非法，跳过当前字节重新同步
+            ++_lost_bytes;
+            ++_head_seq;
+            resync();
+            continue;
+        }
+        if (size == 0 || (uint32_t) size > pending) {
+            //等待后续数据
+            break;
+        }
+        char *frame;
+        auto pos = _head_seq & (_capacity - 1);
+        if (pos + size <= _capacity) {
+            frame = _ring + pos;
+        } else {
+            //帧跨越了环形缓存末尾
+            _scratch.resize(size);
+            peek(_head_seq, &_scratch[0], size);
+            frame = &_scratch[0];
+        }
+        _head_seq += size;
+        _splitter.onFrame(frame, header_size, size);
+    }
+}
+
+}//namespace mediakit
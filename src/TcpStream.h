@@ -0,0 +1,113 @@
+#ifndef RTP2PS_TCPSTREAM_H
+#define RTP2PS_TCPSTREAM_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "RtpSplitter.h"
+#include "MemoryBudget.h"
+
+namespace mediakit{
+
+/**
+ * 单个tcp流的重组与拆包
+ * 按tcp序列号把分片写入环形缓存，连续的数据交给RtpSplitter拆出rtp；
+ * 按序到达且帧完整的分片直接在原始内存上拆包，只有跨分片的不完整帧以及乱序分片才会被拷贝
+ */
+class TcpStream {
+public:
+    /**
+     * @param capacity 环形缓存大小，必须为2的幂且大于最大帧长度
+     */
+    TcpStream(uint32_t capacity = 256 * 1024);
+    ~TcpStream();
+
+    TcpStream(const TcpStream &) = delete;
+    TcpStream &operator=(const TcpStream &) = delete;
+
+    /**
+     * 设置rtp包回调
+     */
+    void setOnRtp(RtpSplitter::onRtp cb);
+
+    /**
+     * 设置内存账户，环形缓存占用的内存记在该账户上
+     */
+    void setMemoryAccount(const MemoryAccount::Ptr &account);
+
+    /**
+     * 输入抓包得到的tcp分片
+     * @param seq tcp序列号
+     * @param data tcp负载
+     * @param len tcp负载长度
+     * @param syn 是否为syn包
+     */
+    void inputSegment(uint32_t seq, char *data, uint32_t len, bool syn = false);
+
+    /**
+     * 输入已排序的数据，譬如socket收到的数据
+     */
+    void inputData(char *data, uint32_t len);
+
+    /**
+     * 缓存中未拆包的数据长度
+     */
+    uint32_t getPendingSize() const;
+
+    /**
+     * 连续数据末尾的序列号，即下一个期望的序列号
+     */
+    uint32_t getEndSeq() const;
+
+    /**
+     * 因分片丢失、帧头非法或流结束时帧不完整而丢弃的字节数
+     */
+    uint64_t getLostBytes() const;
+
+    /**
+     * 帧头非法导致的重新同步次数
+     */
+    uint64_t getResyncCount() const;
+
+    /**
+     * 流结束或空闲超时时调用，缺失的分片不会再到达，跳过缺口拆出剩余乱序数据中的帧，不完整的帧被丢弃
+     */
+    void flush();
+
+    /**
+     * 保存/恢复序列号、未拆包的数据与乱序数据，用于断点续传
+     */
+    void saveState(CheckpointWriter &writer) const;
+    bool loadState(CheckpointReader &reader);
+
+private:
+    void inputInOrder(char *data, uint32_t len);
+    void write(uint32_t seq, const char *data, uint32_t len);
+    void peek(uint32_t seq, char *out, uint32_t len) const;
+    uint32_t completeSize();
+    void addOutOfOrder(uint32_t start, uint32_t end);
+    void mergeOutOfOrder();
+    bool skipGap();
+    void resync();
+    void drain();
+
+private:
+    bool _inited = false;
+    bool _need_resync = false;
+    //缓存中第一个字节的序列号
+    uint32_t _head_seq = 0;
+    //连续数据末尾的序列号
+    uint32_t _tail_seq = 0;
+    uint32_t _capacity;
+    uint64_t _lost_bytes = 0;
+    char *_ring;
+    //跨越环形缓存末尾的帧拷贝到此处
+    std::string _scratch;
+    //乱序到达的数据区间[start, end)，按序列号排序
+    std::vector<std::pair<uint32_t, uint32_t> > _out_of_order;
+    RtpSplitter _splitter;
+    MemoryAccount::Ptr _account;
+};
+
+}//namespace mediakit
+#endif //RTP2PS_TCPSTREAM_H
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <mutex>
+#include "Trace.h"
+#include "Logger.h"
+
+using namespace std;
+
+namespace mediakit{
+
+atomic<bool> Trace::s_enabled{false};
+uint32_t Trace::s_sample = 1;
+
+static mutex s_mtx;
+static vector<shared_ptr<Trace::ThreadBuffer> > s_buffers;
+static size_t s_capacity = 0;
+//开始记录时的时钟，用于把tsc换算成微秒
+static uint64_t s_start_tick = 0;
+static chrono::steady_clock::time_point s_start_time;
+
+void Trace::start(uint32_t sample, size_t capacity) {
+    lock_guard<mutex> lck(s_mtx);
+    //线程缓存保持注册，清空已有的事件
+    for (auto &buffer : s_buffers) {
+        buffer->size = 0;
+        buffer->dropped = 0;
+        buffer->events.resize(capacity);
+    }
+    s_capacity = capacity;
+    s_sample = sample ? sample : 1;
+    s_start_time = chrono::steady_clock::now();
+    s_start_tick = now();
+    s_enabled = true;
+}
+
+void Trace::stop() {
+    s_enabled = false;
+}
+
+bool Trace::isCompiled() {
+#ifdef ENABLE_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Trace::push(ThreadState &st, const char *name, uint64_t start, uint64_t duration) {
+    if (!st.buffer) {
+        //首次记录时创建本线程的缓存
+        auto buffer = std::make_shared<ThreadBuffer>();
+        buffer->tid = syscall(SYS_gettid);
+        lock_guard<mutex> lck(s_mtx);
+        buffer->events.resize(s_capacity);
+        s_buffers.emplace_back(buffer);
+        st.buffer = buffer;
+    }
+    auto &buffer = *st.buffer;
+    auto size = buffer.size.load(memory_order_relaxed);
+    if (size >= buffer.events.size()) {
+        ++buffer.dropped;
+        return;
+    }
+    auto &event = buffer.events[size];
+    event.name = name;
+    event.start = start;
+    event.duration = duration;
+    buffer.size.store(size + 1, memory_order_release);
+}
+
+int Trace::dump(const string &path) {
+    //用开始记录到现在的时长校准tsc频率
+    auto ticks = now() - s_start_tick;
+    auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - s_start_time).count();
+    double ticks_per_us = us > 0 && ticks > 0 ? (double) ticks / us : 1.0;
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        PrintE("打开跟踪文件失败:%s", path.c_str());
+        return -1;
+    }
+
+    lock_guard<mutex> lck(s_mtx);
+    auto pid = getpid();
+    int count = 0;
+    uint64_t dropped = 0;
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (auto &buffer : s_buffers) {
+        fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"thread-%u\"}}",
+                count ? ",\n" : "", pid, buffer->tid, buffer->tid);
+        ++count;
+        auto size = buffer->size.load(memory_order_acquire);
+        for (size_t i = 0; i < size; ++i) {
+            auto &event = buffer->events[i];
+            //事件可能早于start()，例如跨越start()的span
+            double ts = event.start > s_start_tick ? (event.start - s_start_tick) / ticks_per_us : 0;
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                    event.name, pid, buffer->tid, ts, event.duration / ticks_per_us);
+            ++count;
+        }
+        dropped += buffer->dropped;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    PrintI("跟踪事件:%d, 丢弃:%llu, 文件:%s", count, (unsigned long long) dropped, path.c_str());
+    return count;
+}
+
+}//namespace mediakit
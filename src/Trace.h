@@ -0,0 +1,160 @@
+#ifndef RTP2PS_TRACE_H
+#define RTP2PS_TRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+namespace mediakit{
+
+/**
+ * 流水线各阶段的耗时跟踪，导出为Chrome trace event格式的json，可在Perfetto中打开
+ * 每个线程有自己的事件缓存，记录时不加锁；按最外层span采样，被采样的span内的嵌套span全部记录；
+ * 编译时未定义ENABLE_TRACE时TraceSpan()展开为空，没有任何开销
+ */
+class Trace {
+public:
+    struct Event {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    struct ThreadBuffer {
+        uint32_t tid = 0;
+        std::vector<Event> events;
+        //已写入的事件数
+        std::atomic<size_t> size{0};
+        //缓存满而丢弃的事件数
+        uint64_t dropped = 0;
+    };
+
+    struct ThreadState {
+        std::shared_ptr<ThreadBuffer> buffer;
+        uint32_t depth = 0;
+        uint32_t counter = 0;
+        bool sampled = false;
+    };
+
+    /**
+     * 开始记录
+     * @param sample 每sample个最外层span记录一个，1为全部记录
+     * @param capacity 每个线程最多记录的事件数
+     */
+    static void start(uint32_t sample = 1, size_t capacity = 256 * 1024);
+
+    /**
+     * 停止记录
+     */
+    static void stop();
+
+    /**
+     * 把已记录的事件写入文件
+     * @return 写入的事件数，失败返回-1
+     */
+    static int dump(const std::string &path);
+
+    /**
+     * 编译时是否开启了跟踪
+     */
+    static bool isCompiled();
+
+    static bool isEnabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+    }
+
+    static ThreadState &state() {
+        static thread_local ThreadState s_state;
+        return s_state;
+    }
+
+    /**
+     * 进入span，返回是否需要记录
+     */
+    static bool begin() {
+        auto &st = state();
+        if (st.depth++ == 0) {
+            st.sampled = ++st.counter >= s_sample;
+            if (st.sampled) {
+                st.counter = 0;
+            }
+        }
+        return st.sampled;
+    }
+
+    /**
+     * 退出span
+     * @param record 是否记录
+     */
+    static void end(const char *name, uint64_t start, bool record) {
+        auto &st = state();
+        --st.depth;
+        if (record) {
+            push(st, name, start, now() - start);
+        }
+    }
+
+private:
+    static void push(ThreadState &st, const char *name, uint64_t start, uint64_t duration);
+
+private:
+    static std::atomic<bool> s_enabled;
+    static uint32_t s_sample;
+};
+
+/**
+ * 作用域span
+ */
+class TraceScope {
+public:
+    TraceScope(const char *name) {
+        _active = Trace::isEnabled();
+        _record = _active && Trace::begin();
+        if (_record) {
+            _name = name;
+            _start = Trace::now();
+        }
+    }
+
+    ~TraceScope() {
+        if (_active) {
+            Trace::end(_name, _start, _record);
+        }
+    }
+
+private:
+    bool _record;
+    bool _active;
+    const char *_name = nullptr;
+    uint64_t _start = 0;
+};
+
+}//namespace mediakit
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+
+#ifdef ENABLE_TRACE
+#define TraceSpan(name) mediakit::TraceScope TRACE_CONCAT(__trace_scope_, __LINE__)(name)
+#else
+#define TraceSpan(name) do {} while (0)
+#endif
+
+#endif //RTP2PS_TRACE_H
@@ -1,5 +0,0 @@
-#include "global.hpp"
-
-
-string inputfile;
-string outputfile;
\ No newline at end of file
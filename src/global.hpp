@@ -1,15 +0,0 @@
-#ifndef GLOBAL_H_
-#define GLOBAL_H_
-
-#include <string>
-
-using namespace std;
-
-
-
-extern string inputfile;
-extern string outputfile;
-
-
-
-#endif /* GLOBAL_H_ */
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "H26xRtp.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace mediakit;
+
+/**
+ * H26xRtpDecoder丢包处理的测试：帧内丢包或帧太大时整帧丢弃，同一帧后续的包也不能输出
+ */
+
+//只记录输出的帧
+class CountWriter : public FrameWriterInterface {
+public:
+    void inputFrame(const Frame::Ptr &frame) override {
+        ++frames;
+        last.assign(frame->data(), frame->size());
+    }
+
+    int frames = 0;
+    string last;
+};
+
+static RtpPacket::Ptr makeRtp(uint16_t seq, uint32_t stamp, bool mark, const string &payload) {
+    auto rtp = std::make_shared<RtpPacket>();
+    rtp->setCapacity(12 + payload.size());
+    rtp->setSize(12 + payload.size());
+    memcpy(rtp->data() + 12, payload.data(), payload.size());
+    rtp->offset = 12;
+    rtp->sequence = seq;
+    rtp->timeStamp = stamp;
+    rtp->mark = mark;
+    rtp->PT = 96;
+    rtp->type = TrackVideo;
+    return rtp;
+}
+
+//h264 FU-A分片，nalu类型为5(IDR)
+static string fuA(bool start, bool end, char fill) {
+    string payload;
+    payload.push_back((char) 0x7C);
+    payload.push_back((char) ((start ? 0x80 : 0) | (end ? 0x40 : 0) | 5));
+    payload.append(100, fill);
+    return payload;
+}
+
+//h264 STAP-A，包含一个类型为1的nalu
+static string stapA() {
+    string payload;
+    payload.push_back((char) 24);
+    payload.push_back(0);
+    payload.push_back(3);
+    payload.append("\x41\x01\x02", 3);
+    return payload;
+}
+
+static int s_failed = 0;
+
+static void check(bool ok, const char *what) {
+    printf("%s %s\n", ok ? "ok" : "FAIL", what);
+    if (!ok) {
+        ++s_failed;
+    }
+}
+
+//FU-A中间分片丢失，之后同一帧的分片、STAP-A、单nalu包与结束分片都不输出
+static void testLostFuMiddle() {
+    auto writer = std::make_shared<CountWriter>();
+    H26xRtpDecoder decoder(CodecH264);
+    decoder.setFrameWriter(writer);
+    decoder.inputRtp(makeRtp(1, 3000, false, fuA(true, false, 'a')));
+    //丢失seq 2
+    decoder.inputRtp(makeRtp(3, 3000, false, fuA(false, false, 'c')));
+    decoder.inputRtp(makeRtp(4, 3000, false, stapA()));
+    decoder.inputRtp(makeRtp(5, 3000, false, string("\x41\x05\x06", 3)));
+    decoder.inputRtp(makeRtp(6, 3000, false, fuA(true, false, 'd')));
+    decoder.inputRtp(makeRtp(7, 3000, true, fuA(false, true, 'e')));
+    check(writer->frames == 0, "帧内丢包时整帧丢弃");
+
+    //下一帧完整，正常输出
+    decoder.inputRtp(makeRtp(8, 3040, false, fuA(true, false, 'f')));
+    decoder.inputRtp(makeRtp(9, 3040, true, fuA(false, true, 'g')));
+    check(writer->frames == 1 && writer->last.size() == 4 + 1 + 200, "丢包后的下一帧正常输出");
+}
+
+//帧太大时丢弃，同一帧后续的包不输出
+static void testFrameTooLarge() {
+    auto writer = std::make_shared<CountWriter>();
+    H26xRtpDecoder decoder(CodecH264, 150);
+    decoder.setFrameWriter(writer);
+    decoder.inputRtp(makeRtp(1, 3000, false, fuA(true, false, 'a')));
+    decoder.inputRtp(makeRtp(2, 3000, false, fuA(false, false, 'b')));
+    decoder.inputRtp(makeRtp(3, 3000, true, stapA()));
+    check(writer->frames == 0, "帧太大时整帧丢弃");
+}
+
+//丢弃未完成帧后，同一帧后续的包不输出
+static void testDropFrame() {
+    auto writer = std::make_shared<CountWriter>();
+    H26xRtpDecoder decoder(CodecH264);
+    decoder.setFrameWriter(writer);
+    decoder.inputRtp(makeRtp(1, 3000, false, fuA(true, false, 'a')));
+    check(decoder.dropFrame() > 0, "dropFrame释放未完成帧");
+    decoder.inputRtp(makeRtp(2, 3000, false, stapA()));
+    decoder.inputRtp(makeRtp(3, 3000, true, fuA(false, true, 'b')));
+    check(writer->frames == 0, "dropFrame后同一帧不输出");
+}
+
+int main(int argc, char **argv) {
+    Logger::setLevel(LError);
+    testLostFuMiddle();
+    testFrameTooLarge();
+    testDropFrame();
+    return s_failed ? -1 : 0;
+}
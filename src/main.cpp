@@ -1,25 +1,203 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <vector>
 #include "stream.hpp"
-#include "global.hpp"
+#include "FileWriter.h"
+#include "Checkpoint.h"
+#include "AsyncWriter.h"
+#include "PipeWriter.h"
+#include "SegmentWriter.h"
+#include "MemoryBudget.h"
+#include "HugePage.h"
+#include "SlabAllocator.h"
+#include "CpuPlacement.h"
+#include "PacketCapture.h"
+#include "RtpServer.h"
+#include "Checksum.h"
+#include "Trace.h"
+#include "Logger.h"
 
 
 using namespace std;
 using namespace mediakit;
 
-int discovery_options(int argc, char** argv, string& input, string& output){
+enum {
+    OPT_ASYNC_WRITE = 256,
+    OPT_DIRECT_IO,
+    OPT_SEGMENT_DURATION,
+    OPT_SEGMENT_SIZE,
+    OPT_FLOW,
+    OPT_MEMORY_LIMIT,
+    OPT_HUGE_PAGES,
+    OPT_HUGE_PAGES_COPY_LIMIT,
+    OPT_READER_CPUS,
+    OPT_WORKER_CPUS,
+    OPT_WRITER_CPUS,
+    OPT_CAPTURE,
+    OPT_CAPTURE_WORKERS,
+    OPT_CAPTURE_DURATION,
+    OPT_VERBOSE,
+    OPT_DAEMON,
+    OPT_MUX_PORT,
+    OPT_CONTROL,
+    OPT_POLLERS,
+    OPT_VERIFY_CHECKSUM,
+    OPT_TRACE,
+    OPT_TRACE_SAMPLE,
+    OPT_VIDEO_PORT,
+    OPT_AUDIO_PORT,
+    OPT_AUDIO_CODEC,
+    OPT_AUDIO_RATE,
+    OPT_AUDIO_CHANNELS,
+    OPT_PAYLOAD_TYPE,
+    OPT_ES,
+    OPT_DEDUP_HASH,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_INTERVAL,
+    OPT_RESUME,
+    OPT_DECOMPRESS_THREADS,
+    OPT_MARKER_FLUSH,
+    OPT_IDLE_TIMEOUT,
+    OPT_LATENCY,
+};
+
+struct Options {
+    int listen_port = 0;
+    //使用异步写入引擎
+    bool async_write = false;
+    //异步写入时使用O_DIRECT
+    bool direct_io = false;
+    //分段时长，秒，0为不分段
+    uint32_t segment_duration = 0;
+    //分段大小，MB，0为不分段
+    uint32_t segment_size = 0;
+    //流标识，用于分段文件名模板中的%f
+    string flow = "0";
+    //进程内存上限，MB，0为不限制
+    uint32_t memory_limit = 0;
+    //抓包数据与slab内存使用大页
+    bool huge_pages = false;
+    //启用大页时拷贝到大页内存的抓包文件大小上限，MB，更大的文件直接映射
+    uint32_t huge_pages_copy_limit = 1024;
+    //各角色线程绑定的cpu，"auto"或cpu列表，空为不绑定
+    string cpus[CpuPlacement::RoleMax];
+    //实时抓包的网卡名
+    string capture;
+    //抓包worker线程数
+    uint32_t capture_workers = 1;
+    //抓包时长，秒，0为直到收到SIGINT/SIGTERM
+    uint32_t capture_duration = 0;
+    //输出跟踪日志
+    bool verbose = false;
+    //常驻服务模式
+    bool daemon = false;
+    //服务模式的ssrc复用端口
+    uint16_t mux_port = 0;
+    //服务模式的控制接口路径
+    string control = "/tmp/rtp2ps.sock";
+    //服务模式的poller个数，0为在线cpu个数
+    uint32_t pollers = 0;
+    //校验ip/udp校验和，丢弃损坏的包
+    bool verify_checksum = false;
+    //跟踪文件路径，为空时不跟踪
+    string trace;
+    //每多少个最外层span记录一个
+    uint32_t trace_sample = 1;
+    //视频流端口，0为不按端口过滤
+    uint16_t video_port = 0;
+    //音频流端口，非0时音频与视频交织输出到同一个ps流
+    uint16_t audio_port = 0;
+    //音频编码，g711a/g711u/aac
+    string audio_codec = "g711a";
+    //音频采样率
+    int audio_rate = 8000;
+    //音频声道数
+    int audio_channels = 1;
+    //负载类型与视频编码的对应关系，如98=h264
+    vector<string> payload_types;
+    //h264/h265输出Annex-B裸流
+    bool es = false;
+    //重复包过滤同时比较负载摘要
+    bool dedup_hash = false;
+    //断点文件路径，为空时不保存断点
+    string checkpoint;
+    //断点间隔，MB(pcap数据)
+    uint32_t checkpoint_interval = 256;
+    //从断点继续转换
+    bool resume = false;
+    //zstd并行解压线程数，0为在线cpu个数(最多8个)
+    uint32_t decompress_threads = 0;
+    //收到marker位的包时立即输出帧
+    bool marker_flush = false;
+    //空闲超时，毫秒，0为不检查
+    uint32_t idle_timeout = 0;
+    //统计端到端时延，结束时输出每个流的分位数
+    bool latency = false;
+};
+
+//根据流标识创建输出
+typedef std::function<FrameWriterInterface::Ptr(const string &flow)> onCreateOutput;
+
+static volatile sig_atomic_t s_exit = 0;
+
+static void on_signal(int sig){
+    s_exit = 1;
+}
+
+int discovery_options(int argc, char** argv, string& input, string& output, Options& options){
     int ret = 0;
     
     static option long_options[] = {
-        {"input", no_argument, 0, 'i'},
-        {"output", no_argument, 0, 'o'},
+        {"input", required_argument, 0, 'i'},
+        {"output", required_argument, 0, 'o'},
+        {"listen", required_argument, 0, 'l'},
+        {"async-write", no_argument, 0, OPT_ASYNC_WRITE},
+        {"direct-io", no_argument, 0, OPT_DIRECT_IO},
+        {"segment-duration", required_argument, 0, OPT_SEGMENT_DURATION},
+        {"segment-size", required_argument, 0, OPT_SEGMENT_SIZE},
+        {"flow", required_argument, 0, OPT_FLOW},
+        {"memory-limit", required_argument, 0, OPT_MEMORY_LIMIT},
+        {"huge-pages", no_argument, 0, OPT_HUGE_PAGES},
+        {"huge-pages-copy-limit", required_argument, 0, OPT_HUGE_PAGES_COPY_LIMIT},
+        {"reader-cpus", required_argument, 0, OPT_READER_CPUS},
+        {"worker-cpus", required_argument, 0, OPT_WORKER_CPUS},
+        {"writer-cpus", required_argument, 0, OPT_WRITER_CPUS},
+        {"capture", required_argument, 0, OPT_CAPTURE},
+        {"capture-workers", required_argument, 0, OPT_CAPTURE_WORKERS},
+        {"capture-duration", required_argument, 0, OPT_CAPTURE_DURATION},
+        {"verbose", no_argument, 0, OPT_VERBOSE},
+        {"daemon", no_argument, 0, OPT_DAEMON},
+        {"mux-port", required_argument, 0, OPT_MUX_PORT},
+        {"control", required_argument, 0, OPT_CONTROL},
+        {"pollers", required_argument, 0, OPT_POLLERS},
+        {"verify-checksum", no_argument, 0, OPT_VERIFY_CHECKSUM},
+        {"trace", required_argument, 0, OPT_TRACE},
+        {"trace-sample", required_argument, 0, OPT_TRACE_SAMPLE},
+        {"video-port", required_argument, 0, OPT_VIDEO_PORT},
+        {"audio-port", required_argument, 0, OPT_AUDIO_PORT},
+        {"audio-codec", required_argument, 0, OPT_AUDIO_CODEC},
+        {"audio-rate", required_argument, 0, OPT_AUDIO_RATE},
+        {"audio-channels", required_argument, 0, OPT_AUDIO_CHANNELS},
+        {"pt", required_argument, 0, OPT_PAYLOAD_TYPE},
+        {"es", no_argument, 0, OPT_ES},
+        {"dedup-hash", no_argument, 0, OPT_DEDUP_HASH},
+        {"checkpoint", required_argument, 0, OPT_CHECKPOINT},
+        {"checkpoint-interval", required_argument, 0, OPT_CHECKPOINT_INTERVAL},
+        {"resume", no_argument, 0, OPT_RESUME},
+        {"decompress-threads", required_argument, 0, OPT_DECOMPRESS_THREADS},
+        {"marker-flush", no_argument, 0, OPT_MARKER_FLUSH},
+        {"idle-timeout", required_argument, 0, OPT_IDLE_TIMEOUT},
+        {"latency", no_argument, 0, OPT_LATENCY},
         {0, 0, 0, 0}
     };
     
     int opt = 0;
     int option_index = 0;
-    while((opt = getopt_long(argc, argv, "i:o:", long_options, &option_index)) != -1){
+    while((opt = getopt_long(argc, argv, "i:o:l:", long_options, &option_index)) != -1){
         switch(opt){
             case 'i':
                 input = optarg;
@@ -27,6 +205,120 @@ int discovery_options(int argc, char** argv, string& input, string& output){
             case 'o':
                 output = optarg;
                 break;
+            case 'l':
+                options.listen_port = atoi(optarg);
+                break;
+            case OPT_ASYNC_WRITE:
+                options.async_write = true;
+                break;
+            case OPT_DIRECT_IO:
+                options.direct_io = true;
+                break;
+            case OPT_SEGMENT_DURATION:
+                options.segment_duration = atoi(optarg);
+                break;
+            case OPT_SEGMENT_SIZE:
+                options.segment_size = atoi(optarg);
+                break;
+            case OPT_FLOW:
+                options.flow = optarg;
+                break;
+            case OPT_MEMORY_LIMIT:
+                options.memory_limit = atoi(optarg);
+                break;
+            case OPT_HUGE_PAGES:
+                options.huge_pages = true;
+                break;
+            case OPT_HUGE_PAGES_COPY_LIMIT:
+                options.huge_pages_copy_limit = atoi(optarg);
+                break;
+            case OPT_READER_CPUS:
+                options.cpus[CpuPlacement::RoleReader] = optarg;
+                break;
+            case OPT_WORKER_CPUS:
+                options.cpus[CpuPlacement::RoleWorker] = optarg;
+                break;
+            case OPT_WRITER_CPUS:
+                options.cpus[CpuPlacement::RoleWriter] = optarg;
+                break;
+            case OPT_CAPTURE:
+                options.capture = optarg;
+                break;
+            case OPT_CAPTURE_WORKERS:
+                options.capture_workers = atoi(optarg);
+                break;
+            case OPT_CAPTURE_DURATION:
+                options.capture_duration = atoi(optarg);
+                break;
+            case OPT_VERBOSE:
+                options.verbose = true;
+                break;
+            case OPT_DAEMON:
+                options.daemon = true;
+                break;
+            case OPT_MUX_PORT:
+                options.mux_port = atoi(optarg);
+                break;
+            case OPT_CONTROL:
+                options.control = optarg;
+                break;
+            case OPT_POLLERS:
+                options.pollers = atoi(optarg);
+                break;
+            case OPT_VERIFY_CHECKSUM:
+                options.verify_checksum = true;
+                break;
+            case OPT_TRACE:
+                options.trace = optarg;
+                break;
+            case OPT_TRACE_SAMPLE:
+                options.trace_sample = atoi(optarg);
+                break;
+            case OPT_VIDEO_PORT:
+                options.video_port = atoi(optarg);
+                break;
+            case OPT_AUDIO_PORT:
+                options.audio_port = atoi(optarg);
+                break;
+            case OPT_AUDIO_CODEC:
+                options.audio_codec = optarg;
+                break;
+            case OPT_AUDIO_RATE:
+                options.audio_rate = atoi(optarg);
+                break;
+            case OPT_AUDIO_CHANNELS:
+                options.audio_channels = atoi(optarg);
+                break;
+            case OPT_PAYLOAD_TYPE:
+                options.payload_types.emplace_back(optarg);
+                break;
+            case OPT_ES:
+                options.es = true;
+                break;
+            case OPT_DEDUP_HASH:
+                options.dedup_hash = true;
+                break;
+            case OPT_CHECKPOINT:
+                options.checkpoint = optarg;
+                break;
+            case OPT_CHECKPOINT_INTERVAL:
+                options.checkpoint_interval = atoi(optarg);
+                break;
+            case OPT_RESUME:
+                options.resume = true;
+                break;
+            case OPT_DECOMPRESS_THREADS:
+                options.decompress_threads = atoi(optarg);
+                break;
+            case OPT_MARKER_FLUSH:
+                options.marker_flush = true;
+                break;
+            case OPT_IDLE_TIMEOUT:
+                options.idle_timeout = atoi(optarg);
+                break;
+            case OPT_LATENCY:
+                options.latency = true;
+                break;
             default:
                 break;
         }
@@ -34,28 +326,459 @@ int discovery_options(int argc, char** argv, string& input, string& output){
     return ret;
 }
 
+static CodecId parse_audio_codec(const string &name){
+    if(name == "g711a" || name == "pcma"){
+        return CodecG711A;
+    }
+    if(name == "g711u" || name == "pcmu"){
+        return CodecG711U;
+    }
+    if(name == "aac"){
+        return CodecAAC;
+    }
+    return CodecInvalid;
+}
+
+/**
+ * 解析负载类型与视频编码的对应关系，格式为pt=ps|h264|h265
+ */
+static bool parse_payload_type(const string &str, int &pt, CodecId &codec){
+    auto pos = str.find('=');
+    if(pos == string::npos){
+        return false;
+    }
+    pt = atoi(str.substr(0, pos).c_str());
+    auto name = str.substr(pos + 1);
+    if(name == "ps"){
+        codec = CodecInvalid;
+    }else if(name == "h264"){
+        codec = CodecH264;
+    }else if(name == "h265"){
+        codec = CodecH265;
+    }else{
+        return false;
+    }
+    return pt >= 0 && pt < 128;
+}
+
+/**
+ * 按端口把视频与音频流绑定到两个track
+ */
+static void setup_tracks(StreamClient *client, const Options &options){
+    for(auto &str : options.payload_types){
+        int pt;
+        CodecId codec;
+        if(parse_payload_type(str, pt, codec)){
+            client->setPayloadType(pt, codec);
+        }
+    }
+    client->setOutputFormat(options.es ? RtpReceiver::OutputEs : RtpReceiver::OutputPs);
+    client->setDuplicateHash(options.dedup_hash);
+    client->setMarkerFlush(options.marker_flush);
+    client->setIdleTimeout(options.idle_timeout);
+    if(options.latency){
+        client->setLatencyStats(std::make_shared<LatencyStats>());
+    }
+    client->bind_track(0, options.video_port);
+    if(!options.audio_port){
+        return;
+    }
+    RtpReceiver::TrackConfig config;
+    config.type = TrackAudio;
+    config.codec = parse_audio_codec(options.audio_codec);
+    config.samplerate = options.audio_rate;
+    config.channels = options.audio_channels;
+    client->setTrack(1, config);
+    client->bind_track(1, options.audio_port);
+}
+
+/**
+ * 输出流的端到端时延统计
+ */
+static void report_latency(StreamClient *client){
+    auto &latency = client->getLatencyStats();
+    if(latency){
+        latency->report(client->getMemoryAccount()->getName());
+    }
+}
+
+/**
+ * 实时抓包，每个worker有自己的StreamClient与输出
+ */
+static int run_capture(const Options &options, const onCreateOutput &create_output){
+    PacketCapture::Config config;
+    config.interface = options.capture;
+    config.workers = options.capture_workers;
+    PacketCapture capture(config);
+
+    std::vector<StreamClient *> clients(config.workers, nullptr);
+    capture.setOnWorkerStart([&](int worker){
+        //在worker线程中创建，内存位于worker所在的numa节点
+        auto flow = config.workers > 1 ? options.flow + "_" + std::to_string(worker) : options.flow;
+        auto client = new StreamClient();
+        client->getMemoryAccount()->setName(flow);
+        client->set_verify_checksum(options.verify_checksum);
+        setup_tracks(client, options);
+        client->setFrameWriter(create_output(flow));
+        clients[worker] = client;
+    });
+    capture.setOnPacket([&](int worker, char *frame, uint32_t len, uint64_t ts_us){
+        auto client = clients[worker];
+        client->set_arrival_time(ts_us);
+        client->on_ethernet(frame, len);
+    });
+    capture.setOnBlockDone([&](int worker){
+        //block即将归还内核
+        clients[worker]->flush_batch();
+    });
+    capture.setOnWorkerStop([&](int worker){
+        if(options.verify_checksum){
+            auto &checksum = clients[worker]->get_checksum_stats();
+            printf("worker%d校验和错误, ip:%llu, udp:%llu\n", worker,
+                   (unsigned long long)checksum.ip_errors, (unsigned long long)checksum.udp_errors);
+        }
+        //抓包结束，输出最后一帧
+        clients[worker]->flush_batch();
+        clients[worker]->flushFrames();
+        report_latency(clients[worker]);
+        delete clients[worker];
+        clients[worker] = nullptr;
+    });
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    int ret = capture.start();
+    if(ret < 0){
+        return ret;
+    }
+    printf("开始抓包:%s, worker数:%u\n", options.capture.c_str(), config.workers);
+    for(uint32_t ms = 0; !s_exit && (!options.capture_duration || ms < options.capture_duration * 1000); ms += 100){
+        usleep(100 * 1000);
+    }
+    capture.stop();
+
+    auto stats = capture.getStats();
+    printf("抓包结束, 处理包数:%llu, block数:%llu, 内核接收:%llu, 内核丢弃:%llu\n",
+           (unsigned long long)stats.packets, (unsigned long long)stats.blocks,
+           (unsigned long long)stats.kernel_packets, (unsigned long long)stats.kernel_drops);
+    return 0;
+}
+
+/**
+ * 常驻服务模式，会话由控制接口打开
+ */
+static int run_daemon(const Options &options, const SegmentWriter::onCreateWriter &create_writer, const onCreateOutput &create_output){
+    RtpServer::Config config;
+    config.mux_port = options.mux_port;
+    config.pollers = options.pollers;
+    config.control_path = options.control;
+    config.marker_flush = options.marker_flush;
+    config.idle_timeout_ms = options.idle_timeout;
+    config.latency = options.latency;
+    RtpServer server(config);
+    server.setOnCreateOutput([create_writer, create_output](const string &name, const string &output) -> FrameWriterInterface::Ptr {
+        if(!output.empty()){
+            return create_writer(output);
+        }
+        return create_output(name);
+    });
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+    int ret = server.start();
+    if(ret < 0){
+        return ret;
+    }
+    while(!s_exit){
+        usleep(100 * 1000);
+    }
+    server.stop();
+    return 0;
+}
+
+/**
+ * 离线转换的断点保存与续传，只支持输出到单个文件
+ * 断点中保存pcap偏移、输出文件长度与全部流状态，续传时输出文件截断到断点时的长度
+ * @return 开始解析的pcap偏移，失败返回-1
+ */
+static long setup_checkpoint(StreamClient *client, const FrameWriterInterface::Ptr &writer, const Options &options, long input_size){
+    auto file = std::dynamic_pointer_cast<FrameFileWriter>(writer);
+    if(!file){
+        printf("断点续传只支持输出到单个文件(不支持分段与异步写入)\n");
+        return -1;
+    }
+    long offset = 0;
+    string data;
+    if(options.resume && Checkpoint::load(options.checkpoint, data)){
+        CheckpointReader reader(data.data(), data.size());
+        long saved_size;
+        uint64_t output_size;
+        if(!reader.read(saved_size) || !reader.read(offset) || !reader.read(output_size)){
+            printf("非法的断点文件:%s\n", options.checkpoint.c_str());
+            return -1;
+        }
+        if(saved_size != input_size || output_size > file->size()){
+            printf("断点与输入或输出文件不一致, 输入:%ld/%ld, 输出:%llu/%llu\n", saved_size, input_size,
+                   (unsigned long long)output_size, (unsigned long long)file->size());
+            return -1;
+        }
+        if(!client->load_state(reader) || !reader.eof()){
+            printf("断点状态与当前参数不一致:%s\n", options.checkpoint.c_str());
+            return -1;
+        }
+        if(!file->truncate(output_size)){
+            return -1;
+        }
+        printf("从断点继续, pcap偏移:%ld/%ld, 输出长度:%llu\n", offset, input_size, (unsigned long long)output_size);
+    }else if(options.resume){
+        //第一个断点之前中断，丢弃已输出的数据后从头开始
+        printf("没有可用的断点，从头开始:%s\n", options.checkpoint.c_str());
+        if(!file->truncate(0)){
+            return -1;
+        }
+    }
+
+    string path = options.checkpoint;
+    client->set_checkpoint((long)options.checkpoint_interval * 1024 * 1024, [client, file, path, input_size](long offset){
+        //输出先落盘，断点中的输出长度才可靠
+        if(!file->flush()){
+            PrintE("输出文件落盘失败，跳过断点");
+            return;
+        }
+        CheckpointWriter writer;
+        writer.write(input_size);
+        writer.write(offset);
+        writer.write(file->size());
+        client->save_state(writer);
+        if(Checkpoint::save(path, writer.data())){
+            PrintI("保存断点, pcap偏移:%ld/%ld, 输出长度:%llu", offset, input_size, (unsigned long long)file->size());
+        }
+    });
+    return offset;
+}
+
+//输出到"-"时标准输出原来的fd，标准输出本身改为指向标准错误
+static int s_stdout_fd = -1;
+
+/**
+ * 创建管道输出，"-"为标准输出，"fd:N"为继承的文件描述符(管道、socket等)
+ */
+static FrameWriterInterface::Ptr create_pipe_writer(const string &path){
+    int fd = path == "-" ? s_stdout_fd : PipeWriter::parseFd(path);
+    return std::make_shared<PipeWriter>(fd, false);
+}
+
+static void dump_trace(const Options &options){
+    if(options.trace.empty()){
+        return;
+    }
+    Trace::stop();
+    Trace::dump(options.trace);
+}
+
 int main(int argc, char** argv){
     printf("hello\n");
 
     int ret = 0;
-    // string input;
+    string input;
+    string output;
+    Options options;
 
-    if((ret = discovery_options(argc, argv, inputfile, outputfile)) != 0){
+    if((ret = discovery_options(argc, argv, input, output, options)) != 0){
         printf("discovery options failed. ret=%d", ret);
         return ret;
     }
+
+    if(PipeWriter::isPipePath(output)){
+        if(options.daemon || options.capture_workers > 1 || options.segment_duration || options.segment_size || options.async_write){
+            printf("管道只能作为单个输出(不支持服务模式、多个抓包worker、分段与异步写入)\n");
+            return -1;
+        }
+        if(output == "-"){
+            //标准输出只输出ps流，日志改为输出到标准错误
+            s_stdout_fd = dup(STDOUT_FILENO);
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+        }
+        //消费者退出时写入失败而不是进程被终止
+        signal(SIGPIPE, SIG_IGN);
+    }
+
+    //库日志输出到标准输出
+    Logger::setLevel(options.verbose ? LTrace : LInfo);
+    Logger::setOnLog([](LogLevel level, const char *file, int line, const char *msg){
+        printf("%s\n", msg);
+    });
     
     char *data=NULL;
     long size = 0;
 
+    if(options.audio_port && (parse_audio_codec(options.audio_codec) == CodecInvalid || options.audio_rate <= 0)){
+        printf("不支持的音频参数:%s, %d\n", options.audio_codec.c_str(), options.audio_rate);
+        return -1;
+    }
+
+    for(auto &str : options.payload_types){
+        int pt;
+        CodecId codec;
+        if(!parse_payload_type(str, pt, codec)){
+            printf("非法的负载类型:%s\n", str.c_str());
+            return -1;
+        }
+    }
+
+    HugePage::setEnabled(options.huge_pages);
+    HugePage::setCopyLimit((uint64_t)options.huge_pages_copy_limit * 1024 * 1024);
+    for(int role = 0; role < CpuPlacement::RoleMax; ++role){
+        if(!options.cpus[role].empty() && !CpuPlacement::Instance().setCpus((CpuPlacement::Role)role, options.cpus[role])){
+            printf("非法的cpu列表:%s\n", options.cpus[role].c_str());
+            return -1;
+        }
+    }
+    if(CpuPlacement::Instance().bindCurrentThread(CpuPlacement::RoleReader) >= 0){
+        //主线程同时负责读取与流处理，先绑定cpu再创建流，使其内存位于本地numa节点
+        SlabAllocator::warmUp(1);
+    }
+    MemoryBudget::Instance().setLimit((uint64_t)options.memory_limit * 1024 * 1024);
+    if(!options.trace.empty()){
+        if(!Trace::isCompiled()){
+            printf("编译时未开启ENABLE_TRACE，不会记录跟踪事件\n");
+        }
+        Trace::start(options.trace_sample);
+    }
+    SegmentWriter::onCreateWriter create_writer;
+    if(options.async_write){
+        AsyncWriteEngine::Config config;
+        //离线转换输出文件少，暂存缓存取引擎缓存大小以合并成大块写入；服务模式下输出文件很多，减小每个文件的暂存缓存
+        config.staging_size = options.daemon ? 64 * 1024 : config.buffer_size;
+        auto engine = std::make_shared<AsyncWriteEngine>(config);
+        printf("异步写入引擎:%s\n", engine->isUring() ? "io_uring" : "线程池");
+        bool direct_io = options.direct_io;
+        create_writer = [engine, direct_io](const string &path) -> FrameWriterInterface::Ptr {
+            return std::make_shared<AsyncFileWriter>(engine, path, direct_io);
+        };
+    }else{
+        //服务模式下同时输出的文件很多，减小每个文件的缓存
+        uint32_t buffer_size = options.daemon ? 64 * 1024 : 1024 * 1024;
+        create_writer = [buffer_size](const string &path) -> FrameWriterInterface::Ptr {
+            return std::make_shared<FrameFileWriter>(path, buffer_size);
+        };
+    }
+    //管道输出使用独立的写线程，服务模式下控制接口也可以指定"fd:N"
+    auto file_writer = create_writer;
+    create_writer = [file_writer](const string &path) -> FrameWriterInterface::Ptr {
+        return PipeWriter::isPipePath(path) ? create_pipe_writer(path) : file_writer(path);
+    };
+    //多个抓包worker或服务模式时每个流一个输出，路径模板中没有%f时加上流标识后缀
+    string output_template = output;
+    if((options.capture_workers > 1 || options.daemon) && output_template.find("%f") == string::npos){
+        output_template += ".%f";
+    }
+    onCreateOutput create_output = [&options, create_writer, output_template](const string &flow) -> FrameWriterInterface::Ptr {
+        if(options.segment_duration || options.segment_size){
+            //输出路径作为分段文件名模板
+            SegmentWriter::Config config;
+            config.path_template = output_template;
+            config.flow = flow;
+            config.max_duration_ms = options.segment_duration * 1000;
+            config.max_size = (uint64_t)options.segment_size * 1024 * 1024;
+            return std::make_shared<SegmentWriter>(config, create_writer);
+        }
+        if(output_template.find("%f") != string::npos){
+            return create_writer(SegmentWriter::formatPath(output_template, flow, 0, time(NULL)));
+        }
+        return create_writer(output_template);
+    };
+
+    if(options.daemon){
+        ret = run_daemon(options, create_writer, create_output);
+        MemoryBudget::Instance().report();
+        dump_trace(options);
+        return ret;
+    }
+
+    if(!options.capture.empty()){
+        ret = run_capture(options, create_output);
+        MemoryBudget::Instance().report();
+        dump_trace(options);
+        return ret;
+    }
+
     StreamClient *client = new StreamClient();
+    client->getMemoryAccount()->setName(options.flow);
+    client->set_verify_checksum(options.verify_checksum);
+    setup_tracks(client, options);
+    auto writer = create_output(options.flow);
+    client->setFrameWriter(writer);
+    if(options.listen_port > 0){
+        //tcp直接接收rtp流
+        ret = client->on_tcp_listen(options.listen_port);
+        report_latency(client);
+        MemoryBudget::Instance().report();
+        dump_trace(options);
+        delete client;
+        return ret;
+    }
+
     printf("read_file\n");
-    client->read_file(inputfile, &data, &size);
+    client->read_file(input, &data, &size);
+    auto format = Decompressor::detect(data, size);
+    if(format != Decompressor::FormatNone && !Decompressor::isSupported(format)){
+        printf("编译时未启用%s解压，不支持该输入文件\n", Decompressor::getName(format));
+        client->close_file(data, size);
+        delete client;
+        return -1;
+    }
 
+    long offset = 0;
+    if(!options.checkpoint.empty()){
+        offset = setup_checkpoint(client, writer, options, size);
+        if(offset < 0){
+            client->close_file(data, size);
+            delete client;
+            return -1;
+        }
+    }
 
-    printf("on_stream\n");
-    client->on_stream(data, size);
-    
-    
-    return 0;
+    if(format == Decompressor::FormatNone){
+        printf("on_stream\n");
+        client->on_stream(data, size, offset);
+    }else{
+        printf("on_compressed_stream:%s\n", Decompressor::getName(format));
+        Decompressor::Config config;
+        config.threads = options.decompress_threads;
+        Decompressor source(data, size, format, config);
+        if(client->on_compressed_stream(source, offset) != 0){
+            printf("压缩文件已损坏或不完整，已转换损坏之前的数据\n");
+            ret = -1;
+        }
+    }
+    report_latency(client);
+    MemoryBudget::Instance().report();
+    dump_trace(options);
+    auto &stats = client->getStats();
+    if(stats.duplicates || stats.hash_mismatches){
+        printf("重复包:%llu, 序列号重复但负载不同:%llu\n", (unsigned long long)stats.duplicates,
+               (unsigned long long)stats.hash_mismatches);
+    }
+    if(options.verify_checksum){
+        auto &checksum = client->get_checksum_stats();
+        printf("校验和错误, ip:%llu, udp:%llu, AVX2:%d\n", (unsigned long long)checksum.ip_errors,
+               (unsigned long long)checksum.udp_errors, Checksum::isAvx2());
+    }
+    if(options.huge_pages){
+        auto slab = SlabAllocator::getStats();
+        printf("slab内存块:%llu, 其中hugetlb大页:%llu, 进程透明大页:%llu字节\n",
+               (unsigned long long)slab.chunks, (unsigned long long)slab.hugetlb_chunks,
+               (unsigned long long)HugePage::getHugeBytes());
+    }
+    client->close_file(data, size);
+
+    //销毁时等待输出全部写入
+    delete client;
+    if(!options.checkpoint.empty() && ret == 0){
+        //转换完成，断点不再需要
+        unlink(options.checkpoint.c_str());
+    }
+    return ret;
 }
\ No newline at end of file
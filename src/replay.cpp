@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <getopt.h>
+#include <signal.h>
+#include "stream.hpp"
+#include "RtpReplayer.h"
+#include "Logger.h"
+
+using namespace std;
+using namespace mediakit;
+
+enum {
+    OPT_DST = 256,
+    OPT_PORT,
+    OPT_COPIES,
+    OPT_PORT_STEP,
+    OPT_SSRC_STEP,
+    OPT_SOCKETS,
+    OPT_SPEED,
+    OPT_DECOMPRESS_THREADS,
+    OPT_VERBOSE,
+};
+
+struct Options {
+    //抓包文件，可以是gzip/zstd压缩的
+    string input;
+    RtpReplayer::Config replay;
+    //只回放该端口的流，0为全部udp/tcp流
+    uint16_t port = 0;
+    //zstd并行解压线程数，0为在线cpu个数(最多8个)
+    uint32_t decompress_threads = 0;
+    bool verbose = false;
+};
+
+static RtpReplayer *s_replayer = nullptr;
+
+static void on_signal(int sig){
+    if(s_replayer){
+        s_replayer->stop();
+    }
+}
+
+static void usage(const char *name){
+    printf("用法: %s -i <pcap> [选项]\n"
+           "  --dst <ip[:port]>      目标地址，默认127.0.0.1，端口缺省时使用抓包中的目的端口\n"
+           "  --port <port>          只回放该端口(源或目的)的流\n"
+           "  --copies <n>           每个流复制的份数，默认1\n"
+           "  --port-step <n>        第k份的目标端口加上k*n，默认0\n"
+           "  --ssrc-step <n>        第k份的ssrc加上k*n，默认1\n"
+           "  --sockets <n>          发送socket个数，默认8\n"
+           "  --speed <n|max>        回放速度倍数，max为不限速，默认1\n"
+           "  --decompress-threads <n> zstd并行解压线程数，默认为cpu个数(最多8个)\n"
+           "  --verbose              输出跟踪日志\n", name);
+}
+
+static bool parse_dst(const string &str, RtpReplayer::Config &config){
+    auto pos = str.find(':');
+    config.dst_ip = str.substr(0, pos);
+    if(pos == string::npos){
+        return !config.dst_ip.empty();
+    }
+    auto port = atoi(str.c_str() + pos + 1);
+    if(port <= 0 || port > 65535){
+        return false;
+    }
+    config.dst_port = port;
+    return !config.dst_ip.empty();
+}
+
+static int discovery_options(int argc, char** argv, Options& options){
+    static option long_options[] = {
+        {"input", required_argument, 0, 'i'},
+        {"dst", required_argument, 0, OPT_DST},
+        {"port", required_argument, 0, OPT_PORT},
+        {"copies", required_argument, 0, OPT_COPIES},
+        {"port-step", required_argument, 0, OPT_PORT_STEP},
+        {"ssrc-step", required_argument, 0, OPT_SSRC_STEP},
+        {"sockets", required_argument, 0, OPT_SOCKETS},
+        {"speed", required_argument, 0, OPT_SPEED},
+        {"decompress-threads", required_argument, 0, OPT_DECOMPRESS_THREADS},
+        {"verbose", no_argument, 0, OPT_VERBOSE},
+        {0, 0, 0, 0}
+    };
+
+    int opt = 0;
+    int option_index = 0;
+    while((opt = getopt_long(argc, argv, "i:", long_options, &option_index)) != -1){
+        switch(opt){
+            case 'i':
+                options.input = optarg;
+                break;
+            case OPT_DST:
+                if(!parse_dst(optarg, options.replay)){
+                    printf("非法的目标地址:%s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_PORT:
+                options.port = atoi(optarg);
+                break;
+            case OPT_COPIES:
+                options.replay.copies = atoi(optarg);
+                break;
+            case OPT_PORT_STEP:
+                options.replay.port_step = atoi(optarg);
+                break;
+            case OPT_SSRC_STEP:
+                options.replay.ssrc_step = strtoul(optarg, NULL, 0);
+                break;
+            case OPT_SOCKETS:
+                options.replay.sockets = atoi(optarg);
+                break;
+            case OPT_SPEED:
+                options.replay.speed = string(optarg) == "max" ? 0 : atof(optarg);
+                if(options.replay.speed < 0){
+                    printf("非法的回放速度:%s\n", optarg);
+                    return -1;
+                }
+                break;
+            case OPT_DECOMPRESS_THREADS:
+                options.decompress_threads = atoi(optarg);
+                break;
+            case OPT_VERBOSE:
+                options.verbose = true;
+                break;
+            default:
+                return -1;
+        }
+    }
+    return options.input.empty() ? -1 : 0;
+}
+
+int main(int argc, char** argv){
+    Options options;
+    if(discovery_options(argc, argv, options) != 0){
+        usage(argv[0]);
+        return -1;
+    }
+
+    Logger::setLevel(options.verbose ? LTrace : LInfo);
+    Logger::setOnLog([](LogLevel level, const char *file, int line, const char *msg){
+        printf("%s\n", msg);
+    });
+
+    RtpReplayer replayer(options.replay);
+    if(replayer.start() != 0){
+        return -1;
+    }
+    s_replayer = &replayer;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    char *data = NULL;
+    long size = 0;
+    StreamClient::read_file(options.input, &data, &size);
+    if(!data){
+        printf("读取文件失败:%s\n", options.input.c_str());
+        return -1;
+    }
+    auto format = Decompressor::detect(data, size);
+    if(format != Decompressor::FormatNone && !Decompressor::isSupported(format)){
+        printf("编译时未启用%s解压，不支持该输入文件\n", Decompressor::getName(format));
+        StreamClient::close_file(data, size);
+        return -1;
+    }
+
+    //复用离线转换的抓包解析，rtp包直接交给回放而不解码
+    StreamClient client;
+    if(options.port){
+        client.bind_track(0, options.port);
+    }
+    client.set_on_packet([&replayer](const StreamClient::FlowKey &flow, uint64_t arrival_us, const char *rtp, uint32_t len){
+        replayer.inputPacket(ntohs(flow.dst_port), arrival_us, rtp, len);
+    });
+
+    int ret = 0;
+    if(format == Decompressor::FormatNone){
+        ret = client.on_stream(data, size);
+    }else{
+        Decompressor::Config config;
+        config.threads = options.decompress_threads;
+        Decompressor source(data, size, format, config);
+        ret = client.on_compressed_stream(source);
+    }
+    replayer.flush();
+    s_replayer = nullptr;
+    StreamClient::close_file(data, size);
+
+    auto stats = replayer.getStats();
+    double seconds = stats.duration_us / 1000000.0;
+    printf("发出:%llu包, %llu字节, sendmmsg:%llu次, 失败:%llu, 耗时:%.3fs, %.0f包/s, %.1fMbps\n",
+           (unsigned long long)stats.packets, (unsigned long long)stats.bytes, (unsigned long long)stats.sends,
+           (unsigned long long)stats.errors, seconds, seconds > 0 ? stats.packets / seconds : 0.0,
+           seconds > 0 ? stats.bytes * 8 / seconds / 1000000 : 0.0);
+    if(options.replay.speed > 0){
+        printf("晚于计划1ms以上:%llu包, 最大延迟:%lluus\n", (unsigned long long)stats.late,
+               (unsigned long long)stats.max_lag_us);
+    }
+    return ret;
+}
@@ -0,0 +1,293 @@
+#include <string.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include "rtp2ps.h"
+#include "stream.hpp"
+#include "Logger.h"
+
+using namespace std;
+using namespace mediakit;
+
+#define RTP2PS_STR(x) #x
+#define RTP2PS_VERSION_STR(major, minor, patch) RTP2PS_STR(major) "." RTP2PS_STR(minor) "." RTP2PS_STR(patch)
+
+//默认拉取队列长度
+static const uint32_t kDefaultQueueFrames = 64;
+
+/**
+ * 会话，解析与排序复用StreamClient，解码后的帧交给回调或放入拉取队列
+ */
+struct rtp2ps_session : public StreamClient {
+public:
+    rtp2ps_session(const rtp2ps_config &config) {
+        _max_frames = config.queue_frames ? config.queue_frames : kDefaultQueueFrames;
+        if (config.name) {
+            getMemoryAccount()->setName(config.name);
+        }
+        set_verify_checksum(config.verify_checksum != 0);
+        setOutputFormat(config.output_es ? OutputEs : OutputPs);
+        setDuplicateHash(config.dedup_hash != 0);
+        setMarkerFlush(config.marker_flush != 0);
+        setIdleTimeout(config.idle_timeout_ms);
+        setFrameWriter(std::make_shared<FrameWriterInterfaceHelper>([this](const Frame::Ptr &frame) {
+            onFrame(frame);
+        }));
+    }
+
+    ~rtp2ps_session() override {
+        setFrameWriter(nullptr);
+    }
+
+    void setFrameCallback(rtp2ps_frame_cb cb, void *user) {
+        _cb = cb;
+        _user = user;
+    }
+
+    void pushRtp(const rtp2ps_packet *packets, size_t count) {
+        //批量缓存中可能有push_link留下的包
+        flush_batch();
+        RtpPacketDesc descs[kMaxBatch];
+        while (count) {
+            auto n = count > kMaxBatch ? kMaxBatch : count;
+            for (size_t i = 0; i < n; ++i) {
+                auto &desc = descs[i];
+                desc.track_index = 0;
+                desc.type = TrackVideo;
+                desc.samplerate = 90000;
+                //解析时只读取输入数据
+                desc.ptr = (unsigned char *) packets[i].data;
+                desc.len = packets[i].len;
+                desc.arrival_us = packets[i].ts_us;
+            }
+            if (n) {
+                set_arrival_time(packets[n - 1].ts_us);
+            }
+            handleRtpBatch(descs, n);
+            packets += n;
+            count -= n;
+        }
+    }
+
+    void pushLink(const rtp2ps_packet *packets, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            set_arrival_time(packets[i].ts_us);
+            on_ethernet((char *) packets[i].data, packets[i].len);
+        }
+        //调用返回后输入数据失效
+        flush_batch();
+    }
+
+    int pullFrame(uint8_t *buf, size_t buf_size, rtp2ps_frame_info *info) {
+        lock_guard<mutex> lck(_mtx);
+        if (_queue.empty()) {
+            return RTP2PS_ERR_AGAIN;
+        }
+        auto &item = _queue.front();
+        if (info) {
+            *info = item.info;
+        }
+        if (buf_size < item.data.size()) {
+            return RTP2PS_ERR_BUFFER_TOO_SMALL;
+        }
+        if (!buf && !item.data.empty()) {
+            return RTP2PS_ERR_INVALID;
+        }
+        auto size = item.data.size();
+        memcpy(buf, item.data.data(), size);
+        _queue.pop_front();
+        return (int) size;
+    }
+
+    void fillStats(rtp2ps_stats &stats) {
+        stats.packets = getStats().packets;
+        stats.parse_errors = getStats().parse_errors;
+        stats.frames = _frames;
+        stats.bytes = _bytes;
+        stats.memory_used = getMemoryAccount()->getStats().used;
+        stats.checksum_errors = get_checksum_stats().ip_errors + get_checksum_stats().udp_errors;
+        stats.duplicates = getStats().duplicates;
+        lock_guard<mutex> lck(_mtx);
+        stats.dropped_frames = _dropped;
+        stats.queued_frames = _queue.size();
+    }
+
+private:
+    struct QueuedFrame {
+        string data;
+        rtp2ps_frame_info info;
+    };
+
+    void onFrame(const Frame::Ptr &frame) {
+        rtp2ps_frame_info info;
+        info.size = frame->size();
+        info.dts = frame->dts();
+        info.pts = frame->pts();
+        info.key_frame = frame->keyFrame();
+        ++_frames;
+        _bytes += info.size;
+        if (_cb) {
+            _cb(_user, (const uint8_t *) frame->data(), &info);
+            return;
+        }
+
+        QueuedFrame item;
+        item.data.assign(frame->data(), frame->size());
+        item.info = info;
+        lock_guard<mutex> lck(_mtx);
+        if (_queue.size() >= _max_frames) {
+            //使用者来不及取走，丢弃最旧的帧
+            _queue.pop_front();
+            ++_dropped;
+        }
+        _queue.emplace_back(std::move(item));
+    }
+
+private:
+    rtp2ps_frame_cb _cb = nullptr;
+    void *_user = nullptr;
+    uint32_t _max_frames;
+    uint64_t _frames = 0;
+    uint64_t _bytes = 0;
+    uint64_t _dropped = 0;
+    mutex _mtx;
+    deque<QueuedFrame> _queue;
+};
+
+extern "C" {
+
+const char *rtp2ps_version(void) {
+    return RTP2PS_VERSION_STR(RTP2PS_VERSION_MAJOR, RTP2PS_VERSION_MINOR, RTP2PS_VERSION_PATCH);
+}
+
+void rtp2ps_set_log_callback(rtp2ps_log_cb cb, void *user, int level) {
+    if (!cb) {
+        Logger::setOnLog(nullptr);
+        return;
+    }
+    Logger::setLevel((LogLevel) level);
+    Logger::setOnLog([cb, user](LogLevel level, const char *file, int line, const char *msg) {
+        cb(user, level, file, line, msg);
+    });
+}
+
+rtp2ps_session *rtp2ps_create(const rtp2ps_config *config) {
+    rtp2ps_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    if (config) {
+        if (config->struct_size < sizeof(uint32_t)) {
+            return nullptr;
+        }
+        //只拷贝调用者知道的字段，其余保持默认值
+        memcpy(&cfg, config, config->struct_size < sizeof(cfg) ? config->struct_size : sizeof(cfg));
+    }
+    try {
+        return new rtp2ps_session(cfg);
+    } catch (std::exception &ex) {
+        PrintE("创建会话失败:%s", ex.what());
+        return nullptr;
+    }
+}
+
+void rtp2ps_destroy(rtp2ps_session *session) {
+    delete session;
+}
+
+int rtp2ps_set_frame_callback(rtp2ps_session *session, rtp2ps_frame_cb cb, void *user) {
+    if (!session) {
+        return RTP2PS_ERR_INVALID;
+    }
+    session->setFrameCallback(cb, user);
+    return RTP2PS_OK;
+}
+
+int rtp2ps_push_rtp(rtp2ps_session *session, const rtp2ps_packet *packets, size_t count) {
+    if (!session || (!packets && count)) {
+        return RTP2PS_ERR_INVALID;
+    }
+    try {
+        auto errors = session->getStats().parse_errors;
+        session->pushRtp(packets, count);
+        return (int) (count - (session->getStats().parse_errors - errors));
+    } catch (std::exception &ex) {
+        PrintE("处理rtp失败:%s", ex.what());
+        return RTP2PS_ERR_INTERNAL;
+    }
+}
+
+int rtp2ps_push_link(rtp2ps_session *session, const rtp2ps_packet *packets, size_t count) {
+    if (!session || (!packets && count)) {
+        return RTP2PS_ERR_INVALID;
+    }
+    try {
+        session->pushLink(packets, count);
+        return (int) count;
+    } catch (std::exception &ex) {
+        PrintE("处理数据包失败:%s", ex.what());
+        return RTP2PS_ERR_INTERNAL;
+    }
+}
+
+int rtp2ps_pull_frame(rtp2ps_session *session, uint8_t *buf, size_t buf_size, rtp2ps_frame_info *info) {
+    if (!session) {
+        return RTP2PS_ERR_INVALID;
+    }
+    return session->pullFrame(buf, buf_size, info);
+}
+
+int rtp2ps_flush(rtp2ps_session *session) {
+    if (!session) {
+        return RTP2PS_ERR_INVALID;
+    }
+    try {
+        session->flush_batch();
+        session->flush();
+        return RTP2PS_OK;
+    } catch (std::exception &ex) {
+        PrintE("flush失败:%s", ex.what());
+        return RTP2PS_ERR_INTERNAL;
+    }
+}
+
+int rtp2ps_finish(rtp2ps_session *session) {
+    if (!session) {
+        return RTP2PS_ERR_INVALID;
+    }
+    try {
+        session->flush_batch();
+        session->flushFrames();
+        return RTP2PS_OK;
+    } catch (std::exception &ex) {
+        PrintE("finish失败:%s", ex.what());
+        return RTP2PS_ERR_INTERNAL;
+    }
+}
+
+int rtp2ps_check_idle(rtp2ps_session *session, uint64_t now_us) {
+    if (!session) {
+        return RTP2PS_ERR_INVALID;
+    }
+    try {
+        session->flush_batch();
+        session->checkIdle(now_us);
+        return RTP2PS_OK;
+    } catch (std::exception &ex) {
+        PrintE("检查空闲超时失败:%s", ex.what());
+        return RTP2PS_ERR_INTERNAL;
+    }
+}
+
+int rtp2ps_get_stats(rtp2ps_session *session, rtp2ps_stats *stats) {
+    if (!session || !stats || stats->struct_size < sizeof(uint32_t)) {
+        return RTP2PS_ERR_INVALID;
+    }
+    rtp2ps_stats all;
+    memset(&all, 0, sizeof(all));
+    session->fillStats(all);
+    auto size = stats->struct_size < sizeof(all) ? stats->struct_size : sizeof(all);
+    all.struct_size = size;
+    memcpy(stats, &all, size);
+    return RTP2PS_OK;
+}
+
+}//extern "C"
@@ -0,0 +1,197 @@
+#ifndef RTP2PS_H
+#define RTP2PS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define RTP2PS_API __attribute__((visibility("default")))
+#else
+#define RTP2PS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * librtp2ps C接口
+ * 输入rtp包或以太网帧(可批量)，输出ps帧；
+ * 同一个会话的push/flush必须在同一个线程中调用，pull可以在其他线程中调用；
+ * 库内部不输出到标准输出，日志通过rtp2ps_set_log_callback获取
+ */
+
+#define RTP2PS_VERSION_MAJOR 1
+#define RTP2PS_VERSION_MINOR 0
+#define RTP2PS_VERSION_PATCH 0
+
+typedef enum {
+    RTP2PS_OK = 0,
+    //参数错误
+    RTP2PS_ERR_INVALID = -1,
+    //没有可取的帧
+    RTP2PS_ERR_AGAIN = -2,
+    //缓存太小，所需大小见rtp2ps_frame_info.size
+    RTP2PS_ERR_BUFFER_TOO_SMALL = -3,
+    //内部错误
+    RTP2PS_ERR_INTERNAL = -4,
+} rtp2ps_error;
+
+typedef enum {
+    RTP2PS_LOG_TRACE = 0,
+    RTP2PS_LOG_DEBUG,
+    RTP2PS_LOG_INFO,
+    RTP2PS_LOG_WARN,
+    RTP2PS_LOG_ERROR,
+} rtp2ps_log_level;
+
+typedef struct rtp2ps_session rtp2ps_session;
+
+typedef struct {
+    //必须设置为sizeof(rtp2ps_config)，用于兼容后续增加的字段
+    uint32_t struct_size;
+    //拉取队列最多缓存的帧数，满时丢弃最旧的帧，0为默认值
+    uint32_t queue_frames;
+    //会话名，用于日志与内存统计，可为NULL
+    const char *name;
+    //非0时校验rtp2ps_push_link输入的ip/udp校验和，丢弃损坏的包
+    int verify_checksum;
+    //非0时h264/h265负载(pt 98/100)输出Annex-B裸流，否则封装为ps流
+    int output_es;
+    //非0时重复包过滤同时比较负载摘要，用于多个源使用相同ssrc的场景
+    int dedup_hash;
+    //非0时收到marker位的包立即输出ps帧，不等待下一帧的第一个包
+    int marker_flush;
+    //空闲超时，毫秒，超时后输出未完成的帧，0为不检查；没有输入时需定时调用rtp2ps_check_idle
+    uint32_t idle_timeout_ms;
+} rtp2ps_config;
+
+typedef struct {
+    //数据指针，只在调用期间有效，库不会修改其内容
+    const void *data;
+    //数据长度
+    uint32_t len;
+    //到达时间，微秒
+    uint64_t ts_us;
+} rtp2ps_packet;
+
+typedef struct {
+    //帧大小
+    uint32_t size;
+    //解码时间戳，毫秒
+    uint32_t dts;
+    //显示时间戳，毫秒
+    uint32_t pts;
+    //是否为关键帧
+    int key_frame;
+} rtp2ps_frame_info;
+
+typedef struct {
+    //必须设置为sizeof(rtp2ps_stats)
+    uint32_t struct_size;
+    //输入的rtp包数
+    uint64_t packets;
+    //解析失败的rtp包数
+    uint64_t parse_errors;
+    //输出的帧数
+    uint64_t frames;
+    //输出的字节数
+    uint64_t bytes;
+    //拉取队列满而丢弃的帧数
+    uint64_t dropped_frames;
+    //拉取队列中的帧数
+    uint64_t queued_frames;
+    //排序缓存与未完成帧占用的内存
+    uint64_t memory_used;
+    //ip/udp校验和错误而丢弃的包数
+    uint64_t checksum_errors;
+    //重复而丢弃的rtp包数
+    uint64_t duplicates;
+} rtp2ps_stats;
+
+/**
+ * 帧回调，data只在回调期间有效
+ */
+typedef void (*rtp2ps_frame_cb)(void *user, const uint8_t *data, const rtp2ps_frame_info *info);
+
+/**
+ * 日志回调，msg不含换行
+ */
+typedef void (*rtp2ps_log_cb)(void *user, int level, const char *file, int line, const char *msg);
+
+/**
+ * 返回库版本，如"1.0.0"
+ */
+RTP2PS_API const char *rtp2ps_version(void);
+
+/**
+ * 设置进程级的日志回调，cb为NULL时关闭日志
+ * @param level 最低日志等级
+ */
+RTP2PS_API void rtp2ps_set_log_callback(rtp2ps_log_cb cb, void *user, int level);
+
+/**
+ * 创建会话
+ * @param config 配置，可为NULL
+ * @return 失败返回NULL
+ */
+RTP2PS_API rtp2ps_session *rtp2ps_create(const rtp2ps_config *config);
+
+/**
+ * 销毁会话，未输出的帧被丢弃，需要时先调用rtp2ps_finish
+ */
+RTP2PS_API void rtp2ps_destroy(rtp2ps_session *session);
+
+/**
+ * 设置帧回调，设置后帧不再进入拉取队列
+ */
+RTP2PS_API int rtp2ps_set_frame_callback(rtp2ps_session *session, rtp2ps_frame_cb cb, void *user);
+
+/**
+ * 批量输入rtp包
+ * @return 解析成功的包数，失败返回rtp2ps_error
+ */
+RTP2PS_API int rtp2ps_push_rtp(rtp2ps_session *session, const rtp2ps_packet *packets, size_t count);
+
+/**
+ * 批量输入以太网帧，支持vlan、ip分片与tcp承载的rtp
+ * @return 处理的帧数，失败返回rtp2ps_error
+ */
+RTP2PS_API int rtp2ps_push_link(rtp2ps_session *session, const rtp2ps_packet *packets, size_t count);
+
+/**
+ * 从拉取队列中取出一帧，拷贝到调用者提供的缓存中
+ * @param buf 缓存
+ * @param buf_size 缓存大小
+ * @param info 帧信息，可为NULL；缓存太小时info->size为所需大小
+ * @return 帧大小，队列为空返回RTP2PS_ERR_AGAIN，缓存太小返回RTP2PS_ERR_BUFFER_TOO_SMALL且帧保留在队列中
+ */
+RTP2PS_API int rtp2ps_pull_frame(rtp2ps_session *session, uint8_t *buf, size_t buf_size, rtp2ps_frame_info *info);
+
+/**
+ * 不再等待乱序包，输出排序缓存中的全部包
+ */
+RTP2PS_API int rtp2ps_flush(rtp2ps_session *session);
+
+/**
+ * 输入结束：不再等待乱序包，输出全部未完成的帧
+ */
+RTP2PS_API int rtp2ps_finish(rtp2ps_session *session);
+
+/**
+ * 检查空闲超时，输出超时track的未完成帧
+ * @param now_us 当前时间，微秒，与rtp2ps_packet.ts_us使用同一时钟
+ */
+RTP2PS_API int rtp2ps_check_idle(rtp2ps_session *session, uint64_t now_us);
+
+/**
+ * 获取统计
+ * @param stats 统计，调用前设置struct_size
+ */
+RTP2PS_API int rtp2ps_get_stats(rtp2ps_session *session, rtp2ps_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //RTP2PS_H
@@ -1,86 +1,794 @@
 #include "stream.hpp"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+#include "MemoryBudget.h"
+#include "HugePage.h"
+#include "Checksum.h"
+#include "Trace.h"
+
+#define ETH_TYPE_IPV4 0x0800
+#define ETH_TYPE_VLAN 0x8100
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+#define TCP_FLAG_FIN 0x01
+#define TCP_FLAG_SYN 0x02
+#define TCP_FLAG_RST 0x04
+
+//tcp流超过该时间没有数据则删除，微秒
+static const uint64_t kTcpIdleTimeoutUs = 60 * 1000000ULL;
+//检查tcp流空闲的间隔，微秒
+static const uint64_t kTcpSweepIntervalUs = 1000000ULL;
+
+static uint64_t getCurrentMicrosecond() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+StreamClient::StreamClient()
+{
+    _fragments.setOnDatagram([this](char *ip, uint32_t len) {
+        _in_reassembly = true;
+        on_ip(ip, len);
+        _in_reassembly = false;
+    });
+    _fragments.setMemoryAccount(getMemoryAccount());
+    _batch.reserve(kMaxBatch);
+}
+
+void StreamClient::set_arrival_time(uint64_t us)
+{
+    _arrival_us = us;
+    getMemoryAccount()->touch(us);
+    setArrivalTime(us);
+    if (us >= _tcp_sweep_us && !_tcp_streams.empty()) {
+        expire_tcp_streams();
+    }
+}
+
+void StreamClient::bind_track(int track_index, uint16_t port)
+{
+    _track_port[track_index] = htons(port);
+}
+
+int StreamClient::find_track(uint16_t src_port, uint16_t dst_port) const
+{
+    for (int i = 1; i >= 0; --i) {
+        if (_track_port[i] && (_track_port[i] == src_port || _track_port[i] == dst_port)) {
+            return i;
+        }
+    }
+    return _track_port[0] ? -1 : 0;
+}
+
+void StreamClient::set_verify_checksum(bool enable)
+{
+    _verify_checksum = enable;
+}
+
+const StreamClient::ChecksumStats &StreamClient::get_checksum_stats() const
+{
+    return _checksum_stats;
+}
+
+const IpFragmentTable::Stats &StreamClient::get_fragment_stats() const
+{
+    return _fragments.getStats();
+}
+
+void StreamClient::set_on_packet(onPacket cb)
+{
+    _packet_cb = std::move(cb);
+}
+
+//拷贝到大页内存中的抓包文件，其余为文件映射
+static std::mutex s_copied_mtx;
+static std::unordered_set<char *> s_copied_files;
+
+static char *copy_file(int fd, long size)
+{
+    auto text = (char *) HugePage::map(size);
+    long done = 0;
+    while (text && done < size) {
+        ssize_t n = read(fd, text + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    if (text && done < size) {
+        HugePage::unmap(text, size);
+        return NULL;
+    }
+    if (text) {
+        std::lock_guard<std::mutex> lck(s_copied_mtx);
+        s_copied_files.emplace(text);
+    }
+    return text;
+}
 
 void StreamClient::read_file(std::string filename, char**msg, long *size)
 {
-    char* text;
-    FILE *pf = fopen(filename.c_str(),"r");
-    fseek(pf,0,SEEK_END);
-    long lSize = ftell(pf);
-    text = (char*)malloc(lSize);
-    rewind(pf); 
-    fread(text,sizeof(char),lSize,pf);
+    *msg = NULL;
+    *size = 0;
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size <= 0) {
+        PrintE("打开文件失败:%s, %s", filename.c_str(), strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
 
-    *size = lSize;
+    char *text = NULL;
+    bool huge = HugePage::isEnabled();
+    if (huge && (uint64_t) st.st_size <= HugePage::getCopyLimit()) {
+        auto available = HugePage::getAvailableMemory();
+        if (available && (uint64_t) st.st_size > available / 2) {
+            PrintW("抓包文件%lld字节超过可用内存%llu的一半，不拷贝到大页内存", (long long) st.st_size, (unsigned long long) available);
+        } else {
+            //页缓存通常不是大页，较小的文件拷贝到透明大页内存中
+            text = copy_file(fd, st.st_size);
+        }
+    } else if (huge) {
+        PrintI("抓包文件%lld字节超过大页拷贝上限%llu，直接映射", (long long) st.st_size, (unsigned long long) HugePage::getCopyLimit());
+    }
+    if (!text && huge) {
+        //按大页对齐映射，内核支持文件透明大页时页缓存也可以按大页映射
+        text = (char *) HugePage::mapFile(fd, st.st_size);
+    } else if (!text) {
+        void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+            text = (char *) ptr;
+        }
+    }
+    if (text && huge) {
+        PrintI("抓包数据大页:%llu/%lld", (unsigned long long) HugePage::getHugeBytes(text), (long long) st.st_size);
+    }
+    close(fd);
+    if (!text) {
+        PrintE("映射文件失败:%s", filename.c_str());
+        return;
+    }
+
+    *size = st.st_size;
     *msg = text;
 }
 
-int StreamClient::on_stream(char* data, long size)
+void StreamClient::close_file(char *msg, long size)
 {
+    if (!msg) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lck(s_copied_mtx);
+        if (s_copied_files.erase(msg)) {
+            HugePage::unmap(msg, size);
+            return;
+        }
+    }
+    munmap(msg, size);
+}
 
-    struct EthernetHeader *eth;
-    struct VLANHeader *vlh;
-    struct IPHeader *iph;
-    struct UDPHeader *udph;
-    struct in_addr addr1, addr2;   
-    long length = size;
+int StreamClient::on_stream(char* data, long size, long offset)
+{
+    if (size < (long)sizeof(struct PcapFileHeader)) {
+        PrintW("pcap文件太小:%ld", size);
+        return -1;
+    }
 
-    long ioc = 0;
-    int rtplengthinudp;
-    int rtplengthinip;
-    char * rtp;
-    ioc = ioc + 24;
-    int ct;
-    ct = 0;
+    struct PcapFileHeader *pfh = (struct PcapFileHeader*)data;
+    //大小端与本机相反的pcap文件
+    bool swap = pfh->magic == 0xd4c3b2a1 || pfh->magic == 0x4d3cb2a1;
+    //纳秒精度的pcap文件
+    bool nano = pfh->magic == 0xa1b23c4d || pfh->magic == 0x4d3cb2a1;
+    long ioc = offset > (long)sizeof(struct PcapFileHeader) ? offset : sizeof(struct PcapFileHeader);
+    long last_checkpoint = ioc;
+    int ct = 0;
 
- 
-    while (ioc <= length) {
+    while (ioc + (long)sizeof(struct PcapRecordHeader) <= size) {
+        struct PcapRecordHeader *prh = (struct PcapRecordHeader*)(data + ioc);
+        uint32_t caplen = swap ? __builtin_bswap32(prh->incl_len) : prh->incl_len;
+        ioc += sizeof(struct PcapRecordHeader);
+        if (ioc + (long)caplen > size) {
+            PrintW("不完整的pcap记录:%u", caplen);
+            break;
+        }
 
         ct += 1;
-        printf("count--->%d\n", ct);
+        PrintT("count--->%d", ct);
+        on_record((char *)prh, caplen, swap, nano);
+        ioc += caplen;
+        check_point(ioc, last_checkpoint);
+        check_memory();
+    }
+    flush_batch();
+    //输入结束，拆出tcp流中剩余的帧，再输出最后一帧
+    flush_tcp_streams();
+    flushFrames();
+    return 0;
+}
+
+int StreamClient::on_compressed_stream(Decompressor &source, long offset)
+{
+    //pcap记录最大长度，超过时认为文件已损坏
+    static const uint32_t kMaxCaplen = 64 * 1024 * 1024;
+    bool started = false;
+    bool swap = false;
+    bool nano = false;
+    //下一条记录在解压后数据中的偏移
+    long ioc = 0;
+    long last_checkpoint = 0;
+    //跨块的不完整记录
+    std::string carry;
+    bool corrupt = false;
+
+    //当前需要的完整数据长度：文件头，记录头，或者记录头加记录数据
+    auto unit_size = [&](const char *ptr, size_t avail) -> size_t {
+        if (!started) {
+            return sizeof(struct PcapFileHeader);
+        }
+        if (avail < sizeof(struct PcapRecordHeader)) {
+            return sizeof(struct PcapRecordHeader);
+        }
+        auto prh = (const struct PcapRecordHeader *)ptr;
+        uint32_t caplen = swap ? __builtin_bswap32(prh->incl_len) : prh->incl_len;
+        if (caplen > kMaxCaplen) {
+            PrintW("非法的pcap记录长度:%u", caplen);
+            corrupt = true;
+        }
+        return sizeof(struct PcapRecordHeader) + caplen;
+    };
+
+    auto on_unit = [&](char *ptr, size_t len) {
+        if (!started) {
+            auto pfh = (struct PcapFileHeader *)ptr;
+            swap = pfh->magic == 0xd4c3b2a1 || pfh->magic == 0x4d3cb2a1;
+            nano = pfh->magic == 0xa1b23c4d || pfh->magic == 0x4d3cb2a1;
+            started = true;
+            ioc = last_checkpoint = len > (size_t)offset ? len : offset;
+            return;
+        }
+        on_record(ptr, len - sizeof(struct PcapRecordHeader), swap, nano);
+        ioc += len;
+        check_point(ioc, last_checkpoint);
+        check_memory();
+    };
+
+    //当前块在解压后数据中的偏移
+    long pos = 0;
+    char *chunk;
+    size_t chunk_size;
+    while (!corrupt && source.read(chunk, chunk_size)) {
+        char *ptr = chunk;
+        size_t left = chunk_size;
+        pos += chunk_size;
+        while (left && !corrupt) {
+            //ptr在解压后数据中的偏移
+            long cur = pos - (long)left;
+            if (started && ioc > cur) {
+                //断点续传，跳过断点之前的数据
+                auto skip = std::min((long)left, ioc - cur);
+                ptr += skip;
+                left -= skip;
+                continue;
+            }
+            if (!carry.empty()) {
+                size_t need;
+                while ((need = unit_size(carry.data(), carry.size())) > carry.size() && left && !corrupt) {
+                    auto n = std::min(need - carry.size(), left);
+                    carry.append(ptr, n);
+                    ptr += n;
+                    left -= n;
+                }
+                if (need > carry.size()) {
+                    break;
+                }
+                on_unit(&carry[0], need);
+                //批量缓存指向carry
+                flush_batch();
+                carry.clear();
+            } else {
+                auto need = unit_size(ptr, left);
+                if (need > left) {
+                    carry.assign(ptr, left);
+                    break;
+                }
+                on_unit(ptr, need);
+                ptr += need;
+                left -= need;
+            }
+        }
+        //块在下一次read()时被回收
+        flush_batch();
+    }
+    if (!carry.empty() && !corrupt) {
+        PrintW("不完整的pcap记录:%u", (uint32_t)carry.size());
+    }
+    //输入结束，拆出tcp流中剩余的帧，再输出最后一帧
+    flush_batch();
+    flush_tcp_streams();
+    flushFrames();
+    return source.hasError() || corrupt ? -1 : 0;
+}
+
+void StreamClient::on_record(char* record, uint32_t caplen, bool swap, bool nano)
+{
+    auto prh = (struct PcapRecordHeader *)record;
+    uint32_t ts_sec = swap ? __builtin_bswap32(prh->ts_sec) : prh->ts_sec;
+    uint32_t ts_frac = swap ? __builtin_bswap32(prh->ts_usec) : prh->ts_usec;
+    set_arrival_time(ts_sec * 1000000ULL + (nano ? ts_frac / 1000 : ts_frac));
+    TraceSpan("packet");
+    on_ethernet(record + sizeof(struct PcapRecordHeader), caplen);
+}
+
+void StreamClient::expire_tcp_streams()
+{
+    _tcp_sweep_us = _arrival_us + kTcpSweepIntervalUs;
+    for (auto it = _tcp_streams.begin(); it != _tcp_streams.end();) {
+        if (_arrival_us > it->second.active_us + kTcpIdleTimeoutUs) {
+            close_tcp_flow(it->second);
+            it = _tcp_streams.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void StreamClient::close_tcp_flow(TcpFlow &flow)
+{
+    auto &stream = flow.stream;
+    if (!stream) {
+        return;
+    }
+    stream->flush();
+    if (stream->getLostBytes() || stream->getResyncCount()) {
+        PrintW("tcp流结束, 丢弃字节数:%llu, 帧头重新同步次数:%llu", (unsigned long long)stream->getLostBytes(),
+               (unsigned long long)stream->getResyncCount());
+    }
+    stream = nullptr;
+}
+
+void StreamClient::flush_tcp_streams()
+{
+    for (auto &pr : _tcp_streams) {
+        close_tcp_flow(pr.second);
+    }
+    _tcp_streams.clear();
+}
+
+void StreamClient::check_point(long ioc, long &last_checkpoint)
+{
+    if (!_checkpoint_cb || ioc - last_checkpoint < _checkpoint_interval) {
+        return;
+    }
+    if (_fragments.hasPending()) {
+        //重组中的ip分片不保存，推迟到之后的记录边界
+        if (!_checkpoint_deferred) {
+            PrintW("有未完成的ip分片，推迟断点, 偏移:%ld", ioc);
+            _checkpoint_deferred = true;
+        }
+        return;
+    }
+    if (_checkpoint_deferred) {
+        PrintI("推迟的断点在偏移%ld处完成，推迟了%ld字节", ioc, ioc - last_checkpoint - _checkpoint_interval);
+        _checkpoint_deferred = false;
+    }
+    //断点保存rtp层与tcp流的状态
+    flush_batch();
+    _checkpoint_cb(ioc);
+    last_checkpoint = ioc;
+}
+
+void StreamClient::check_memory()
+{
+    auto &budget = MemoryBudget::Instance();
+    if (!budget.isThrottle()) {
+        return;
+    }
+    //先处理批量缓存，回收排序缓存时输出的包不会排在批量缓存中的包之前
+    flush_batch();
+    budget.reclaim();
+}
+
+void StreamClient::set_checkpoint(long interval, onCheckpoint cb)
+{
+    _checkpoint_interval = interval;
+    _checkpoint_cb = std::move(cb);
+}
+
+void StreamClient::save_state(CheckpointWriter &writer)
+{
+    flush_batch();
+    writer.write(_arrival_us);
+    writer.write(_checksum_stats);
+    writer.write(_tcp_sweep_us);
+    writer.write((uint32_t) _tcp_streams.size());
+    for (auto &pr : _tcp_streams) {
+        auto &flow = pr.second;
+        writer.write(pr.first);
+        writer.write(flow.active_us);
+        writer.write(flow.start_seq);
+        writer.write(flow.verified);
+        writer.write(flow.rejected);
+        writer.write(flow.fin);
+        writer.write(flow.fin_seq);
+        writer.write((bool) flow.stream);
+        if (flow.stream) {
+            flow.stream->saveState(writer);
+        }
+    }
+    saveState(writer);
+}
 
-        ioc += 16;
-        printf("eth head data:%d, ioc:%d\n", data + (int)ioc, ioc);
-        //接收到的数据帧头6字节是目的MAC地址，紧接着6字节是源MAC地址。
-        eth = (struct EthernetHeader*)(data + (int)ioc);
-        printf("Dest MAC addr:%02x:%02x:%02x:%02x:%02x:%02x\n", eth->dstmac[0], eth->dstmac[1], eth->dstmac[2], eth->dstmac[3], eth->dstmac[4], eth->dstmac[5]);
-        printf("Source MAC addr:%02x:%02x:%02x:%02x:%02x:%02x\n", eth->srcmac[0], eth->srcmac[1], eth->srcmac[2], eth->srcmac[3], eth->srcmac[4], eth->srcmac[5]);
- 
+bool StreamClient::load_state(CheckpointReader &reader)
+{
+    uint32_t count;
+    if (!reader.read(_arrival_us) || !reader.read(_checksum_stats) || !reader.read(_tcp_sweep_us) || !reader.read(count)) {
+        return false;
+    }
+    _tcp_streams.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+        FlowKey key;
+        TcpFlow flow;
+        bool has_stream;
+        if (!reader.read(key) || !reader.read(flow.active_us) || !reader.read(flow.start_seq) || !reader.read(flow.verified)
+            || !reader.read(flow.rejected) || !reader.read(flow.fin) || !reader.read(flow.fin_seq) || !reader.read(has_stream)) {
+            return false;
+        }
+        int track_index = find_track(key.src_port, key.dst_port);
+        if (track_index < 0) {
+            PrintE("tcp流的端口与断点时的track参数不一致");
+            return false;
+        }
+        if (has_stream) {
+            flow.stream = create_tcp_stream(key, track_index);
+            if (!flow.stream->loadState(reader)) {
+                return false;
+            }
+        }
+        _tcp_streams.emplace(key, std::move(flow));
+    }
+    if (!loadState(reader)) {
+        return false;
+    }
+    set_arrival_time(_arrival_us);
+    return true;
+}
 
-        ioc += sizeof(struct EthernetHeader);
-        printf("vln head data:%d, ioc:%d\n", data + (int)ioc, ioc);
-        vlh = (struct VLANHeader*)(data + (int)ioc);
-        printf("VLANHeader:%02x:%02x:%02x:%02x\n", vlh->lan[0], vlh->lan[1], vlh->lan[2], vlh->lan[3]);
+void StreamClient::on_ethernet(char* frame, uint32_t len)
+{
+    if (len < sizeof(struct EthernetHeader)) {
+        return;
+    }
+    //接收到的数据帧头6字节是目的MAC地址，紧接着6字节是源MAC地址。
+    struct EthernetHeader *eth = (struct EthernetHeader*)frame;
+    PrintT("Dest MAC addr:%02x:%02x:%02x:%02x:%02x:%02x", eth->dstmac[0], eth->dstmac[1], eth->dstmac[2], eth->dstmac[3], eth->dstmac[4], eth->dstmac[5]);
+    PrintT("Source MAC addr:%02x:%02x:%02x:%02x:%02x:%02x", eth->srcmac[0], eth->srcmac[1], eth->srcmac[2], eth->srcmac[3], eth->srcmac[4], eth->srcmac[5]);
 
+    uint16_t eth_type = ntohs(eth->eth_type);
+    uint32_t ioc = sizeof(struct EthernetHeader);
+    while (eth_type == ETH_TYPE_VLAN) {
+        //VLANHeader后2字节为内层以太网类型
+        if (ioc + sizeof(struct VLANHeader) > len) {
+            return;
+        }
+        struct VLANHeader *vlh = (struct VLANHeader*)(frame + ioc);
+        PrintT("VLANHeader:%02x:%02x:%02x:%02x", vlh->lan[0], vlh->lan[1], vlh->lan[2], vlh->lan[3]);
+        eth_type = (vlh->lan[2] << 8) | vlh->lan[3];
         ioc += sizeof(struct VLANHeader);
+    }
+
+    if (eth_type != ETH_TYPE_IPV4) {
+        return;
+    }
+    on_ip(frame + ioc, len - ioc);
+}
+
+void StreamClient::on_ip(char* ip, uint32_t len)
+{
+    if (len < sizeof(struct IPHeader)) {
+        return;
+    }
+    struct IPHeader *iph = (struct IPHeader*)ip;
+    uint32_t ihl = iph->ihl * 4;
+    uint32_t tot_len = ntohs(iph->tot_len);
+    if (iph->version != 4 || ihl < sizeof(struct IPHeader) || tot_len < ihl) {
+        return;
+    }
+    //以太网最短帧会有填充，以ip总长度为准
+    if (tot_len < len) {
+        len = tot_len;
+    }
 
-        // ioc += sizeof(struct EthernetHeader);
-        printf("ip head data:%d, ioc:%d\n", data + (int)ioc, ioc);
-        iph = (struct IPHeader*)(data + (int)ioc);
-        rtplengthinip = (int)ntohs(iph->tot_len) - 20 - 8;
-        printf("IPHeader total lentgh:%d\n", iph->tot_len);
-        printf("data:%02x %02x \n", data[ioc], data[ioc+1]);
+    //重组后的首部校验和未更新，分片在重组前已经校验过
+    if (_verify_checksum && !_in_reassembly && !Checksum::verifyIpv4(ip, ihl)) {
+        ++_checksum_stats.ip_errors;
+        return;
+    }
 
-        ioc += sizeof(struct IPHeader);
-        printf("udp head data:%d, ioc:%d\n", data + (int)ioc, ioc);
-        udph = (struct UDPHeader*)(data + (int)ioc);
-        printf("data:%x %x %x %x\n", ntohs(udph->src_port), udph->dst_port, udph->uhl, udph->chk_sum);
-        printf("data:%x %x %x %x\n", data[ioc], data[ioc+1], data[ioc+2], data[ioc+3]);
+    if (IpFragmentTable::isFragment(ip)) {
+        //分片先重组，完整后再重新进入本函数
+        _fragments.input(ip, len, _arrival_us);
+        return;
+    }
 
+    switch (iph->protocol) {
+        case IP_PROTO_UDP:
+            on_udp(iph, ip + ihl, len - ihl);
+            break;
+        case IP_PROTO_TCP:
+            on_tcp(iph, ip + ihl, len - ihl);
+            break;
+        default:
+            break;
+    }
+}
 
-        rtplengthinudp = (int)ntohs(udph->uhl) - 8;
-        printf("rtplength:%d\n", rtplengthinudp);
+void StreamClient::on_udp(const IPHeader* iph, char* udp, uint32_t len)
+{
+    if (len < sizeof(struct UDPHeader)) {
+        return;
+    }
+    struct UDPHeader *udph = (struct UDPHeader*)udp;
+    int rtplengthinudp = (int)ntohs(udph->uhl) - 8;
+    if (rtplengthinudp < 0 || rtplengthinudp > (int)(len - sizeof(struct UDPHeader))) {
+        PrintW("udp长度非法:%d", rtplengthinudp);
+        return;
+    }
+    if (_verify_checksum && !Checksum::verifyUdp(iph, udp, rtplengthinudp + 8)) {
+        ++_checksum_stats.udp_errors;
+        return;
+    }
+    int track_index = find_track(udph->src_port, udph->dst_port);
+    if (track_index < 0) {
+        return;
+    }
+    PrintT("rtplength:%d", rtplengthinudp);
+    if (_packet_cb) {
+        FlowKey key;
+        key.src_ip = iph->srcaddr.s_addr;
+        key.dst_ip = iph->dstaddr.s_addr;
+        key.src_port = udph->src_port;
+        key.dst_port = udph->dst_port;
+        _packet_cb(key, _arrival_us, udp + sizeof(struct UDPHeader), rtplengthinudp);
+        return;
+    }
+    //抓包数据在解析期间一直有效，重组后的数据则不是
+    on_rtp(track_index, udp + sizeof(struct UDPHeader), rtplengthinudp, !_in_reassembly);
+}
 
-        ioc += sizeof(struct UDPHeader);
-        rtp = data + (int)ioc;
-        if(rtplengthinudp < 18) {
-            ioc += 18;
-        } else {
-            ioc += rtplengthinudp;
+void StreamClient::on_tcp(const IPHeader* iph, char* tcp, uint32_t len)
+{
+    if (len < sizeof(struct TCPHeader)) {
+        return;
+    }
+    struct TCPHeader *tcph = (struct TCPHeader*)tcp;
+    uint32_t hdr_len = (tcph->off >> 4) * 4;
+    if (hdr_len < sizeof(struct TCPHeader) || hdr_len > len) {
+        return;
+    }
+
+    FlowKey key;
+    key.src_ip = iph->srcaddr.s_addr;
+    key.dst_ip = iph->dstaddr.s_addr;
+    key.src_port = tcph->src_port;
+    key.dst_port = tcph->dst_port;
+
+    if (tcph->flags & TCP_FLAG_RST) {
+        //连接被重置，不会再有重传，拆出缓存中剩余的帧
+        auto it = _tcp_streams.find(key);
+        if (it != _tcp_streams.end()) {
+            close_tcp_flow(it->second);
+            _tcp_streams.erase(it);
         }
+        return;
+    }
 
-        handleOneRtp(0, TrackVideo, 90000, (unsigned char *) rtp, rtplengthinudp);
-        printf("***********************\n");
+    int track_index = find_track(tcph->src_port, tcph->dst_port);
+    if (track_index < 0) {
+        return;
+    }
+
+    auto payload = tcp + hdr_len;
+    auto payload_len = len - hdr_len;
+    uint32_t seq = ntohl(tcph->seq);
+    bool syn = tcph->flags & TCP_FLAG_SYN;
+    bool fin = tcph->flags & TCP_FLAG_FIN;
+    auto it = _tcp_streams.find(key);
+    if (it == _tcp_streams.end()) {
+        uint32_t start_seq = seq + 1;
+        if (!syn) {
+            //未抓到syn包，从分片中第一个rtp帧开始，纯ack与其他协议的流不记录
+            auto offset = RtpSplitter::findFrameStart(payload, payload_len);
+            if (offset < 0) {
+                return;
+            }
+            start_seq = seq + offset;
+        }
+        it = _tcp_streams.emplace(key, TcpFlow()).first;
+        it->second.start_seq = start_seq;
+        it->second.verified = !syn;
+    }
+    auto &flow = it->second;
+    flow.active_us = _arrival_us;
+    if (syn) {
+        //syn包占用一个序列号，流的第一个字节为其后一个序列号
+        flow.start_seq = seq + 1;
+        flow.verified = flow.rejected = flow.fin = false;
+        if (flow.stream) {
+            flow.stream->inputSegment(seq, payload, 0, true);
+        }
+    }
+    if (payload_len && !flow.rejected && !flow.verified && seq == flow.start_seq) {
+        //流的第一个字节到达，确认是否承载rtp
+        flow.verified = RtpSplitter::isFrameStart(payload, payload_len);
+        flow.rejected = !flow.verified;
+        if (flow.rejected) {
+            //其他协议的流，只保留序列号等状态，不再缓存数据
+            flow.stream = nullptr;
+        }
+    }
+    if (payload_len && !flow.rejected && !flow.stream) {
+        //收到负载时才分配环形缓存，乱序先到达的分片在确认之前也要缓存
+        flow.stream = create_tcp_stream(key, track_index);
+        flow.stream->inputSegment(flow.start_seq - 1, nullptr, 0, true);
+    }
+    if (payload_len && flow.stream) {
+        flow.stream->inputSegment(seq, payload, payload_len);
+    }
 
+    if (fin) {
+        //FIN占用负载之后的序列号
+        flow.fin = true;
+        flow.fin_seq = seq + payload_len;
+    }
+    if (flow.fin && (!flow.stream || (int32_t)(flow.stream->getEndSeq() - flow.fin_seq) >= 0)) {
+        //FIN之前的数据已全部到达，流结束；缺少分片时保留到补齐或者空闲超时
+        close_tcp_flow(flow);
+        _tcp_streams.erase(it);
     }
+}
 
-}
\ No newline at end of file
+std::shared_ptr<TcpStream> StreamClient::create_tcp_stream(const FlowKey &key, int track_index)
+{
+    auto stream = std::make_shared<TcpStream>();
+    stream->setMemoryAccount(getMemoryAccount());
+    stream->setOnRtp([this, track_index, key](char *rtp, uint32_t len, int channel) {
+        if (_packet_cb) {
+            _packet_cb(key, _arrival_us, rtp, len);
+            return;
+        }
+        on_rtp(track_index, rtp, len, false);
+    });
+    return stream;
+}
+
+void StreamClient::on_rtp(int track_index, char* rtp, uint32_t len, bool stable)
+{
+    auto &track = getTrack(track_index);
+    if (!stable) {
+        //先处理之前缓存的包，保证输入顺序
+        flush_batch();
+        handleOneRtp(track_index, track.type, track.samplerate, (unsigned char *) rtp, len);
+        return;
+    }
+
+    RtpPacketDesc desc;
+    desc.track_index = track_index;
+    desc.type = track.type;
+    desc.samplerate = track.samplerate;
+    desc.ptr = (unsigned char *) rtp;
+    desc.len = len;
+    desc.arrival_us = _arrival_us;
+    _batch.emplace_back(desc);
+    if (_batch.size() >= kMaxBatch) {
+        flush_batch();
+    }
+}
+
+void StreamClient::flush_batch()
+{
+    if (_batch.empty()) {
+        return;
+    }
+    TraceSpan("flush_batch");
+    handleRtpBatch(_batch.data(), _batch.size());
+    _batch.clear();
+}
+
+int StreamClient::on_tcp_listen(uint16_t port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        PrintE("创建socket失败:%s", strerror(errno));
+        return -1;
+    }
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 1) < 0) {
+        PrintE("监听tcp端口%d失败:%s", port, strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    PrintI("等待tcp连接, 端口:%d", port);
+    int fd = accept(sock, NULL, NULL);
+    close(sock);
+    if (fd < 0) {
+        PrintE("accept失败:%s", strerror(errno));
+        return -1;
+    }
+
+    //内核已经完成了tcp重组，只需要拆包
+    TcpStream stream;
+    stream.setMemoryAccount(getMemoryAccount());
+    bool warn_audio = getTrack(1).type != TrackInvalid;
+    bool warn_channel = true;
+    stream.setOnRtp([this, &warn_audio, &warn_channel](char *rtp, uint32_t len, int channel) {
+        //interleaved通道号的约定与RtpPacket::interleaved相同，为track下标的2倍
+        int track_index = channel < 0 ? 0 : channel / 2;
+        if (channel < 0 && warn_audio) {
+            PrintW("RFC 4571封装没有通道号，音频track不会收到数据");
+            warn_audio = false;
+        }
+        if (track_index > 1 || getTrack(track_index).type == TrackInvalid) {
+            if (warn_channel) {
+                PrintW("未配置的interleaved通道:%d，丢弃", channel);
+                warn_channel = false;
+            }
+            return;
+        }
+        on_rtp(track_index, rtp, len, false);
+    });
+    auto &budget = MemoryBudget::Instance();
+    char buf[64 * 1024];
+    while (true) {
+        if (budget.isThrottle()) {
+            //接近内存上限，先回收，再放慢读取让tcp窗口向发送端施加背压
+            budget.reclaim();
+            usleep(1000);
+        }
+        if (getIdleTimeout()) {
+            //没有数据时也要检查空闲超时
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (poll(&pfd, 1, getIdleTimeout()) == 0) {
+                checkIdle(getCurrentMicrosecond());
+                continue;
+            }
+        }
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        set_arrival_time(getCurrentMicrosecond());
+        stream.inputData(buf, n);
+    }
+    close(fd);
+    flushFrames();
+    return 0;
+}
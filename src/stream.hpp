@@ -1,7 +1,13 @@
 #include<stdint.h>
 #include<string>
+#include<memory>
+#include<unordered_map>
+#include<functional>
 #include<netinet/in.h>
 #include"RtpReceiver.hpp"
+#include"TcpStream.h"
+#include"IpFragment.h"
+#include"Decompressor.h"
 
 
 class StreamClient : public RtpReceiver{
@@ -9,6 +15,25 @@ class StreamClient : public RtpReceiver{
 
 public:
 
+    struct PcapFileHeader
+    {
+        uint32_t magic; //0xa1b2c3d4
+        uint16_t version_major;
+        uint16_t version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs;
+        uint32_t snaplen;
+        uint32_t linktype; //链路层类型，1为以太网
+    };
+
+    struct PcapRecordHeader
+    {
+        uint32_t ts_sec;
+        uint32_t ts_usec;
+        uint32_t incl_len; //抓取的长度
+        uint32_t orig_len; //原始长度
+    };
+
     struct EthernetHeader
     {
         uint8_t dstmac[6]; //目标mac地址
@@ -51,8 +76,262 @@ public:
         uint16_t chk_sum; //16位udp检验和
     };
 
+    struct TCPHeader
+    {
+        uint16_t src_port; //源端口号
+        uint16_t dst_port; //目的端口号
+        uint32_t seq;     //序列号
+        uint32_t ack;     //确认号
+        uint8_t off;      //高4位为首部长度
+        uint8_t flags;    //FIN/SYN/RST等标志
+        uint16_t window;  //窗口大小
+        uint16_t chk_sum; //检验和
+        uint16_t urg_ptr; //紧急指针
+    };
+
+    //tcp流的四元组
+    struct FlowKey
+    {
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+
+        bool operator==(const FlowKey &that) const {
+            return src_ip == that.src_ip && dst_ip == that.dst_ip && src_port == that.src_port && dst_port == that.dst_port;
+        }
+    };
+
+    struct FlowKeyHash
+    {
+        size_t operator()(const FlowKey &key) const {
+            uint64_t ip = ((uint64_t) key.src_ip << 32) | key.dst_ip;
+            uint32_t port = ((uint32_t) key.src_port << 16) | key.dst_port;
+            return std::hash<uint64_t>()(ip ^ ((uint64_t) port * 0x9E3779B97F4A7C15ULL));
+        }
+    };
+
+    //tcp流状态，收到负载后才创建拆包缓存
+    struct TcpFlow
+    {
+        std::shared_ptr<TcpStream> stream;
+        //最近一次收到分片的时间，微秒
+        uint64_t active_us = 0;
+        //流第一个字节的序列号
+        uint32_t start_seq = 0;
+        //第一个字节已经到达并且是rtp帧头
+        bool verified = false;
+        //不承载rtp的流
+        bool rejected = false;
+        //已收到FIN，等待FIN之前的数据全部到达
+        bool fin = false;
+        //FIN的序列号
+        uint32_t fin_seq = 0;
+    };
+
+    //校验和统计
+    struct ChecksumStats
+    {
+        uint64_t ip_errors = 0;  //ip首部校验和错误的包数
+        uint64_t udp_errors = 0; //udp校验和错误的包数
+    };
+
+    //断点回调，参数为下一条pcap记录的偏移
+    typedef std::function<void(long offset)> onCheckpoint;
+
+    /**
+     * 原始rtp包回调，设置后rtp包不再排序解码
+     * @param flow 包所在的流，网络字节序
+     * @param arrival_us 到达时间(抓包时间)，微秒
+     * @param rtp rtp数据，只在回调期间有效
+     */
+    typedef std::function<void(const FlowKey &flow, uint64_t arrival_us, const char *rtp, uint32_t len)> onPacket;
+
+    StreamClient();
+
+    /**
+     * 映射抓包文件，启用大页时不超过拷贝上限且可用内存充足的文件拷贝到透明大页内存中，
+     * 其余按大页对齐映射并设置MADV_HUGEPAGE
+     * 映射为只读，解析过程不会修改输入数据
+     */
     static void read_file(std::string filename, char**msg, long *size);
 
-    int on_stream(char* data, long size);
+    /**
+     * 释放read_file()映射的内存
+     */
+    static void close_file(char *msg, long size);
+
+    /**
+     * 解析pcap文件数据
+     * @param offset 开始解析的记录偏移，断点续传时为断点中保存的偏移，0为从头开始
+     */
+    int on_stream(char* data, long size, long offset = 0);
+
+    /**
+     * 解析压缩的pcap文件，边解压边解析
+     * 跨块的记录拷贝后再解析，断点回调的偏移为解压后的偏移
+     * @param offset 开始解析的解压后偏移，之前的数据仍需解压但不解析
+     * @return 解压出错返回-1
+     */
+    int on_compressed_stream(Decompressor &source, long offset = 0);
+
+    /**
+     * 设置断点回调，每解析interval字节的pcap数据后，在下一个没有未完成ip分片的记录边界回调，
+     * 回调时批量缓存已处理，可以调用save_state()
+     * @param interval 断点间隔，字节
+     */
+    void set_checkpoint(long interval, onCheckpoint cb);
+
+    /**
+     * 保存流状态，包括tcp流未拆包的数据，用于断点续传
+     */
+    void save_state(CheckpointWriter &writer);
+
+    /**
+     * 恢复save_state()保存的流状态，track等参数必须与保存时一致
+     */
+    bool load_state(CheckpointReader &reader);
+
+    /**
+     * 监听tcp端口，接收RFC 4571或'$' interleaved封装的rtp流，直到对端断开
+     * '$' interleaved封装按通道号区分track，通道0为视频，通道2为音频，奇数通道为rtcp；
+     * RFC 4571封装没有通道号，只输入视频track
+     * @param port 监听端口
+     */
+    int on_tcp_listen(uint16_t port);
+
+    /**
+     * 设置当前数据包的到达时间，离线模式下为抓包时间
+     */
+    void set_arrival_time(uint64_t us);
+
+    /**
+     * 把udp/tcp端口上的流绑定到指定track，源端口或目的端口匹配即可
+     * 未绑定端口的track 1不接收数据；track 0未绑定端口时接收其他全部流
+     * @param track_index track下标索引
+     * @param port 端口，0为取消绑定
+     */
+    void bind_track(int track_index, uint16_t port);
+
+    /**
+     * 开启ip首部与udp校验和校验，校验失败的包在拷贝为rtp包之前丢弃
+     * 本机发出的包在网卡卸载校验和时抓到的校验和是无效的，此时不应开启
+     */
+    void set_verify_checksum(bool enable);
+
+    const ChecksumStats &get_checksum_stats() const;
+
+    /**
+     * ip分片重组统计
+     */
+    const IpFragmentTable::Stats &get_fragment_stats() const;
+
+    /**
+     * 设置原始rtp包回调，用于回放等不需要解码的场景；track的端口绑定仍然有效
+     */
+    void set_on_packet(onPacket cb);
+
+    /**
+     * 解析以太网帧
+     */
+    void on_ethernet(char* frame, uint32_t len);
+
+    /**
+     * 解析ip包
+     */
+    void on_ip(char* ip, uint32_t len);
+
+    /**
+     * 解析udp包
+     */
+    void on_udp(const IPHeader* iph, char* udp, uint32_t len);
+
+    /**
+     * 解析tcp分片
+     */
+    void on_tcp(const IPHeader* iph, char* tcp, uint32_t len);
+
+    /**
+     * 处理批量缓存中的rtp包，缓存指向的数据失效前必须调用
+     */
+    void flush_batch();
+
+private:
+    /**
+     * 解析一条pcap记录
+     * @param record 记录头，之后紧跟caplen字节的数据
+     */
+    void on_record(char* record, uint32_t caplen, bool swap, bool nano);
+
+    /**
+     * 解析了足够多的数据且在记录边界没有未完成的ip分片时回调断点
+     * @param ioc 下一条记录的偏移
+     * @param last_checkpoint 上一次断点的偏移
+     */
+    void check_point(long ioc, long &last_checkpoint);
+
+    /**
+     * 离线解析在记录边界检查内存，超过高水位时提前回收，
+     * 没有发送端可以施加背压，因此只回收不放慢读取
+     */
+    void check_memory();
+
+    /**
+     * 创建tcp流的拆包器
+     */
+    std::shared_ptr<TcpStream> create_tcp_stream(const FlowKey &key, int track_index);
+
+    /**
+     * 删除长时间没有数据的tcp流，未抓到FIN/RST的流以及FIN之前缺少分片的流也能被回收
+     */
+    void expire_tcp_streams();
+
+    /**
+     * 删除tcp流前拆出缓存中剩余的帧，并输出丢弃的统计
+     */
+    void close_tcp_flow(TcpFlow &flow);
+
+    /**
+     * 输入结束，拆出全部tcp流缓存中剩余的帧
+     */
+    void flush_tcp_streams();
+
+    /**
+     * 根据端口查找track
+     * @param src_port 源端口，网络字节序
+     * @param dst_port 目的端口，网络字节序
+     * @return track下标索引，不属于任何track返回-1
+     */
+    int find_track(uint16_t src_port, uint16_t dst_port) const;
+
+    /**
+     * 输入rtp包
+     * @param track_index track下标索引
+     * @param stable rtp数据在整个批量处理期间是否有效，有效时放入批量缓存
+     */
+    void on_rtp(int track_index, char* rtp, uint32_t len, bool stable);
+
+private:
+    //当前数据包的到达时间，微秒
+    uint64_t _arrival_us = 0;
+    //是否正在重组分片，重组缓存在回调结束后即被复用
+    bool _in_reassembly = false;
+    bool _verify_checksum = false;
+    //各track绑定的端口，网络字节序
+    uint16_t _track_port[2] = {0, 0};
+    ChecksumStats _checksum_stats;
+    IpFragmentTable _fragments;
+    //指向抓包数据的rtp包批量缓存
+    std::vector<RtpPacketDesc> _batch;
+    //纯ack的反方向以及其他协议的连接不占用拆包缓存
+    std::unordered_map<FlowKey, TcpFlow, FlowKeyHash> _tcp_streams;
+    //下次检查tcp流空闲的时间，微秒
+    uint64_t _tcp_sweep_us = 0;
+    //断点间隔，字节
+    long _checkpoint_interval = 0;
+    //断点因未完成的ip分片而推迟
+    bool _checkpoint_deferred = false;
+    onCheckpoint _checkpoint_cb;
+    onPacket _packet_cb;
 
 };
@@ -44,6 +44,17 @@ class_name &class_name::Instance() { \
     return s_insteanc_ref; \
 }
 
+//按大端字节序读取16/32位整数，不要求内存对齐
+#define AV_RB16(x)                           \
+    ((((const uint8_t*)(x))[0] << 8) |          \
+      ((const uint8_t*)(x))[1])
+
+#define AV_RB32(x)                                \
+    (((uint32_t)((const uint8_t*)(x))[0] << 24) |    \
+               (((const uint8_t*)(x))[1] << 16) |    \
+               (((const uint8_t*)(x))[2] <<  8) |    \
+                ((const uint8_t*)(x))[3])
+
 using namespace std;
 
 namespace toolkit {